@@ -22,7 +22,6 @@ stdenv.mkDerivation {
 
   env = {
     PREFIX = "${placeholder "out"}";
-    RELEASE = true;
   };
 
   meta = {
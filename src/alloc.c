@@ -0,0 +1,107 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+
+#define ALIGN_UP(n) (((n) + ALLOC_ALIGN - 1) & ~(size_t)(ALLOC_ALIGN - 1))
+
+// blocks are chained through their first bytes, objects start right after
+typedef struct {
+    void *next;
+} pool_block;
+
+static _Thread_local alloc_counters counters;
+
+alloc_counters alloc_thread_counters(void)
+{
+    return counters;
+}
+
+void *counted_malloc(size_t size)
+{
+    counters.allocs++;
+    counters.bytes += size;
+    return malloc(size);
+}
+
+void *counted_calloc(size_t n, size_t size)
+{
+    counters.allocs++;
+    counters.bytes += n * size;
+    return calloc(n, size);
+}
+
+void *counted_realloc(void *ptr, size_t size)
+{
+    counters.allocs++;
+    counters.bytes += size;
+    return realloc(ptr, size);
+}
+
+void counted_free(void *ptr)
+{
+    if (ptr == NULL) return;
+
+    counters.frees++;
+    free(ptr);
+}
+
+void pool_init(pool *p, size_t obj_size, size_t per_block)
+{
+    if (obj_size < sizeof(void *)) obj_size = sizeof(void *);
+
+    *p = (pool){ .obj_size = ALIGN_UP(obj_size), .per_block = per_block ? per_block : 1 };
+}
+
+static
+bool pool_grow(pool *p)
+{
+    size_t header = ALIGN_UP(sizeof(pool_block));
+    unsigned char *block = counted_malloc(header + p->obj_size * p->per_block);
+
+    if (block == NULL) return false;
+
+    ((pool_block *)block)->next = p->blocks;
+    p->blocks = block;
+
+    for (size_t i = p->per_block; i-- > 0;) {
+        void **obj = (void **)(block + header + i * p->obj_size);
+
+        *obj = p->free_list;
+        p->free_list = obj;
+    }
+    return true;
+}
+
+void *pool_get(pool *p)
+{
+    if (p->free_list == NULL && !pool_grow(p)) return NULL;
+
+    void **obj = p->free_list;
+    p->free_list = *obj;
+    p->live++;
+    return obj;
+}
+
+void pool_put(pool *p, void *obj)
+{
+    if (obj == NULL) return;
+
+    *(void **)obj = p->free_list;
+    p->free_list = obj;
+    p->live--;
+}
+
+void pool_destroy(pool *p)
+{
+    while (p->blocks != NULL) {
+        void *next = ((pool_block *)p->blocks)->next;
+
+        counted_free(p->blocks);
+        p->blocks = next;
+    }
+    p->free_list = NULL;
+    p->live = 0;
+}
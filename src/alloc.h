@@ -0,0 +1,35 @@
+#ifndef ALLOC_H
+    #define ALLOC_H
+
+    #include <stddef.h>
+
+enum { ALLOC_ALIGN = 16 };
+
+// Heap traffic of the calling thread, through the counted_* functions only
+typedef struct {
+    size_t allocs;
+    size_t frees;
+    size_t bytes;
+} alloc_counters;
+
+// Fixed size objects recycled through a free list, memory goes back on pool_destroy
+typedef struct {
+    size_t obj_size;
+    size_t per_block;
+    void *free_list;
+    void *blocks;
+    size_t live;
+} pool;
+
+alloc_counters alloc_thread_counters(void);
+void *counted_malloc(size_t size);
+void *counted_calloc(size_t n, size_t size);
+void *counted_realloc(void *ptr, size_t size);
+void counted_free(void *ptr);
+
+void pool_init(pool *p, size_t obj_size, size_t per_block);
+void *pool_get(pool *p);
+void pool_put(pool *p, void *obj);
+void pool_destroy(pool *p);
+
+#endif // ALLOC_H
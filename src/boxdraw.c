@@ -0,0 +1,352 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "boxdraw.h"
+
+// weight of one arm going from the centre of the cell to one of its edges
+enum { NO = 0, LT = 1, HV = 2, DB = 3 };
+enum { UP, RIGHT, DOWN, LEFT };
+
+#define ARMS(up, right, down, left) ((up) | (right) << 2 | (down) << 4 | (left) << 6)
+#define ARM(arms, dir) (((arms) >> ((dir) * 2)) & 3)
+
+// U+2500 to U+257F, arcs and diagonals have no arms and are drawn as curves
+static const uint8_t box_arms[128] = {
+    /* ─ ━ │ ┃ ┄ ┅ ┆ ┇ */
+    ARMS(NO, LT, NO, LT), ARMS(NO, HV, NO, HV), ARMS(LT, NO, LT, NO), ARMS(HV, NO, HV, NO),
+    ARMS(NO, LT, NO, LT), ARMS(NO, HV, NO, HV), ARMS(LT, NO, LT, NO), ARMS(HV, NO, HV, NO),
+    /* ┈ ┉ ┊ ┋ ┌ ┍ ┎ ┏ */
+    ARMS(NO, LT, NO, LT), ARMS(NO, HV, NO, HV), ARMS(LT, NO, LT, NO), ARMS(HV, NO, HV, NO),
+    ARMS(NO, LT, LT, NO), ARMS(NO, HV, LT, NO), ARMS(NO, LT, HV, NO), ARMS(NO, HV, HV, NO),
+    /* ┐ ┑ ┒ ┓ └ ┕ ┖ ┗ */
+    ARMS(NO, NO, LT, LT), ARMS(NO, NO, LT, HV), ARMS(NO, NO, HV, LT), ARMS(NO, NO, HV, HV),
+    ARMS(LT, LT, NO, NO), ARMS(LT, HV, NO, NO), ARMS(HV, LT, NO, NO), ARMS(HV, HV, NO, NO),
+    /* ┘ ┙ ┚ ┛ ├ ┝ ┞ ┟ */
+    ARMS(LT, NO, NO, LT), ARMS(LT, NO, NO, HV), ARMS(HV, NO, NO, LT), ARMS(HV, NO, NO, HV),
+    ARMS(LT, LT, LT, NO), ARMS(LT, HV, LT, NO), ARMS(HV, LT, LT, NO), ARMS(LT, LT, HV, NO),
+    /* ┠ ┡ ┢ ┣ ┤ ┥ ┦ ┧ */
+    ARMS(HV, LT, HV, NO), ARMS(HV, HV, LT, NO), ARMS(LT, HV, HV, NO), ARMS(HV, HV, HV, NO),
+    ARMS(LT, NO, LT, LT), ARMS(LT, NO, LT, HV), ARMS(HV, NO, LT, LT), ARMS(LT, NO, HV, LT),
+    /* ┨ ┩ ┪ ┫ ┬ ┭ ┮ ┯ */
+    ARMS(HV, NO, HV, LT), ARMS(HV, NO, LT, HV), ARMS(LT, NO, HV, HV), ARMS(HV, NO, HV, HV),
+    ARMS(NO, LT, LT, LT), ARMS(NO, LT, LT, HV), ARMS(NO, HV, LT, LT), ARMS(NO, HV, LT, HV),
+    /* ┰ ┱ ┲ ┳ ┴ ┵ ┶ ┷ */
+    ARMS(NO, LT, HV, LT), ARMS(NO, LT, HV, HV), ARMS(NO, HV, HV, LT), ARMS(NO, HV, HV, HV),
+    ARMS(LT, LT, NO, LT), ARMS(LT, LT, NO, HV), ARMS(LT, HV, NO, LT), ARMS(LT, HV, NO, HV),
+    /* ┸ ┹ ┺ ┻ ┼ ┽ ┾ ┿ */
+    ARMS(HV, LT, NO, LT), ARMS(HV, LT, NO, HV), ARMS(HV, HV, NO, LT), ARMS(HV, HV, NO, HV),
+    ARMS(LT, LT, LT, LT), ARMS(LT, LT, LT, HV), ARMS(LT, HV, LT, LT), ARMS(LT, HV, LT, HV),
+    /* ╀ ╁ ╂ ╃ ╄ ╅ ╆ ╇ */
+    ARMS(HV, LT, LT, LT), ARMS(LT, LT, HV, LT), ARMS(HV, LT, HV, LT), ARMS(HV, LT, LT, HV),
+    ARMS(HV, HV, LT, LT), ARMS(LT, LT, HV, HV), ARMS(LT, HV, HV, LT), ARMS(HV, HV, LT, HV),
+    /* ╈ ╉ ╊ ╋ ╌ ╍ ╎ ╏ */
+    ARMS(LT, HV, HV, HV), ARMS(HV, LT, HV, HV), ARMS(HV, HV, HV, LT), ARMS(HV, HV, HV, HV),
+    ARMS(NO, LT, NO, LT), ARMS(NO, HV, NO, HV), ARMS(LT, NO, LT, NO), ARMS(HV, NO, HV, NO),
+    /* ═ ║ ╒ ╓ ╔ ╕ ╖ ╗ */
+    ARMS(NO, DB, NO, DB), ARMS(DB, NO, DB, NO), ARMS(NO, DB, LT, NO), ARMS(NO, LT, DB, NO),
+    ARMS(NO, DB, DB, NO), ARMS(NO, NO, LT, DB), ARMS(NO, NO, DB, LT), ARMS(NO, NO, DB, DB),
+    /* ╘ ╙ ╚ ╛ ╜ ╝ ╞ ╟ */
+    ARMS(LT, DB, NO, NO), ARMS(DB, LT, NO, NO), ARMS(DB, DB, NO, NO), ARMS(LT, NO, NO, DB),
+    ARMS(DB, NO, NO, LT), ARMS(DB, NO, NO, DB), ARMS(LT, DB, LT, NO), ARMS(DB, LT, DB, NO),
+    /* ╠ ╡ ╢ ╣ ╤ ╥ ╦ ╧ */
+    ARMS(DB, DB, DB, NO), ARMS(LT, NO, LT, DB), ARMS(DB, NO, DB, LT), ARMS(DB, NO, DB, DB),
+    ARMS(NO, DB, LT, DB), ARMS(NO, LT, DB, LT), ARMS(NO, DB, DB, DB), ARMS(LT, DB, NO, DB),
+    /* ╨ ╩ ╪ ╫ ╬ ╭ ╮ ╯ */
+    ARMS(DB, LT, NO, LT), ARMS(DB, DB, NO, DB), ARMS(LT, DB, LT, DB), ARMS(DB, LT, DB, LT),
+    ARMS(DB, DB, DB, DB), 0, 0, 0,
+    /* ╰ ╱ ╲ ╳ ╴ ╵ ╶ ╷ */
+    0, 0, 0, 0,
+    ARMS(NO, NO, NO, LT), ARMS(LT, NO, NO, NO), ARMS(NO, LT, NO, NO), ARMS(NO, NO, LT, NO),
+    /* ╸ ╹ ╺ ╻ ╼ ╽ ╾ ╿ */
+    ARMS(NO, NO, NO, HV), ARMS(HV, NO, NO, NO), ARMS(NO, HV, NO, NO), ARMS(NO, NO, HV, NO),
+    ARMS(NO, HV, NO, LT), ARMS(LT, NO, HV, NO), ARMS(NO, LT, NO, HV), ARMS(HV, NO, LT, NO),
+};
+
+// quadrants of U+2596 to U+259F
+enum { QUAD_UL = 1, QUAD_UR = 2, QUAD_LL = 4, QUAD_LR = 8 };
+
+static const uint8_t quadrants[10] = {
+    QUAD_LL, QUAD_LR, QUAD_UL, QUAD_UL | QUAD_LL | QUAD_LR, QUAD_UL | QUAD_LR,
+    QUAD_UL | QUAD_UR | QUAD_LL, QUAD_UL | QUAD_UR | QUAD_LR, QUAD_UR,
+    QUAD_UR | QUAD_LL, QUAD_UR | QUAD_LL | QUAD_LR,
+};
+
+// curves are antialiased by counting SUBSAMPLES x SUBSAMPLES points per pixel
+enum { SUBSAMPLES = 4 };
+
+typedef struct {
+    uint8_t *mask;
+    int w, h;
+    int light; // thickness of a light line, heavy ones are twice as thick
+    uint32_t cp;
+} canvas;
+
+typedef struct {
+    int lo, hi;
+} span;
+
+typedef bool (*shape_fn)(const canvas *cv, float x, float y);
+
+bool boxdraw_supported(uint32_t cp)
+{
+    return (cp >= 0x2500 && cp <= 0x259F) || (cp >= 0x2800 && cp <= 0x28FF);
+}
+
+static
+void fill(canvas *cv, int x0, int y0, int x1, int y1, uint8_t value)
+{
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > cv->w) x1 = cv->w;
+    if (y1 > cv->h) y1 = cv->h;
+
+    for (int y = y0; y < y1; y++)
+        memset(cv->mask + (size_t)y * cv->w + x0, value, x1 > x0 ? x1 - x0 : 0);
+}
+
+// Like fill(), with the axes swapped for vertical arms
+static
+void fill_along(canvas *cv, bool horizontal, span along, span across)
+{
+    if (horizontal) fill(cv, along.lo, across.lo, along.hi, across.hi, 255);
+    else fill(cv, across.lo, along.lo, across.hi, along.hi, 255);
+}
+
+static
+void fill_shape(canvas *cv, shape_fn inside)
+{
+    for (int y = 0; y < cv->h; y++) {
+        for (int x = 0; x < cv->w; x++) {
+            int hits = 0;
+
+            for (int sy = 0; sy < SUBSAMPLES; sy++)
+                for (int sx = 0; sx < SUBSAMPLES; sx++)
+                    hits += inside(cv, x + (sx + 0.5f) / SUBSAMPLES, y + (sy + 0.5f) / SUBSAMPLES);
+
+            uint8_t *px = cv->mask + (size_t)y * cv->w + x;
+            uint8_t value = hits * 255 / (SUBSAMPLES * SUBSAMPLES);
+
+            if (value > *px) *px = value;
+        }
+    }
+}
+
+// Pixels a stroke of `weight` takes across an axis of `len`, both lines for a double one
+static
+span stroke(const canvas *cv, int len, int weight)
+{
+    int thick = (weight == DB) ? cv->light * 3 : (weight == HV) ? cv->light * 2 : cv->light;
+    int lo = (len - thick) / 2;
+
+    return (span){ lo, lo + thick };
+}
+
+// How far an arm reaching in from the low (or high) edge goes to cover all of `s`
+static
+int reach_far(span s, bool from_low)
+{
+    return from_low ? s.hi : s.lo;
+}
+
+// How far it goes to stop right after the first line of a double stroke
+static
+int reach_near(const canvas *cv, span s, bool from_low)
+{
+    return from_low ? s.lo + cv->light : s.hi - cv->light;
+}
+
+static
+span arm_extent(int reach, int len, bool from_low)
+{
+    return from_low ? (span){ 0, reach } : (span){ reach, len };
+}
+
+// One line of a double arm, `facing` is the perpendicular arm on its side
+static
+int double_line_reach(const canvas *cv, int arms, int facing, int len, bool from_low)
+{
+    int near = ARM(arms, facing);
+    int far = ARM(arms, (facing + 2) & 3);
+
+    // the inner corner of two double lines
+    if (near == DB) return reach_near(cv, stroke(cv, len, DB), from_low);
+    if (near != NO) return len / 2;
+    // the outer corner, or a double line bending into a single one
+    if (far != NO) return reach_far(stroke(cv, len, far), from_low);
+    return len / 2;
+}
+
+static
+void draw_arm(canvas *cv, int arms, int dir, int dashes)
+{
+    int weight = ARM(arms, dir);
+    bool horizontal = (dir == LEFT || dir == RIGHT);
+    bool from_low = (dir == LEFT || dir == UP);
+    int len = horizontal ? cv->w : cv->h;
+    int across_len = horizontal ? cv->h : cv->w;
+    int side_lo = horizontal ? UP : LEFT;
+    int side_hi = horizontal ? DOWN : RIGHT;
+    int w_lo = ARM(arms, side_lo);
+    int w_hi = ARM(arms, side_hi);
+
+    if (weight == NO) return;
+
+    if (weight == DB) {
+        span both = stroke(cv, across_len, DB);
+        span first = { both.lo, both.lo + cv->light };
+        span second = { both.hi - cv->light, both.hi };
+
+        fill_along(cv, horizontal,
+            arm_extent(double_line_reach(cv, arms, side_lo, len, from_low), len, from_low), first);
+        fill_along(cv, horizontal,
+            arm_extent(double_line_reach(cv, arms, side_hi, len, from_low), len, from_low), second);
+        return;
+    }
+
+    span across = stroke(cv, across_len, weight);
+    int widest = (w_lo > w_hi) ? w_lo : w_hi;
+    int reach;
+
+    if (dashes > 0) {
+        // dashed lines run the whole cell by themselves, one gap per dash
+        int step = len / dashes;
+        int gap = (step / 2 > 0) ? step / 2 : 1;
+
+        for (int i = 0; i < dashes; i++) {
+            int lo = i * len / dashes + gap / 2;
+            fill_along(cv, horizontal, (span){ lo, lo + step - gap }, across);
+        }
+        return;
+    }
+
+    if (widest == NO) reach = reach_far(stroke(cv, len, weight), from_low);
+    // a single line ending on a double one going straight through stops at its first line
+    else if (w_lo != NO && w_hi != NO && widest == DB && ARM(arms, (dir + 2) & 3) == NO)
+        reach = reach_near(cv, stroke(cv, len, DB), from_low);
+    else reach = reach_far(stroke(cv, len, widest), from_low);
+
+    fill_along(cv, horizontal, arm_extent(reach, len, from_low), across);
+}
+
+static
+float centre(span s)
+{
+    return (s.lo + s.hi) / 2.0f;
+}
+
+// ╭ ╮ ╯ ╰, a quarter circle joining the light lines of the neighbouring cells
+static
+bool inside_arc(const canvas *cv, float x, float y)
+{
+    float cx = centre(stroke(cv, cv->w, LT));
+    float cy = centre(stroke(cv, cv->h, LT));
+    float half = cv->light / 2.0f;
+    int dx = (cv->cp == 0x256D || cv->cp == 0x2570) ? 1 : -1;
+    int dy = (cv->cp == 0x256D || cv->cp == 0x256E) ? 1 : -1;
+    float r = cx;
+
+    if (cv->w - cx < r) r = cv->w - cx;
+    if (cy < r) r = cy;
+    if (cv->h - cy < r) r = cv->h - cy;
+
+    float ox = cx + dx * r;
+    float oy = cy + dy * r;
+    bool past_x = (x - ox) * dx >= 0;
+    bool past_y = (y - oy) * dy >= 0;
+
+    if (past_x) return y >= cy - half && y <= cy + half;
+    if (past_y) return x >= cx - half && x <= cx + half;
+
+    float d2 = (x - ox) * (x - ox) + (y - oy) * (y - oy);
+    float inner = (r > half) ? r - half : 0;
+    return d2 >= inner * inner && d2 <= (r + half) * (r + half);
+}
+
+// ╱ ╲ ╳, corner to corner so they continue into the diagonal neighbours
+static
+bool inside_diagonal(const canvas *cv, float x, float y)
+{
+    float w = cv->w, h = cv->h;
+    float limit = (cv->light / 2.0f) * (cv->light / 2.0f) * (w * w + h * h);
+    float rising = h * x + w * y - w * h;
+    float falling = h * x - w * y;
+
+    if (cv->cp != 0x2572 && rising * rising <= limit) return true;
+    return cv->cp != 0x2571 && falling * falling <= limit;
+}
+
+static
+void draw_block(canvas *cv, uint32_t cp)
+{
+    int w = cv->w, h = cv->h;
+    // rounded so that eighths of a cell tile it exactly
+    #define EIGHTHS(len, n) (((len) * (n) + 4) / 8)
+
+    if (cp == 0x2580) fill(cv, 0, 0, w, EIGHTHS(h, 4), 255);
+    else if (cp <= 0x2588) fill(cv, 0, h - EIGHTHS(h, cp - 0x2580), w, h, 255);
+    else if (cp <= 0x258F) fill(cv, 0, 0, EIGHTHS(w, 0x2590 - cp), h, 255);
+    else if (cp == 0x2590) fill(cv, EIGHTHS(w, 4), 0, w, h, 255);
+    // shades are flat blends of both colours rather than dither patterns
+    else if (cp <= 0x2593) fill(cv, 0, 0, w, h, (cp - 0x2590) * 64);
+    else if (cp == 0x2594) fill(cv, 0, 0, w, EIGHTHS(h, 1), 255);
+    else if (cp == 0x2595) fill(cv, w - EIGHTHS(w, 1), 0, w, h, 255);
+    else {
+        int q = quadrants[cp - 0x2596];
+        int mx = EIGHTHS(w, 4), my = EIGHTHS(h, 4);
+
+        if (q & QUAD_UL) fill(cv, 0, 0, mx, my, 255);
+        if (q & QUAD_UR) fill(cv, mx, 0, w, my, 255);
+        if (q & QUAD_LL) fill(cv, 0, my, mx, h, 255);
+        if (q & QUAD_LR) fill(cv, mx, my, w, h, 255);
+    }
+    #undef EIGHTHS
+}
+
+// Dots on a 2 x 4 grid, numbered down the left column then the right one
+static
+void draw_braille(canvas *cv, uint32_t cp)
+{
+    static const uint8_t dot_bit[4][2] = { { 0x01, 0x08 }, { 0x02, 0x10 }, { 0x04, 0x20 }, { 0x40, 0x80 } };
+    int cell_w = cv->w / 2, cell_h = cv->h / 4;
+    // square dots on whole pixels stay crisp at any size
+    int side = ((cell_w < cell_h) ? cell_w : cell_h) / 2;
+
+    if (side < 1) side = 1;
+
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 2; col++) {
+            if (!(cp & dot_bit[row][col])) continue;
+
+            int x = col * cv->w / 2 + (cell_w - side) / 2;
+            int y = row * cv->h / 4 + (cell_h - side) / 2;
+            fill(cv, x, y, x + side, y + side, 255);
+        }
+    }
+}
+
+static
+int dash_count(uint32_t cp)
+{
+    if (cp >= 0x2504 && cp <= 0x2507) return 3;
+    if (cp >= 0x2508 && cp <= 0x250B) return 4;
+    if (cp >= 0x254C && cp <= 0x254F) return 2;
+    return 0;
+}
+
+void boxdraw_render(uint32_t cp, uint8_t *mask, int w, int h)
+{
+    canvas cv = { mask, w, h, (w + 4) / 8 > 0 ? (w + 4) / 8 : 1, cp };
+
+    memset(mask, 0, (size_t)w * h);
+
+    if (cp >= 0x2800) draw_braille(&cv, cp);
+    else if (cp >= 0x2580) draw_block(&cv, cp);
+    else if (cp >= 0x256D && cp <= 0x2570) fill_shape(&cv, inside_arc);
+    else if (cp >= 0x2571 && cp <= 0x2573) fill_shape(&cv, inside_diagonal);
+    else {
+        int arms = box_arms[cp - 0x2500];
+
+        for (int dir = UP; dir <= LEFT; dir++) draw_arm(&cv, arms, dir, dash_count(cp));
+    }
+}
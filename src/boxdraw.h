@@ -0,0 +1,17 @@
+#ifndef BOXDRAW_H
+    #define BOXDRAW_H
+
+    #include <stdbool.h>
+    #include <stdint.h>
+
+/*
+ * Box drawing (U+2500-U+257F), block elements (U+2580-U+259F) and braille
+ * (U+2800-U+28FF) are drawn from geometry at the cell size instead of taken
+ * from the font, so lines join across cells without gaps.
+ */
+bool boxdraw_supported(uint32_t cp);
+
+// Fills `mask`, `w` * `h` bytes, with the coverage of `cp` from 0 to 255
+void boxdraw_render(uint32_t cp, uint8_t *mask, int w, int h);
+
+#endif // BOXDRAW_H
@@ -0,0 +1,148 @@
+#include <string.h>
+
+#include <SDL3/SDL_clipboard.h>
+
+#include "alloc.h"
+#include "clipboard.h"
+#include "log.h"
+#include "macro_utils.h"
+
+static
+bool clip_append(clip_source *clip, const char *s, size_t n)
+{
+    if (clip->len + n > clip->cap) {
+        size_t cap = (clip->cap > 0) ? clip->cap : 4096;
+
+        while (cap < clip->len + n) cap *= 2;
+
+        char *grown = counted_realloc(clip->text, cap);
+        if (grown == NULL) return false;
+
+        clip->text = grown;
+        clip->cap = cap;
+    }
+
+    memcpy(clip->text + clip->len, s, n);
+    clip->len += n;
+    return true;
+}
+
+static
+void *clip_worker(void *arg)
+{
+    clip_source *clip = arg;
+
+    for (uint64_t line = clip->from.line; line <= clip->to.line; line += CLIP_CHUNK_LINES) {
+        uint64_t last = (clip->to.line - line < CLIP_CHUNK_LINES) ? clip->to.line : line + CLIP_CHUNK_LINES - 1;
+        size_t len;
+
+        if (atomic_load(&clip->cancel)) break;
+
+        char *chunk = screen_selection_text(clip->scr, clip->from, clip->to, line, last, &len);
+        if (chunk == NULL) break;
+
+        bool appended = clip_append(clip, chunk, len) && (last == clip->to.line || clip_append(clip, "\n", 1));
+
+        counted_free(chunk);
+        if (!appended) {
+            pretty_log(PRETTY_ERROR, "Out of memory after copying %zu bytes of the selection", clip->len);
+            break;
+        }
+    }
+    atomic_fetch_sub(&clip->scr->borrowed, 1);
+
+    pthread_mutex_lock(&clip->lock);
+    clip->done = true;
+    pthread_cond_broadcast(&clip->ready);
+    pthread_mutex_unlock(&clip->lock);
+    return NULL;
+}
+
+static
+void clip_wait(clip_source *clip)
+{
+    pthread_mutex_lock(&clip->lock);
+    while (!clip->done) pthread_cond_wait(&clip->ready, &clip->lock);
+    pthread_mutex_unlock(&clip->lock);
+}
+
+// Asked for on the UI thread when an application pastes, for any of the mime types
+static
+const void *clip_data(void *userdata, const char *mime_type, size_t *size)
+{
+    clip_source *clip = userdata;
+
+    UNUSED(mime_type);
+    clip_wait(clip);
+
+    *size = clip->len;
+    return (clip->text != NULL) ? clip->text : "";
+}
+
+// Something else went to the clipboard, or it was cleared
+static
+void clip_cleanup(void *userdata)
+{
+    clip_source *clip = userdata;
+
+    atomic_store(&clip->cancel, true);
+    pthread_join(clip->thread, NULL);
+
+    if (clip->owner != NULL && *clip->owner == clip) *clip->owner = NULL;
+    counted_free(clip->text);
+    counted_free(clip);
+}
+
+// Offers the selection of `scr` to the clipboard, reading it starts right away on a worker
+bool clip_copy(screen *scr, clip_source **owner)
+{
+    static const char *mime_types[] = {
+        "text/plain;charset=utf-8", "text/plain", "UTF8_STRING", "TEXT", "STRING"
+    };
+    text_pos from, to;
+
+    if (!screen_selection(scr, &from, &to)) return false;
+
+    clip_source *clip = counted_malloc(sizeof *clip);
+    if (clip == NULL) return false;
+
+    *clip = (clip_source){
+        .scr = scr,
+        .from = from,
+        .to = to,
+        .owner = owner,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .ready = PTHREAD_COND_INITIALIZER,
+    };
+
+    atomic_fetch_add(&scr->borrowed, 1);
+    if (pthread_create(&clip->thread, NULL, clip_worker, clip) != 0) {
+        atomic_fetch_sub(&scr->borrowed, 1);
+        counted_free(clip);
+        return false;
+    }
+
+    // the source we offered before, if any, is cleaned up first
+    if (!SDL_SetClipboardData(clip_data, clip_cleanup, clip, mime_types, length_of(mime_types))) {
+        pretty_log(PRETTY_ERROR, "Couldn't copy the selection: %s", SDL_GetError());
+        clip_cleanup(clip);
+        return false;
+    }
+
+    *owner = clip;
+    pretty_log(PRETTY_DEBUG, "copying lines %llu to %llu",
+        (unsigned long long)from.line, (unsigned long long)to.line);
+    return true;
+}
+
+// Lets the clipboard keep the text once the screen it came from goes away
+void clip_detach(clip_source **owner)
+{
+    clip_source *clip = *owner;
+
+    if (clip == NULL) return;
+
+    clip_wait(clip);
+    clip->owner = NULL;
+    *owner = NULL;
+}
@@ -0,0 +1,40 @@
+#ifndef CLIPBOARD_H
+    #define CLIPBOARD_H
+
+    #include <pthread.h>
+    #include <stdatomic.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+
+    #include "screen.h"
+
+// selected lines read per hold of the screen lock
+enum { CLIP_CHUNK_LINES = 1024 };
+
+/*
+ * A copied selection on its way to the clipboard. Selecting only moves two
+ * positions, the text is read from the screen by a worker thread once a
+ * copy is asked for, a chunk of lines at a time. An application pasting it
+ * waits for the worker if it hasn't finished yet.
+ */
+typedef struct clip_source {
+    screen *scr; // borrowed until the worker is done
+    text_pos from;
+    text_pos to;
+    struct clip_source **owner; // cleared when the clipboard drops the source
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    atomic_bool cancel;
+    bool done;
+
+    char *text;
+    size_t len;
+    size_t cap;
+} clip_source;
+
+bool clip_copy(screen *scr, clip_source **owner);
+void clip_detach(clip_source **owner);
+
+#endif // CLIPBOARD_H
@@ -8,12 +8,14 @@
 #include "config.h"
 #include "macro_utils.h"
 #include "log.h"
+#include "slave.h"
 
 static char CONFIG_PATH_SUFFIX[] = "/pretty/config.toml";
 
 enum type {
     V_STRING,
     V_NUMBER,
+    V_SIZE,
     V_COLOR,
 };
 
@@ -29,49 +31,55 @@ static generic_config CONFIG = {
     .font_size = 12,
     .pad_x = 12,
     .pad_y = 12,
+    .buffer_size = TTY_RING_DEFAULT_CAP,
+    .buffer_max_size = TTY_RING_DEFAULT_MAX_CAP,
     .color_palette = {
-        "000000FF",
-        "AA0000FF",
-        "00AA00FF",
-        "AA5500FF",
-        "0000AAFF",
-        "AA00AAFF",
-        "00AAAAFF",
-        "AAAAAAFF",
-        "555555FF",
-        "FF5555FF",
-        "55FF55FF",
-        "FFFF55FF",
-        "5555FFFF",
-        "FF55FFFF",
-        "55FFFFFF",
-        "FFFFFFFF",
-        [COLOR_BACKGROUND] = "000000FF"
+        0x000000FF,
+        0xAA0000FF,
+        0x00AA00FF,
+        0xAA5500FF,
+        0x0000AAFF,
+        0xAA00AAFF,
+        0x00AAAAFF,
+        0xAAAAAAFF,
+        0x555555FF,
+        0xFF5555FF,
+        0x55FF55FF,
+        0xFFFF55FF,
+        0x5555FFFF,
+        0xFF55FFFF,
+        0x55FFFFFF,
+        0xFFFFFFFF,
+        [COLOR_BACKGROUND] = 0x000000FF,
+        [COLOR_FOREGROUND] = 0xFFFFFFFF,
     }
 };
 
 static struct cval CONFIG_VALIDATION[] = {
-   { "font",    "family",     V_STRING, &CONFIG.font_name                      },
-   { "font",    "size",       V_NUMBER, &CONFIG.font_size                      },
-   { "window",  "pad_x",      V_NUMBER, &CONFIG.pad_x                          },
-   { "window",  "pad_y",      V_NUMBER, &CONFIG.pad_y                          },
-   { "palette", "background", V_COLOR,  CONFIG.color_palette[COLOR_BACKGROUND] },
-   { "palette", "color0",     V_COLOR,  CONFIG.color_palette[0]                },
-   { "palette", "color1",     V_COLOR,  CONFIG.color_palette[1]                },
-   { "palette", "color2",     V_COLOR,  CONFIG.color_palette[2]                },
-   { "palette", "color3",     V_COLOR,  CONFIG.color_palette[3]                },
-   { "palette", "color4",     V_COLOR,  CONFIG.color_palette[4]                },
-   { "palette", "color5",     V_COLOR,  CONFIG.color_palette[5]                },
-   { "palette", "color6",     V_COLOR,  CONFIG.color_palette[6]                },
-   { "palette", "color7",     V_COLOR,  CONFIG.color_palette[7]                },
-   { "palette", "color8",     V_COLOR,  CONFIG.color_palette[8]                },
-   { "palette", "color9",     V_COLOR,  CONFIG.color_palette[9]                },
-   { "palette", "color10",    V_COLOR,  CONFIG.color_palette[10]               },
-   { "palette", "color11",    V_COLOR,  CONFIG.color_palette[11]               },
-   { "palette", "color12",    V_COLOR,  CONFIG.color_palette[12]               },
-   { "palette", "color13",    V_COLOR,  CONFIG.color_palette[13]               },
-   { "palette", "color14",    V_COLOR,  CONFIG.color_palette[14]               },
-   { "palette", "color15",    V_COLOR,  CONFIG.color_palette[15]               },
+   { "font",     "family",          V_STRING, &CONFIG.font_name                      },
+   { "font",     "size",            V_NUMBER, &CONFIG.font_size                      },
+   { "window",   "pad_x",           V_NUMBER, &CONFIG.pad_x                          },
+   { "window",   "pad_y",           V_NUMBER, &CONFIG.pad_y                          },
+   { "terminal", "buffer_size",     V_SIZE,   &CONFIG.buffer_size                    },
+   { "terminal", "buffer_max_size", V_SIZE,   &CONFIG.buffer_max_size                },
+   { "palette",  "background",      V_COLOR,  &CONFIG.color_palette[COLOR_BACKGROUND] },
+   { "palette",  "foreground",      V_COLOR,  &CONFIG.color_palette[COLOR_FOREGROUND] },
+   { "palette",  "color0",          V_COLOR,  &CONFIG.color_palette[0]               },
+   { "palette",  "color1",          V_COLOR,  &CONFIG.color_palette[1]               },
+   { "palette",  "color2",          V_COLOR,  &CONFIG.color_palette[2]               },
+   { "palette",  "color3",          V_COLOR,  &CONFIG.color_palette[3]               },
+   { "palette",  "color4",          V_COLOR,  &CONFIG.color_palette[4]               },
+   { "palette",  "color5",          V_COLOR,  &CONFIG.color_palette[5]               },
+   { "palette",  "color6",          V_COLOR,  &CONFIG.color_palette[6]               },
+   { "palette",  "color7",          V_COLOR,  &CONFIG.color_palette[7]               },
+   { "palette",  "color8",          V_COLOR,  &CONFIG.color_palette[8]               },
+   { "palette",  "color9",          V_COLOR,  &CONFIG.color_palette[9]               },
+   { "palette",  "color10",         V_COLOR,  &CONFIG.color_palette[10]              },
+   { "palette",  "color11",         V_COLOR,  &CONFIG.color_palette[11]              },
+   { "palette",  "color12",         V_COLOR,  &CONFIG.color_palette[12]              },
+   { "palette",  "color13",         V_COLOR,  &CONFIG.color_palette[13]              },
+   { "palette",  "color14",         V_COLOR,  &CONFIG.color_palette[14]              },
+   { "palette",  "color15",         V_COLOR,  &CONFIG.color_palette[15]              },
 };
 
 static
@@ -145,6 +153,24 @@ char *parse_value(struct cval *p, char *s)
 
             *(unsigned char *)p->target = n;
             break;
+        case V_SIZE:
+            if (*s == '\"') s++;
+
+            n = strtoul(s, &s, 10);
+
+            switch (toupper(*s)) {
+                case 'M':
+                    n *= 1024;
+                    /* fallthrough */
+                case 'K':
+                    n *= 1024;
+                    s++;
+                    break;
+            }
+
+            if (*s == '\"') s++;
+            *(size_t *)p->target = n;
+            break;
         case V_COLOR:
             if (*s != '\"') pretty_log(PRETTY_ERROR, "Missing start quote!");
             else s++;
@@ -161,7 +187,8 @@ char *parse_value(struct cval *p, char *s)
                 break;
             }
 
-            memcpy(p->target, s, n);
+            // packed once here, a colour without alpha is opaque
+            *(uint32_t *)p->target = (n == 6) ? strtoul(s, NULL, 16) << 8 | 0xFF : strtoul(s, NULL, 16);
             s += n;
 
             if (*s != '\"') pretty_log(PRETTY_ERROR, "Missing end quote!");
@@ -209,6 +236,25 @@ char *parse_key_value(char const *section_name, char *s)
     return parse_value(p, s);
 }
 
+// Indices 16 to 231 are a 6x6x6 colour cube, 232 to 255 a grey ramp
+static
+void fill_extended_palette(uint32_t *palette)
+{
+    static const uint8_t levels[6] = { 0x00, 0x5F, 0x87, 0xAF, 0xD7, 0xFF };
+
+    for (int i = 0; i < 216; i++) {
+        uint32_t r = levels[i / 36], g = levels[(i / 6) % 6], b = levels[i % 6];
+
+        palette[16 + i] = r << 24 | g << 16 | b << 8 | 0xFF;
+    }
+
+    for (int i = 0; i < 24; i++) {
+        uint32_t v = 8 + i * 10;
+
+        palette[232 + i] = v << 24 | v << 16 | v << 8 | 0xFF;
+    }
+}
+
 generic_config *return_config(char *cat_config)
 {
     // TODO: write a even better parser
@@ -239,5 +285,7 @@ generic_config *return_config(char *cat_config)
 skip:
         s += strcspn(s, "\n");
     }
+
+    fill_extended_palette(CONFIG.color_palette);
     return &CONFIG;
 }
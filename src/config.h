@@ -1,6 +1,9 @@
 #ifndef CONFIG_H
     #define CONFIG_H
 
+    #include <stddef.h>
+    #include <stdint.h>
+
     #include "macro_utils.h"
     #include <SDL3/SDL_pixels.h>
 
@@ -26,9 +29,11 @@ typedef struct {
     config_section *window;
 } config_struct;
 
+// the 256 indexed colours come first, 16 to 255 are derived from the xterm cube
 enum {
   REVERSED_COLOR = 15,
-  COLOR_BACKGROUND,
+  COLOR_BACKGROUND = 256,
+  COLOR_FOREGROUND,
   COLOR_COUNT,
 };
 
@@ -37,7 +42,9 @@ typedef struct {
     unsigned int font_size;
     unsigned int pad_x;
     unsigned int pad_y;
-    char color_palette[COLOR_COUNT][length_of("rrggbbaa") + 1];
+    size_t buffer_size;
+    size_t buffer_max_size;
+    uint32_t color_palette[COLOR_COUNT]; // packed as 0xRRGGBBAA
 } generic_config;
 
 generic_config *return_config(char *cat_config);
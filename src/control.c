@@ -0,0 +1,308 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "control.h"
+#include "screen.h"
+#include "log.h"
+#include "trace.h"
+
+static
+char *default_path(void)
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    char buff[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+    if (dir != NULL && *dir != '\0')
+        snprintf(buff, sizeof(buff), "%s/pretty-%d.sock", dir, getpid());
+    else snprintf(buff, sizeof(buff), "/tmp/pretty-%u-%d.sock", getuid(), getpid());
+
+    return strdup(buff);
+}
+
+bool control_open(control *ctl, const char *path, render_stats *render)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    *ctl = (control){ .listen_fd = -1, .render = render, .sample_start = trace_now_ns() };
+    ctl->path = (path != NULL) ? strdup(path) : default_path();
+
+    if (ctl->path == NULL) return false;
+
+    if (strlen(ctl->path) >= sizeof(addr.sun_path)) {
+        pretty_log(PRETTY_ERROR, "Control socket path [%s] is too long", ctl->path);
+        goto fail;
+    }
+    memcpy(addr.sun_path, ctl->path, strlen(ctl->path) + 1);
+
+    ctl->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ctl->listen_fd < 0) {
+        pretty_log(PRETTY_ERROR, "Couldn't create control socket: %s", strerror(errno));
+        goto fail;
+    }
+
+    if (bind(ctl->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || listen(ctl->listen_fd, CONTROL_MAX_CLIENTS) < 0)
+    {
+        pretty_log(PRETTY_ERROR, "Couldn't listen on [%s]: %s", ctl->path, strerror(errno));
+        goto fail;
+    }
+
+    pretty_log(PRETTY_INFO, "Control socket listening on [%s]", ctl->path);
+    return true;
+
+fail:
+    if (ctl->listen_fd >= 0) close(ctl->listen_fd);
+    free(ctl->path);
+    *ctl = (control){ .listen_fd = -1 };
+    return false;
+}
+
+void control_close(control *ctl)
+{
+    if (ctl->listen_fd < 0) return;
+
+    if (ctl->started) {
+        atomic_store(&ctl->should_exit, true);
+        pthread_join(ctl->thread, NULL);
+    }
+
+    for (int i = 0; i < ctl->nclients; i++) close(ctl->clients[i].fd);
+    close(ctl->listen_fd);
+    unlink(ctl->path);
+    free(ctl->path);
+    *ctl = (control){ .listen_fd = -1 };
+}
+
+// The listening socket comes first, then one entry per client
+static
+int control_pollfds(const control *ctl, struct pollfd *fds)
+{
+    fds[0] = (struct pollfd){ .fd = ctl->listen_fd, .events = POLLIN };
+    for (int i = 0; i < ctl->nclients; i++)
+        fds[i + 1] = (struct pollfd){ .fd = ctl->clients[i].fd, .events = POLLIN };
+
+    return ctl->nclients + 1;
+}
+
+void render_stats_frame(render_stats *stats, uint64_t ns)
+{
+    size_t n = atomic_fetch_add_explicit(&stats->frame_count, 1, memory_order_relaxed);
+
+    atomic_store_explicit(&stats->frame_us[n % FRAME_TIME_SAMPLES],
+        (uint32_t)(ns / 1000), memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->frames_rendered, 1, memory_order_relaxed);
+}
+
+static
+int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static
+double percentile_ms(const uint32_t *sorted, size_t n, int pct)
+{
+    if (n == 0) return 0;
+    return sorted[(n - 1) * pct / 100] / 1000.0;
+}
+
+static
+void drop_client(control *ctl, int i)
+{
+    close(ctl->clients[i].fd);
+    ctl->clients[i] = ctl->clients[--ctl->nclients];
+}
+
+// Best effort, a client that can't keep up with a few hundred bytes is dropped
+static
+bool client_send(control_client *client, const char *buff, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = send(client->fd, buff, len, MSG_NOSIGNAL);
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+
+        buff += n;
+        len -= n;
+    }
+    return true;
+}
+
+static
+int format_stats(control *ctl, tty_state *tty, char *buff, size_t size)
+{
+    render_stats *render = ctl->render;
+    uint32_t frames[FRAME_TIME_SAMPLES];
+    size_t nframes = atomic_load_explicit(&render->frame_count, memory_order_relaxed);
+    size_t lines, history_bytes;
+
+    if (nframes > FRAME_TIME_SAMPLES) nframes = FRAME_TIME_SAMPLES;
+    for (size_t i = 0; i < nframes; i++)
+        frames[i] = atomic_load_explicit(&render->frame_us[i], memory_order_relaxed);
+    qsort(frames, nframes, sizeof(*frames), compare_u32);
+
+    screen_history_usage(tty->screen, &lines, &history_bytes);
+
+    pthread_mutex_lock(&tty->lock);
+    size_t ring_used = ring_count(tty);
+    size_t ring_cap = tty->cap;
+    size_t stalls = tty->stalls;
+    size_t bytes_read = tty->bytes_read;
+    size_t frames_skipped = tty->frames_skipped;
+    pthread_mutex_unlock(&tty->lock);
+
+    return snprintf(buff, size,
+        "{\"pid\": %d, \"bytes_read\": %zu, \"bytes_per_sec\": %.0f, "
+        "\"ring_used\": %zu, \"ring_cap\": %zu, \"ring_max_cap\": %zu, \"stalls\": %zu, "
+        "\"frames_rendered\": %zu, \"frames_skipped\": %zu, "
+        "\"frame_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}, "
+        "\"atlas_glyphs\": %d, \"atlas_capacity\": %d, "
+        "\"row_cache\": {\"hits\": %zu, \"misses\": %zu, \"evictions\": %zu, "
+        "\"rows\": %d, \"capacity\": %d}, "
+        "\"scrollback_lines\": %zu, \"scrollback_bytes\": %zu}\n",
+        getpid(), bytes_read, ctl->bytes_per_sec,
+        ring_used, ring_cap, tty->max_cap, stalls,
+        atomic_load_explicit(&render->frames_rendered, memory_order_relaxed), frames_skipped,
+        percentile_ms(frames, nframes, 50), percentile_ms(frames, nframes, 90),
+        percentile_ms(frames, nframes, 99), percentile_ms(frames, nframes, 100),
+        atomic_load(&render->atlas_glyphs), atomic_load(&render->atlas_capacity),
+        atomic_load_explicit(&render->row_cache_hits, memory_order_relaxed),
+        atomic_load_explicit(&render->row_cache_misses, memory_order_relaxed),
+        atomic_load_explicit(&render->row_cache_evictions, memory_order_relaxed),
+        atomic_load(&render->row_cache_rows), atomic_load(&render->row_cache_capacity),
+        lines, history_bytes);
+}
+
+static
+bool handle_command(control *ctl, tty_state *tty, control_client *client, const char *cmd)
+{
+    char buff[1024];
+    int len;
+
+    if (strcmp(cmd, "stats") == 0) len = format_stats(ctl, tty, buff, sizeof(buff));
+    else if (strcmp(cmd, "ping") == 0) len = snprintf(buff, sizeof(buff), "pong\n");
+    else len = snprintf(buff, sizeof(buff), "{\"error\": \"unknown command\"}\n");
+
+    if (len < 0) return false;
+    if ((size_t)len >= sizeof(buff)) len = sizeof(buff) - 1;
+
+    return client_send(client, buff, len);
+}
+
+// Splits what the client sent into newline terminated commands
+static
+bool client_read(control *ctl, tty_state *tty, control_client *client)
+{
+    char buff[256];
+    ssize_t n = recv(client->fd, buff, sizeof(buff), 0);
+
+    if (n < 0) return errno == EINTR || errno == EAGAIN;
+    if (n == 0) return false;
+
+    for (ssize_t i = 0; i < n; i++) {
+        char c = buff[i];
+
+        if (c != '\n') {
+            if (c != '\r' && client->len < CONTROL_LINE_CAP - 1) client->line[client->len++] = c;
+            continue;
+        }
+
+        client->line[client->len] = '\0';
+        client->len = 0;
+
+        if (!handle_command(ctl, tty, client, client->line)) return false;
+    }
+    return true;
+}
+
+static
+void accept_clients(control *ctl)
+{
+    for (int fd; (fd = accept(ctl->listen_fd, NULL, NULL)) >= 0;) {
+        if (ctl->nclients == CONTROL_MAX_CLIENTS
+            || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+        {
+            pretty_log(PRETTY_WARN, "Refusing control client, %d connected", ctl->nclients);
+            close(fd);
+            continue;
+        }
+        ctl->clients[ctl->nclients++] = (control_client){ .fd = fd };
+    }
+}
+
+// Runs after every poll, whether or not the socket was ready
+static
+void control_serve(control *ctl, tty_state *tty, const struct pollfd *fds, int nfds)
+{
+    uint64_t now = trace_now_ns();
+    if (now - ctl->sample_start >= 1000000000ULL) {
+        pthread_mutex_lock(&tty->lock);
+        size_t bytes_read = tty->bytes_read;
+        pthread_mutex_unlock(&tty->lock);
+
+        ctl->bytes_per_sec = (double)(bytes_read - ctl->sample_bytes)
+            * 1e9 / (now - ctl->sample_start);
+        ctl->sample_bytes = bytes_read;
+        ctl->sample_start = now;
+    }
+
+    for (int i = 1; i < nfds; i++) {
+        if (fds[i].revents == 0) continue;
+
+        for (int c = 0; c < ctl->nclients; c++) {
+            if (ctl->clients[c].fd != fds[i].fd) continue;
+
+            if ((fds[i].revents & (POLLERR | POLLNVAL))
+                || !client_read(ctl, tty, &ctl->clients[c]))
+                drop_client(ctl, c);
+            break;
+        }
+    }
+
+    if (nfds > 0 && (fds[0].revents & POLLIN)) accept_clients(ctl);
+}
+
+static
+void *control_loop(void *arg)
+{
+    control *ctl = arg;
+    struct pollfd fds[1 + CONTROL_MAX_CLIENTS];
+
+    trace_thread_name("control");
+
+    // the timeout bounds how long control_close waits, and keeps bytes_per_sec sampled
+    while (!atomic_load(&ctl->should_exit)) {
+        int nfds = control_pollfds(ctl, fds);
+        int ret = poll(fds, nfds, 100);
+
+        if (ret < 0 && errno != EINTR) {
+            pretty_log(PRETTY_ERROR, "Control socket poll failed: %s", strerror(errno));
+            break;
+        }
+        control_serve(ctl, ctl->tty, fds, (ret > 0) ? nfds : 0);
+    }
+    return NULL;
+}
+
+bool control_start(control *ctl, tty_state *tty)
+{
+    if (ctl->listen_fd < 0) return false;
+
+    ctl->tty = tty;
+    if (pthread_create(&ctl->thread, NULL, control_loop, ctl) != 0) {
+        pretty_log(PRETTY_WARN, "Couldn't start the control socket thread");
+        return false;
+    }
+    ctl->started = true;
+    return true;
+}
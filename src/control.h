@@ -0,0 +1,64 @@
+#ifndef CONTROL_H
+    #define CONTROL_H
+
+    #include <poll.h>
+    #include <pthread.h>
+    #include <stdatomic.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include <stdint.h>
+
+    #include "slave.h"
+
+enum { CONTROL_MAX_CLIENTS = 8 };
+enum { CONTROL_LINE_CAP = 128 };
+enum { FRAME_TIME_SAMPLES = 256 };
+
+// Written by the render loop, only read by the control socket
+typedef struct {
+    atomic_size_t frames_rendered;
+    atomic_size_t frame_count;
+    _Atomic uint32_t frame_us[FRAME_TIME_SAMPLES];
+    atomic_int atlas_glyphs;
+    atomic_int atlas_capacity;
+    atomic_size_t row_cache_hits;
+    atomic_size_t row_cache_misses;
+    atomic_size_t row_cache_evictions;
+    atomic_int row_cache_rows;
+    atomic_int row_cache_capacity;
+} render_stats;
+
+typedef struct {
+    int fd;
+    size_t len;
+    char line[CONTROL_LINE_CAP];
+} control_client;
+
+/*
+ * Answers stats requests on a unix socket. It polls on a thread of its own,
+ * so a reader waiting for ring space or a replay never keeps it waiting.
+ */
+typedef struct control {
+    int listen_fd;
+    char *path;
+    control_client clients[CONTROL_MAX_CLIENTS];
+    int nclients;
+
+    render_stats *render;
+    tty_state *tty;
+    pthread_t thread;
+    bool started;
+    atomic_bool should_exit;
+
+    /* throughput over the last full second */
+    uint64_t sample_start;
+    size_t sample_bytes;
+    double bytes_per_sec;
+} control;
+
+bool control_open(control *ctl, const char *path, render_stats *render);
+bool control_start(control *ctl, tty_state *tty);
+void control_close(control *ctl);
+void render_stats_frame(render_stats *stats, uint64_t ns);
+
+#endif // CONTROL_H
@@ -0,0 +1,607 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL3/SDL_opengl.h>
+
+#include "SDL3_ttf/SDL_ttf.h"
+#include "gl_renderer.h"
+#include "alloc.h"
+#include "log.h"
+#include "trace.h"
+
+#define FOREACH_GL_FUNC(FUNC) \
+    FUNC(const GLubyte *, GetString, GLenum) \
+    FUNC(void, Viewport, GLint, GLint, GLsizei, GLsizei) \
+    FUNC(void, ClearColor, GLfloat, GLfloat, GLfloat, GLfloat) \
+    FUNC(void, Clear, GLbitfield) \
+    FUNC(void, PixelStorei, GLenum, GLint) \
+    FUNC(void, GenTextures, GLsizei, GLuint *) \
+    FUNC(void, DeleteTextures, GLsizei, const GLuint *) \
+    FUNC(void, BindTexture, GLenum, GLuint) \
+    FUNC(void, TexParameteri, GLenum, GLenum, GLint) \
+    FUNC(void, TexImage2D, GLenum, GLint, GLint, GLsizei, GLsizei, GLint, GLenum, GLenum, const void *) \
+    FUNC(void, TexSubImage2D, GLenum, GLint, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, const void *) \
+    FUNC(GLuint, CreateShader, GLenum) \
+    FUNC(void, ShaderSource, GLuint, GLsizei, const GLchar *const *, const GLint *) \
+    FUNC(void, CompileShader, GLuint) \
+    FUNC(void, GetShaderiv, GLuint, GLenum, GLint *) \
+    FUNC(void, GetShaderInfoLog, GLuint, GLsizei, GLsizei *, GLchar *) \
+    FUNC(void, DeleteShader, GLuint) \
+    FUNC(GLuint, CreateProgram, void) \
+    FUNC(void, AttachShader, GLuint, GLuint) \
+    FUNC(void, LinkProgram, GLuint) \
+    FUNC(void, GetProgramiv, GLuint, GLenum, GLint *) \
+    FUNC(void, GetProgramInfoLog, GLuint, GLsizei, GLsizei *, GLchar *) \
+    FUNC(void, DeleteProgram, GLuint) \
+    FUNC(void, UseProgram, GLuint) \
+    FUNC(GLint, GetUniformLocation, GLuint, const GLchar *) \
+    FUNC(void, Uniform1i, GLint, GLint) \
+    FUNC(void, Uniform2i, GLint, GLint, GLint) \
+    FUNC(void, Uniform2f, GLint, GLfloat, GLfloat) \
+    FUNC(void, Uniform3f, GLint, GLfloat, GLfloat, GLfloat) \
+    FUNC(void, Uniform4f, GLint, GLfloat, GLfloat, GLfloat, GLfloat) \
+    FUNC(void, GenVertexArrays, GLsizei, GLuint *) \
+    FUNC(void, DeleteVertexArrays, GLsizei, const GLuint *) \
+    FUNC(void, BindVertexArray, GLuint) \
+    FUNC(void, GenBuffers, GLsizei, GLuint *) \
+    FUNC(void, DeleteBuffers, GLsizei, const GLuint *) \
+    FUNC(void, BindBuffer, GLenum, GLuint) \
+    FUNC(void, BufferData, GLenum, GLsizeiptr, const void *, GLenum) \
+    FUNC(void, BufferSubData, GLenum, GLintptr, GLsizeiptr, const void *) \
+    FUNC(void, EnableVertexAttribArray, GLuint) \
+    FUNC(void, VertexAttribIPointer, GLuint, GLint, GLenum, GLsizei, const void *) \
+    FUNC(void, VertexAttribDivisor, GLuint, GLuint) \
+    FUNC(void, DrawArraysInstanced, GLenum, GLint, GLsizei, GLsizei) \
+    FUNC(void, ReadPixels, GLint, GLint, GLsizei, GLsizei, GLenum, GLenum, void *) \
+
+#define FOREACH_GL_UNIFORM(UNIFORM) \
+    UNIFORM(viewport) \
+    UNIFORM(cell) \
+    UNIFORM(pad) \
+    UNIFORM(grid) \
+    UNIFORM(origin) \
+    UNIFORM(slot) \
+    UNIFORM(sheet_cols) \
+    UNIFORM(lines) \
+    UNIFORM(cursor) \
+    UNIFORM(cursor_color) \
+
+#define GENERATE_GL_FUNC(ret, name, ...) ret (APIENTRY *name)(__VA_ARGS__);
+#define GENERATE_GL_UNIFORM(name) GLint name;
+
+typedef struct {
+    FOREACH_GL_FUNC(GENERATE_GL_FUNC)
+} gl_funcs;
+
+typedef struct {
+    FOREACH_GL_UNIFORM(GENERATE_GL_UNIFORM)
+} gl_uniforms;
+
+// instance flags above the underline style, the fragment shader tests the same bits
+enum {
+    INSTANCE_STRIKE = 1 << 3,
+    INSTANCE_RIGHT_HALF = 1 << 4, // samples the second slot of a wide glyph
+};
+enum { INSTANCE_NO_GLYPH = 0xFFFF };
+
+// One cell as the shader sees it, colours are resolved when the row is built
+typedef struct {
+    uint16_t glyph; // slot in the sheet
+    uint16_t flags;
+    uint32_t fg;
+    uint32_t bg;
+    uint32_t underline;
+} gl_instance;
+
+struct gl_renderer {
+    SDL_Window *win;
+    SDL_GLContext context;
+    gl_funcs f;
+    gl_uniforms u;
+    GLuint program;
+    GLuint vao;
+    GLuint buffer;
+    GLuint texture;
+
+    glyph_atlas atlas; // `texture` stays NULL, the sheet goes into the GL one
+    int baseline;
+
+    /* what the instance buffer holds, rows are stored circularly from `origin` */
+    gl_instance *cells;
+    uint64_t *uploaded;
+    int cols;
+    int rows;
+    int origin;
+    uint64_t top_line;
+    size_t evictions; // of the glyph cache, as of when the rows were built
+
+    /* rows built while some of their glyphs were still rasterising */
+    bool glyphs_pending;
+    uint64_t glyph_generation;
+
+    void *capture; // the next frame is read back here before it is presented
+};
+
+// Every instance is a cell sized quad, its position comes from the instance id
+static const char VERTEX_SHADER[] =
+    "#version 330 core\n"
+    "layout(location = 0) in uvec2 glyph_flags;\n"
+    "layout(location = 1) in uvec3 colors;\n"
+    "uniform vec2 viewport;\n"
+    "uniform vec2 cell;\n"
+    "uniform vec2 pad;\n"
+    "uniform ivec2 grid;\n"
+    "uniform int origin;\n"
+    "flat out uint glyph;\n"
+    "flat out uint flags;\n"
+    "flat out vec4 fg;\n"
+    "flat out vec4 bg;\n"
+    "flat out vec4 underline;\n"
+    "flat out int instance;\n"
+    "out vec2 local;\n"
+    "vec4 unpack(uint c)\n"
+    "{\n"
+    "    return vec4(uvec4(c >> 24, c >> 16, c >> 8, c) & 255u) / 255.0;\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    int row = (gl_InstanceID / grid.x - origin + grid.y) % grid.y;\n"
+    "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+    "    vec2 pos = (pad + (vec2(gl_InstanceID % grid.x, row) + corner) * cell) / viewport * 2.0 - 1.0;\n"
+    "    glyph = glyph_flags.x;\n"
+    "    flags = glyph_flags.y;\n"
+    "    fg = unpack(colors.x);\n"
+    "    bg = unpack(colors.y);\n"
+    "    underline = unpack(colors.z);\n"
+    "    instance = gl_InstanceID;\n"
+    "    local = corner * cell;\n"
+    "    gl_Position = vec4(pos.x, -pos.y, 0.0, 1.0);\n"
+    "}\n";
+
+// Same geometry as draw_row and draw_decorations, per pixel instead of per rectangle
+static const char FRAGMENT_SHADER[] =
+    "#version 330 core\n"
+    "uniform sampler2D atlas;\n"
+    "uniform vec2 cell;\n"
+    "uniform vec2 slot;\n"
+    "uniform int sheet_cols;\n"
+    "uniform vec3 lines;\n"
+    "uniform int cursor;\n"
+    "uniform vec4 cursor_color;\n"
+    "flat in uint glyph;\n"
+    "flat in uint flags;\n"
+    "flat in vec4 fg;\n"
+    "flat in vec4 bg;\n"
+    "flat in vec4 underline;\n"
+    "flat in int instance;\n"
+    "in vec2 local;\n"
+    "out vec4 color;\n"
+    "bool underlined()\n"
+    "{\n"
+    "    float t = lines.x, x = local.x, y = local.y - lines.y;\n"
+    "    float phase = floor(x / t) * t / cell.x;\n"
+    "    switch (flags & 7u) {\n"
+    "        case 0u: return false;\n"
+    "        case 2u: return (y >= 0.0 && y < t) || (y >= 2.0 * t && y < 3.0 * t);\n"
+    "        case 3u: y -= (phase < 0.5 ? phase : 1.0 - phase) * 4.0 * t - t; break;\n"
+    "        case 4u: return mod(x, 2.0 * t) < t && y >= 0.0 && y < t;\n"
+    "        case 5u: return mod(x, cell.x / 3.0) < cell.x / 6.0 && y >= 0.0 && y < t;\n"
+    "    }\n"
+    "    return y >= 0.0 && y < t;\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "    color = bg;\n"
+    "    if ((flags & 8u) != 0u && local.y >= lines.z && local.y < lines.z + lines.x) color = fg;\n"
+    "    if (underlined()) color = underline;\n"
+    "    if (glyph != 0xFFFFu) {\n"
+    "        vec2 corner = vec2(glyph % uint(sheet_cols), glyph / uint(sheet_cols)) * slot;\n"
+    "        if ((flags & 16u) != 0u) corner.x += slot.x;\n"
+    "        vec2 texel = (corner + local * slot / cell) / vec2(textureSize(atlas, 0));\n"
+    "        color = mix(color, fg, texture(atlas, texel).a);\n"
+    "    }\n"
+    "    if (instance == cursor && (any(lessThan(local, vec2(1.0))) || any(greaterThan(local, cell - 1.0))))\n"
+    "        color = cursor_color;\n"
+    "}\n";
+
+SDL_WindowFlags gl_window_flags(void)
+{
+    // 3.3 core is the first with instanced attributes, llvmpipe provides it
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+    SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+    return SDL_WINDOW_OPENGL;
+}
+
+static
+bool gl_load(gl_funcs *f)
+{
+    #define LOAD_GL_FUNC(ret, name, ...)                                            \
+        f->name = (ret (APIENTRY *)(__VA_ARGS__))SDL_GL_GetProcAddress("gl" #name); \
+        if (f->name == NULL) {                                                      \
+            pretty_log(PRETTY_WARN, "Missing GL entry point gl" #name);             \
+            return false;                                                           \
+        }
+
+    FOREACH_GL_FUNC(LOAD_GL_FUNC)
+    #undef LOAD_GL_FUNC
+    return true;
+}
+
+static
+GLuint gl_compile(const gl_funcs *f, GLenum type, const char *source)
+{
+    GLuint shader = f->CreateShader(type);
+    GLint ok;
+
+    f->ShaderSource(shader, 1, &source, NULL);
+    f->CompileShader(shader);
+    f->GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (ok) return shader;
+
+    char info[512];
+    f->GetShaderInfoLog(shader, sizeof info, NULL, info);
+    pretty_log(PRETTY_ERROR, "Couldn't compile shader: %s", info);
+    f->DeleteShader(shader);
+    return 0;
+}
+
+static
+bool gl_link(gl_renderer *gl)
+{
+    const gl_funcs *f = &gl->f;
+    GLuint vertex = gl_compile(f, GL_VERTEX_SHADER, VERTEX_SHADER);
+    GLuint fragment = gl_compile(f, GL_FRAGMENT_SHADER, FRAGMENT_SHADER);
+    GLint ok = 0;
+
+    if (vertex != 0 && fragment != 0) {
+        gl->program = f->CreateProgram();
+        f->AttachShader(gl->program, vertex);
+        f->AttachShader(gl->program, fragment);
+        f->LinkProgram(gl->program);
+        f->GetProgramiv(gl->program, GL_LINK_STATUS, &ok);
+    }
+    if (vertex != 0) f->DeleteShader(vertex);
+    if (fragment != 0) f->DeleteShader(fragment);
+
+    if (!ok && gl->program != 0) {
+        char info[512];
+
+        f->GetProgramInfoLog(gl->program, sizeof info, NULL, info);
+        pretty_log(PRETTY_ERROR, "Couldn't link shaders: %s", info);
+    }
+    if (!ok) return false;
+
+    #define LOAD_GL_UNIFORM(name) gl->u.name = f->GetUniformLocation(gl->program, #name);
+    FOREACH_GL_UNIFORM(LOAD_GL_UNIFORM)
+    #undef LOAD_GL_UNIFORM
+    return true;
+}
+
+gl_renderer *gl_renderer_create(SDL_Window *win)
+{
+    TRACE_SCOPE("gl_renderer_create");
+    gl_renderer *gl = calloc(1, sizeof *gl);
+
+    if (gl == NULL)
+        return NULL;
+
+    gl->win = win;
+    gl->context = SDL_GL_CreateContext(win);
+    if (gl->context == NULL) {
+        pretty_log(PRETTY_WARN, "Couldn't create a GL 3.3 context: %s", SDL_GetError());
+        goto fail;
+    }
+    if (!gl_load(&gl->f) || !gl_link(gl)) goto fail;
+
+    // frames are paced by the event loop, not by the display
+    SDL_GL_SetSwapInterval(0);
+
+    const gl_funcs *f = &gl->f;
+    f->GenVertexArrays(1, &gl->vao);
+    f->GenBuffers(1, &gl->buffer);
+    f->GenTextures(1, &gl->texture);
+
+    f->BindVertexArray(gl->vao);
+    f->BindBuffer(GL_ARRAY_BUFFER, gl->buffer);
+    f->EnableVertexAttribArray(0);
+    f->VertexAttribIPointer(0, 2, GL_UNSIGNED_SHORT, sizeof(gl_instance), (void *)offsetof(gl_instance, glyph));
+    f->VertexAttribDivisor(0, 1);
+    f->EnableVertexAttribArray(1);
+    f->VertexAttribIPointer(1, 3, GL_UNSIGNED_INT, sizeof(gl_instance), (void *)offsetof(gl_instance, fg));
+    f->VertexAttribDivisor(1, 1);
+
+    // glyphs map 1:1 to pixels, nothing is ever filtered
+    f->BindTexture(GL_TEXTURE_2D, gl->texture);
+    f->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    f->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    f->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    f->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    pretty_log(PRETTY_INFO, "Drawing with OpenGL on %s", (const char *)f->GetString(GL_RENDERER));
+    return gl;
+
+fail:
+    gl_renderer_destroy(gl);
+    // the SDL renderer asks for its own context
+    SDL_GL_ResetAttributes();
+    return NULL;
+}
+
+void gl_renderer_destroy(gl_renderer *gl)
+{
+    if (gl == NULL) return;
+
+    if (gl->context != NULL && SDL_GL_MakeCurrent(gl->win, gl->context)) {
+        const gl_funcs *f = &gl->f;
+
+        if (gl->texture != 0) f->DeleteTextures(1, &gl->texture);
+        if (gl->buffer != 0) f->DeleteBuffers(1, &gl->buffer);
+        if (gl->vao != 0) f->DeleteVertexArrays(1, &gl->vao);
+        if (gl->program != 0) f->DeleteProgram(gl->program);
+    }
+    if (gl->context != NULL) SDL_GL_DestroyContext(gl->context);
+
+    counted_free(gl->cells);
+    counted_free(gl->uploaded);
+    free(gl);
+}
+
+// Uploads the sheet rows holding glyphs committed since the last call, like atlas_sync
+static
+void gl_sync_atlas(gl_renderer *gl)
+{
+    glyph_cache *cache = gl->atlas.cache;
+    int first, last;
+
+    if (!sheet_dirty(cache, gl->atlas.synced, &first, &last)) return;
+
+    const char *pixels = (const char *)cache->sheet->pixels + (size_t)first * cache->h * cache->sheet->pitch;
+
+    // RGBA8888 is a packed 0xRRGGBBAA, whatever the byte order
+    gl->f.BindTexture(GL_TEXTURE_2D, gl->texture);
+    gl->f.PixelStorei(GL_UNPACK_ROW_LENGTH, cache->sheet->pitch / 4);
+    gl->f.TexSubImage2D(GL_TEXTURE_2D, 0, 0, first * cache->h, cache->sheet->w, (last - first + 1) * cache->h,
+        GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, pixels);
+    gl->atlas.synced = cache->version;
+}
+
+glyph_atlas *gl_set_glyphs(gl_renderer *gl, glyph_cache *cache)
+{
+    if (gl->atlas.cache == cache) return &gl->atlas;
+    if (!SDL_GL_MakeCurrent(gl->win, gl->context)) {
+        pretty_log(PRETTY_ERROR, "Couldn't make the GL context current: %s", SDL_GetError());
+        return NULL;
+    }
+
+    gl->f.BindTexture(GL_TEXTURE_2D, gl->texture);
+    gl->f.TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cache->sheet->w, cache->sheet->h, 0,
+        GL_RGBA, GL_UNSIGNED_INT_8_8_8_8, NULL);
+
+    gl->atlas = (glyph_atlas){ .w = cache->w, .h = cache->h, .cache = cache, .synced = 0 };
+    memcpy(gl->atlas.glyphs, cache->glyphs, sizeof(gl->atlas.glyphs));
+    gl->baseline = TTF_GetFontAscent(cache->font.ttf);
+
+    // slots differ between scales, every row has to be built again
+    if (gl->uploaded != NULL) memset(gl->uploaded, 0, gl->rows * sizeof *gl->uploaded);
+    gl->evictions = cache->evictions;
+
+    gl_sync_atlas(gl);
+    return &gl->atlas;
+}
+
+// True when a glyph a previous frame had to leave out may have arrived since
+// RGBA rows of the next frame, bottom up, go to `pixels` which holds the whole window
+void gl_capture(gl_renderer *gl, void *pixels)
+{
+    gl->capture = pixels;
+}
+
+bool gl_needs_glyphs(const gl_renderer *gl)
+{
+    return gl->glyphs_pending && gl->glyph_generation != gl->atlas.cache->generation;
+}
+
+// Sizes the instance buffer to the grid, every row is uploaded again after a resize
+static
+bool gl_prepare(gl_renderer *gl, int cols, int rows)
+{
+    if (gl->cols == cols && gl->rows == rows) return true;
+
+    size_t count = (size_t)cols * rows;
+    gl_instance *cells = counted_realloc(gl->cells, count * sizeof *cells);
+
+    if (cells == NULL) return false;
+    gl->cells = cells;
+
+    uint64_t *uploaded = counted_realloc(gl->uploaded, rows * sizeof *uploaded);
+
+    if (uploaded == NULL) return false;
+    memset(uploaded, 0, rows * sizeof *uploaded);
+    gl->uploaded = uploaded;
+
+    gl->f.BufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(count * sizeof *cells), NULL, GL_DYNAMIC_DRAW);
+    gl->cols = cols;
+    gl->rows = rows;
+    gl->origin = 0;
+    return true;
+}
+
+// Row `row` of the snapshot with its selection and hovered link, false when some glyphs are still rasterising
+static
+bool gl_build_row(gl_renderer *gl, gl_instance *out, const screen_snapshot *snap, int row, const uint32_t *palette)
+{
+    const cell *cells = snap->cells + (size_t)row * snap->cols;
+    const cell_attr *attrs = snap->attrs;
+    int cols = gl->cols;
+    bool complete = true;
+    int sel_from, sel_to, hover_from, hover_to;
+
+    snapshot_selected(snap, row, &sel_from, &sel_to);
+    snapshot_hovered(snap, row, &hover_from, &hover_to);
+
+    for (int col = 0; col < cols; col++) {
+        uint32_t c = cells[col].codepoint;
+        const cell_attr *a = &attrs[cells[col].attr];
+        int span = (col + 1 < cols && cells[col + 1].codepoint == CELL_WIDE_SPACER) ? 2 : 1;
+        uint32_t fg, bg;
+        SDL_FRect src;
+
+        // the right half of a wide glyph is drawn by a copy of its left half
+        if (c == CELL_WIDE_SPACER && col > 0) {
+            out[col] = out[col - 1];
+            out[col].flags |= INSTANCE_RIGHT_HALF;
+            continue;
+        }
+
+        cell_colors(a, palette, col >= sel_from && col < sel_to, &fg, &bg);
+        out[col] = (gl_instance){ INSTANCE_NO_GLYPH, 0, fg, bg, attr_color(a->underline, palette, fg) };
+        if (a->flags & ATTR_HIDDEN) continue;
+
+        bool hovered = (col >= hover_from && col < hover_to)
+            || (snap->hover_link != 0 && a->link == snap->hover_link);
+        int underline = ATTR_UNDERLINE(a->flags);
+
+        if (hovered && underline == UNDERLINE_NONE) underline = UNDERLINE_SINGLE;
+        out[col].flags = underline | ((a->flags & ATTR_STRIKE) ? INSTANCE_STRIKE : 0);
+        if (c <= ' ' || c == 0x7F || c == CELL_WIDE_SPACER) continue;
+
+        uint32_t key = glyph_key(c, a->flags);
+
+        // ascii sits in the slot of its codepoint
+        if (key <= '~') {
+            out[col].glyph = key;
+            continue;
+        }
+
+        enum glyph_state state = glyph_lookup(&gl->atlas, key, span, &src);
+
+        if (state != GLYPH_READY) {
+            complete &= state == GLYPH_MISSING;
+            continue;
+        }
+        out[col].glyph = (int)src.y / gl->atlas.h * GLYPH_SHEET_COLS + (int)src.x / gl->atlas.w;
+    }
+    return complete;
+}
+
+// Sends buffer rows `first` up to `end` to the instance buffer
+static
+void gl_upload_rows(gl_renderer *gl, int first, int end)
+{
+    size_t row = (size_t)gl->cols * sizeof *gl->cells;
+
+    if (first == end) return;
+    gl->f.BufferSubData(GL_ARRAY_BUFFER, (GLintptr)(first * row), (GLsizeiptr)((end - first) * row),
+        gl->cells + (size_t)first * gl->cols);
+}
+
+static
+void gl_color(uint32_t c, GLfloat rgba[4])
+{
+    for (int i = 0; i < 4; i++) rgba[i] = (GLfloat)((c >> (24 - 8 * i)) & 0xFF) / 255.0f;
+}
+
+// Draws in pixels with the glyphs of the last gl_set_glyphs
+bool gl_render_frame(gl_renderer *gl, struct dim win_size, const screen_snapshot *snap, generic_config *conf)
+{
+    TRACE_SCOPE("gl_render_frame");
+    const gl_funcs *f = &gl->f;
+    glyph_cache *cache = gl->atlas.cache;
+    font_info *font = &cache->font;
+    int pad_x = (int)(conf->pad_x * cache->scale);
+    int pad_y = (int)(conf->pad_y * cache->scale);
+
+    if (!SDL_GL_MakeCurrent(gl->win, gl->context)) {
+        pretty_log(PRETTY_ERROR, "Couldn't make the GL context current: %s", SDL_GetError());
+        return false;
+    }
+
+    f->BindVertexArray(gl->vao);
+    f->BindBuffer(GL_ARRAY_BUFFER, gl->buffer);
+    if (!gl_prepare(gl, snap->cols, snap->rows)) return false;
+    gl_sync_atlas(gl);
+
+    // rows built before point at slots other glyphs may have taken over since
+    if (gl->evictions != cache->evictions) {
+        memset(gl->uploaded, 0, gl->rows * sizeof *gl->uploaded);
+        gl->evictions = cache->evictions;
+    }
+
+    scroll_rows(gl->uploaded, gl->rows, &gl->origin, (int64_t)(snap->top_line - gl->top_line));
+    gl->top_line = snap->top_line;
+
+    // only rows whose content changed are built, neighbouring ones go up in one upload
+    trace_span span = trace_begin("upload_rows");
+    int first = 0, end = 0;
+
+    gl->glyphs_pending = false;
+    gl->glyph_generation = cache->generation;
+    cache->frame_start = cache->clock;
+
+    for (int row = 0; row < snap->rows; row++) {
+        uint64_t hash = snap->row_hash[row];
+        int slot = (row + gl->origin) % gl->rows;
+
+        if (gl->uploaded[row] == hash) continue;
+
+        bool complete = gl_build_row(gl, gl->cells + (size_t)slot * gl->cols, snap, row, conf->color_palette);
+
+        // a row missing glyphs doesn't match any hash, it is built again once they land
+        gl->uploaded[row] = complete ? hash : ~hash;
+        gl->glyphs_pending |= !complete;
+
+        if (slot != end) {
+            gl_upload_rows(gl, first, end);
+            first = slot;
+        }
+        end = slot + 1;
+    }
+    gl_upload_rows(gl, first, end);
+    trace_end(&span);
+
+    int t = SDL_max(1, font->line_skip / 16);
+    int cursor = snap->cursor_visible
+        ? ((snap->cursor_y + gl->origin) % gl->rows) * gl->cols + SDL_min(snap->cursor_x, gl->cols - 1)
+        : -1;
+    GLfloat bg[4], cursor_color[4];
+
+    gl_color(conf->color_palette[COLOR_BACKGROUND], bg);
+    gl_color(conf->color_palette[REVERSED_COLOR], cursor_color);
+
+    // the padding is the clear colour, every cell is one instance of a single draw
+    span = trace_begin("draw_cells");
+    f->Viewport(0, 0, win_size.width, win_size.height);
+    f->ClearColor(bg[0], bg[1], bg[2], bg[3]);
+    f->Clear(GL_COLOR_BUFFER_BIT);
+
+    f->UseProgram(gl->program);
+    f->Uniform2f(gl->u.viewport, (GLfloat)win_size.width, (GLfloat)win_size.height);
+    f->Uniform2f(gl->u.cell, (GLfloat)font->advance, (GLfloat)font->line_skip);
+    f->Uniform2f(gl->u.pad, (GLfloat)pad_x, (GLfloat)pad_y);
+    f->Uniform2i(gl->u.grid, gl->cols, gl->rows);
+    f->Uniform1i(gl->u.origin, gl->origin);
+    f->Uniform2f(gl->u.slot, (GLfloat)cache->w, (GLfloat)cache->h);
+    f->Uniform1i(gl->u.sheet_cols, GLYPH_SHEET_COLS);
+    f->Uniform3f(gl->u.lines, (GLfloat)t,
+        (GLfloat)SDL_min(gl->baseline + t, font->line_skip - 3 * t), (GLfloat)(gl->baseline * 2 / 3));
+    f->Uniform1i(gl->u.cursor, cursor);
+    f->Uniform4f(gl->u.cursor_color, cursor_color[0], cursor_color[1], cursor_color[2], cursor_color[3]);
+
+    f->BindTexture(GL_TEXTURE_2D, gl->texture);
+    f->DrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, gl->cols * gl->rows);
+    trace_end(&span);
+
+    // the back buffer is undefined once presented, offscreen surfaces included
+    if (gl->capture != NULL) {
+        f->ReadPixels(0, 0, win_size.width, win_size.height, GL_RGBA, GL_UNSIGNED_BYTE, gl->capture);
+        gl->capture = NULL;
+    }
+
+    span = trace_begin("present");
+    SDL_GL_SwapWindow(gl->win);
+    trace_end(&span);
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef GL_RENDERER_H
+    #define GL_RENDERER_H
+
+    #include <SDL3/SDL.h>
+
+    #include "config.h"
+    #include "renderer.h"
+    #include "screen.h"
+
+/*
+ * Draws the whole grid with one instanced draw call, every cell being an
+ * instance that carries its glyph slot and colours. Needs a GL 3.3 core
+ * context, the entry points are resolved through SDL at runtime so nothing
+ * links against libGL and the SDL renderer is used when it is missing.
+ */
+typedef struct gl_renderer gl_renderer;
+
+// Window flags and context attributes, to be set before the window is created
+SDL_WindowFlags gl_window_flags(void);
+
+gl_renderer *gl_renderer_create(SDL_Window *win);
+void gl_renderer_destroy(gl_renderer *gl);
+
+// Switches to the glyphs of another display scale, the atlas is uploaded again
+glyph_atlas *gl_set_glyphs(gl_renderer *gl, glyph_cache *cache);
+bool gl_needs_glyphs(const gl_renderer *gl);
+bool gl_render_frame(gl_renderer *gl, struct dim win_size, const screen_snapshot *snap, generic_config *conf);
+void gl_capture(gl_renderer *gl, void *pixels);
+
+#endif // GL_RENDERER_H
@@ -1,7 +1,4 @@
-#include <ctype.h>
 #include <getopt.h>
-#include <limits.h>
-#include <pthread.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -9,57 +6,76 @@
 #include <unistd.h>
 
 #include <SDL3/SDL_error.h>
-#include <SDL3/SDL_pixels.h>
-#include <SDL3/SDL_render.h>
+#include <SDL3/SDL_hints.h>
+#include <SDL3/SDL_keyboard.h>
 #include <SDL3/SDL_video.h>
 
 #include "SDL3/SDL_events.h"
-#include "SDL3/SDL_keycode.h"
 #include "SDL3_ttf/SDL_ttf.h"
 #include "config.h"
-#include "macro_utils.h"
 #include "pretty.h"
-#include "slave.h"
+#include "server.h"
+#include "terminal.h"
 #include "font.h"
 #include "renderer.h"
+#include "trace.h"
 #include "log.h"
 
-#define SCREEN_WIDTH 1280
-#define SCREEN_HEIGHT 720
-
 #define TEST_COMMAND "python tests/plop.py\r"
 
 static struct option LONG_OPTIONS[] = {
-    {"config", required_argument, 0, 'c'},
-    {0,        0,                 0,  0 }
+    {"config",     required_argument, 0, 'c'},
+    {"bench",      required_argument, 0, 'b'},
+    {"no-render",  no_argument,       0, 'n'},
+    {"record",     required_argument, 0, 'r'},
+    {"replay",     required_argument, 0, 'p'},
+    {"fast",       no_argument,       0, 'f'},
+    {"trace",      required_argument, 0, 't'},
+    {"control",    optional_argument, 0, 's'},
+    {"server",     no_argument,       0, 'S'},
+    {"new-window", no_argument,       0, 'w'},
+    {"gl",         no_argument,       0, 'g'},
+    {0,            0,                 0,  0 }
 };
 
-void notify_ui_flush(void)
+void notify_ui_flush(unsigned int window_id)
 {
-    static SDL_Event ev = { .type = SDL_EVENT_USER };
+    SDL_Event ev = { .type = SDL_EVENT_USER };
 
+    ev.user.windowID = window_id;
     SDL_PushEvent(&ev);
 }
 
-void thread_handle_quit(tty_state *tty)
+static
+terminal *find_terminal(terminal *terms, SDL_Window *win)
 {
-    tty->should_exit = true;
-    pretty_log(PRETTY_DEBUG, "waiting for thread [%lu] to exit", tty->thread);
-
-    void *res;
-    int s = pthread_join(tty->thread, &res);
+    for (; terms != NULL; terms = terms->next)
+        if (terms->win == win) return terms;
+    return NULL;
+}
 
-    if (s != 0) pretty_log(PRETTY_ERROR, "pthread_join failed");
-    else pretty_log(PRETTY_DEBUG, "thread [%lu] exited cleanly", tty->thread);
+static
+void remove_terminal(terminal **terms, terminal *term)
+{
+    for (; *terms != NULL; terms = &(*terms)->next)
+        if (*terms == term) {
+            *terms = term->next;
+            terminal_close(term);
+            return;
+        }
 }
 
 int main(int argc, char **argv)
 {
     char *config_file = NULL;
+    char *trace_file = NULL;
+    bool server_mode = false;
+    bool new_window = false;
+    terminal_options opts = { 0 };
     int option_index, c;
 
     while (true) {
-        c = getopt_long(argc, argv, ":c:", LONG_OPTIONS, &option_index);
+        c = getopt_long(argc, argv, ":c:b:nr:p:ft:s::Swg", LONG_OPTIONS, &option_index);
 
         if (c < 0) break;
 
@@ -67,6 +83,37 @@ int main(int argc, char **argv)
             case 'c':
                 config_file = optarg;
                 break;
+            case 'b':
+                opts.bench_file = optarg;
+                break;
+            case 'n':
+                opts.no_render = true;
+                break;
+            case 'r':
+                opts.record_file = optarg;
+                break;
+            case 'p':
+                opts.replay_file = optarg;
+                break;
+            case 'f':
+                opts.fast = true;
+                break;
+            case 't':
+                trace_file = optarg;
+                break;
+            case 's':
+                opts.control_socket = true;
+                opts.control_path = optarg;
+                break;
+            case 'S':
+                server_mode = true;
+                break;
+            case 'w':
+                new_window = true;
+                break;
+            case 'g':
+                opts.gl = true;
+                break;
             case '?':
                 break;
             default:
@@ -75,6 +122,16 @@ int main(int argc, char **argv)
         }
     }
 
+    // a running server opens the window in milliseconds, otherwise start standalone
+    if (new_window) {
+        if (server_request(NULL, "new-window")) return EXIT_SUCCESS;
+        pretty_log(PRETTY_INFO, "No server running, opening a standalone window");
+    }
+
+    // --trace wins over PRETTY_TRACE, without either the trace points are no-ops
+    trace_init(trace_file);
+    trace_thread_name("main");
+
     if (config_file == NULL) config_file = get_default_config_file();
 
     else if (access(config_file, F_OK) != 0) {
@@ -85,162 +142,94 @@ int main(int argc, char **argv)
     pretty_log(PRETTY_INFO, "Loading config from [%s]", config_file);
     char *cat_config = file_read(config_file);
 
-    generic_config *config = return_config(cat_config);
+    shared_resources shared = { .config = return_config(cat_config) };
 
-    if (config == NULL) {
+    if (shared.config == NULL) {
         pretty_log(PRETTY_ERROR, "Failed to get config!");
         return EXIT_FAILURE;
     }
 
-    char buff[TTY_RING_CAP] = { 0 };
-    size_t buff_pos = 0;
-
-    tty_state tty = {
-        .pty_master_fd = tty_new((char *[]){ "/bin/sh", NULL }),
-        .buff_changed = false,
-        .lock = PTHREAD_MUTEX_INITIALIZER,
-        .overwrite_oldest = true,
-        .child_exited = false
-    };
-
-    if (pthread_create(&tty.thread, NULL, tty_poll_loop, &tty) != 0) return EXIT_FAILURE;
+    // the server outlives its windows, only a signal stops it
+    if (server_mode) SDL_SetHint(SDL_HINT_QUIT_ON_LAST_WINDOW_CLOSE, "0");
 
     if (!SDL_Init(SDL_INIT_VIDEO)) {
         pretty_log(PRETTY_ERROR, "Couldn't initialize SDL: %s", SDL_GetError());
         return SDL_APP_FAILURE;
     }
 
-    SDL_Window *win;
-    SDL_Renderer *renderer;
-    struct dim win_size = { SCREEN_WIDTH, SCREEN_HEIGHT };
-
-    if (!SDL_CreateWindowAndRenderer(
-            "examples/renderer/clear",
-            win_size.width, win_size.height,
-            SDL_WINDOW_RESIZABLE
-            | SDL_WINDOW_HIGH_PIXEL_DENSITY
-            | SDL_WINDOW_TRANSPARENT,
-            &win, &renderer))
-    {
-        pretty_log(PRETTY_ERROR, "Couldn't create window/renderer: %s", SDL_GetError());
-        return SDL_APP_FAILURE;
-    }
+    int status = EXIT_FAILURE;
+    terminal *terms = NULL;
+    server srv = { .listen_fd = -1 };
 
-    SDL_SetRenderDrawColor(renderer,
-        HEX_TO_RGBA(config->color_palette[COLOR_BACKGROUND]));
-#ifdef WAIT_EVENTS
-    SDL_SetWindowTitle(win, "Pretty");
-#endif
-
-    font_info font;
-    if (!collect_font(config->font_name, config->font_size, &font)) {
+    // the font is loaded once, glyphs are baked per display scale when a window first needs them
+    if (!collect_font(shared.config->font_name, shared.config->font_size, &shared.font)) {
         pretty_log(PRETTY_ERROR, "Failed to retrieve specified font");
         goto quit;
     }
 
-    glyph_atlas *atlas = create_atlas(renderer, font.ttf, config);
-    if (atlas == NULL) {
-        pretty_log(PRETTY_ERROR, "Failed to bake glyph atlas");
-        goto quit;
-    }
+    // links are found off the UI thread, without it they are only those sent with OSC 8
+    url_start(&shared.urls);
+
+    // windows opened through the server are plain shells, drawn the same way
+    const terminal_options server_opts = { .gl = opts.gl };
+
+    if (server_mode) {
+        if (!server_start(&srv, NULL)) goto quit;
+    } else if ((terms = terminal_open(&shared, &opts)) == NULL) goto quit;
 
     for (bool is_running = true; is_running;) {
         SDL_Event event;
-#ifdef WAIT_EVENTS
-        SDL_WaitEvent(&event);
-#else
-        for (; SDL_PollEvent(&event); ) {
-#endif
-            switch (event.type) {
-                case SDL_EVENT_QUIT:
-                    is_running = false;
-                    break;
-                case SDL_EVENT_WINDOW_RESIZED:
-                    win_size.width = event.window.data1;
-                    win_size.height = event.window.data2;
-                    pretty_log(PRETTY_INFO, "Window resized: %dx%d",
-                            win_size.width, win_size.height);
-                    goto render_frame;
-                    break;
-                case SDL_EVENT_WINDOW_EXPOSED:
-                    goto render_frame;
-                    break;
-                case SDL_EVENT_KEY_DOWN: {
-                    SDL_Keymod mod = SDL_GetModState();
-
-                    if (mod & SDL_KMOD_LCTRL) switch (event.key.key) {
-                        case SDLK_C:
-                            tty_write(&tty, "\x03", 1);
-                            break;
-                        case SDLK_D:
-                            tty_write(&tty, "\x04", 1);
-                            break;
-                        case SDLK_Z:
-                            tty_write(&tty, "\x1A", 1);
-                            break;
-                        default:
-                            pretty_log(PRETTY_DEBUG, "unhandled key combination: LCtrl+%s",
-                                    SDL_GetKeyName(event.key.key));
-                            break;
-                    }
-
-                    else if (event.key.key <= UCHAR_MAX && isprint(event.key.key))
-                        tty_write(&tty, (char *)&event.key.key, sizeof(char));
-
-                    else if (event.key.key == SDLK_RETURN)
-                        tty_write(&tty, "\r", length_of("\r"));
-
-                    else if (event.key.key == SDLK_BACKSPACE)
-                        tty_write(&tty, "\x7f", 1);
-
-                    else pretty_log(PRETTY_DEBUG, "unhandled key: %s", SDL_GetKeyName(event.key.key));
-                    break;
-                }
-                case SDL_EVENT_MOUSE_WHEEL:
-                    if (event.wheel.y > 0) calculate_scroll(&tty, SCROLL_UP);
-                    else if (event.wheel.y < 0) calculate_scroll(&tty, SCROLL_DOWN);
-
-                    read_to_buff(&tty, buff, sizeof(buff), &buff_pos);
-                    goto render_frame;
-                    break;
-                case SDL_EVENT_USER:
-                    read_to_buff(&tty, buff, sizeof(buff), &buff_pos);
-                    goto render_frame;
-
-render_frame:
-                    if (!render_frame(renderer, atlas, win_size, &tty, buff,
-                                sizeof(buff), &buff_pos, &font, config))
-                    {
-                        is_running = false;
-                        continue;
-                    }
-                    break;
-                default:
-                    break;
+        Sint32 timeout = -1;
+        Uint64 now = SDL_GetTicksNS();
+
+        // sleeps until an event or the next frame a window asked for, idle windows cost nothing
+        for (terminal *term = terms; term != NULL; term = term->next) {
+            Sint32 t = terminal_timeout(term, now);
+
+            if (t >= 0 && (timeout < 0 || t < timeout)) timeout = t;
+        }
+
+        for (bool got = SDL_WaitEventTimeout(&event, timeout); got; got = SDL_PollEvent(&event)) {
+            if (event.type == SDL_EVENT_QUIT) is_running = false;
+
+            else if (server_mode && event.type == srv.event_type) {
+                terminal *term = terminal_open(&shared, &server_opts);
+
+                if (term != NULL) (term->next = terms, terms = term);
+            }
+
+            else {
+                terminal *term = find_terminal(terms, SDL_GetWindowFromEvent(&event));
+
+                if (term != NULL && !terminal_handle_event(term, &event))
+                    remove_terminal(&terms, term);
             }
-#ifndef WAIT_EVENTS
         }
-#endif
-        display_fps_metrics(win);
+        // bounded so a screen full of new glyphs is spread over several iterations
+        for (int i = 0; i < shared.nglyphs; i++) glyph_cache_commit(shared.glyphs[i]);
 
-        if (tty.child_exited) {
-            is_running = false;
-            tty.should_exit = true;
+        for (terminal *term = terms, *next; term != NULL; term = next) {
+            next = term->next;
+            if (!terminal_update(term)) remove_terminal(&terms, term);
         }
-    }
+        tty_reap_children();
 
-    SDL_DestroyTexture(atlas->texture);
-    free(atlas);
+        if (terms == NULL && !server_mode) is_running = false;
+    }
+    status = EXIT_SUCCESS;
 
 quit:
-    thread_handle_quit(&tty);
-    TTF_CloseFont(font.ttf);
+    server_stop(&srv);
+    while (terms != NULL) remove_terminal(&terms, terms);
+    url_stop(&shared.urls);
+    // joins the raster workers, the last traced threads
+    for (int i = 0; i < shared.nglyphs; i++) glyph_cache_destroy(shared.glyphs[i]);
+    trace_flush();
+    if (shared.font.ttf != NULL) TTF_CloseFont(shared.font.ttf);
     TTF_Quit();
-    SDL_DestroyWindow(win);
-    SDL_DestroyRenderer(renderer);
     SDL_Quit();
     free(cat_config);
     pretty_log(PRETTY_INFO, "Succesfully closed Pretty instance");
 
-    return EXIT_SUCCESS;
+    return status;
 }
@@ -23,7 +23,7 @@ void die(const char *errstr, ...)
 }
 
 char *file_read(char const *filepath);
-void notify_ui_flush(void);
+void notify_ui_flush(unsigned int window_id);
 
 
 #endif
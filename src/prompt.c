@@ -0,0 +1,97 @@
+#include "alloc.h"
+#include "prompt.h"
+
+// Marks compare by line then column, a column always fits in 16 bits
+static
+uint64_t mark_pos(uint64_t line, int col)
+{
+    return line << 16 | (uint16_t)col;
+}
+
+static
+prompt_mark *ring_at(const mark_ring *ring, size_t i)
+{
+    return &ring->marks[(ring->head + i) & (PROMPT_MARKS_CAP - 1)];
+}
+
+// Index of the first mark at or past `pos`, `count` when there is none
+static
+size_t ring_lower_bound(const mark_ring *ring, uint64_t pos)
+{
+    size_t lo = 0;
+    size_t hi = ring->count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const prompt_mark *m = ring_at(ring, mid);
+
+        if (mark_pos(m->line, m->col) < pos) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void prompt_index_free(prompt_index *idx)
+{
+    for (int k = 0; k < MARK_KINDS; k++) counted_free(idx->rings[k].marks);
+    *idx = (prompt_index){ 0 };
+}
+
+void prompt_index_add(prompt_index *idx, enum prompt_mark_kind kind, prompt_mark mark)
+{
+    uint64_t pos = mark_pos(mark.line, mark.col);
+    mark_ring *ring = &idx->rings[kind];
+
+    // a redrawn prompt sends its mark again at the same place, it replaces the old one
+    for (int k = 0; k < MARK_KINDS; k++)
+        idx->rings[k].count = ring_lower_bound(&idx->rings[k], (k == (int)kind) ? pos : pos + 1);
+
+    if (ring->marks == NULL) {
+        ring->marks = counted_malloc(PROMPT_MARKS_CAP * sizeof *ring->marks);
+        if (ring->marks == NULL) return;
+    }
+
+    if (ring->count == PROMPT_MARKS_CAP) {
+        ring->head = (ring->head + 1) & (PROMPT_MARKS_CAP - 1);
+        ring->count--;
+    }
+    *ring_at(ring, ring->count++) = mark;
+}
+
+// Drops the marks on lines that fell off the scrollback
+void prompt_index_trim(prompt_index *idx, uint64_t first_line)
+{
+    for (int k = 0; k < MARK_KINDS; k++) {
+        mark_ring *ring = &idx->rings[k];
+
+        while (ring->count > 0 && ring_at(ring, 0)->line < first_line) {
+            ring->head = (ring->head + 1) & (PROMPT_MARKS_CAP - 1);
+            ring->count--;
+        }
+    }
+}
+
+const prompt_mark *prompt_index_last(const prompt_index *idx, enum prompt_mark_kind kind)
+{
+    const mark_ring *ring = &idx->rings[kind];
+
+    return (ring->count > 0) ? ring_at(ring, ring->count - 1) : NULL;
+}
+
+// The last mark of `kind` strictly before the position, NULL when there is none
+const prompt_mark *prompt_index_before(const prompt_index *idx, enum prompt_mark_kind kind, uint64_t line, int col)
+{
+    const mark_ring *ring = &idx->rings[kind];
+    size_t i = ring_lower_bound(ring, mark_pos(line, col));
+
+    return (i > 0) ? ring_at(ring, i - 1) : NULL;
+}
+
+// The first mark of `kind` at the position or after it, NULL when there is none
+const prompt_mark *prompt_index_after(const prompt_index *idx, enum prompt_mark_kind kind, uint64_t line, int col)
+{
+    const mark_ring *ring = &idx->rings[kind];
+    size_t i = ring_lower_bound(ring, mark_pos(line, col));
+
+    return (i < ring->count) ? ring_at(ring, i) : NULL;
+}
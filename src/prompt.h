@@ -0,0 +1,50 @@
+#ifndef PROMPT_H
+    #define PROMPT_H
+
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include <stdint.h>
+
+// marks kept per kind, about as many commands, the oldest are dropped first
+enum { PROMPT_MARKS_CAP = 2048 };
+
+// OSC 133 A, B, C and D, in the order a shell sends them for one command
+enum prompt_mark_kind {
+    MARK_PROMPT,
+    MARK_INPUT,
+    MARK_OUTPUT,
+    MARK_DONE,
+    MARK_KINDS,
+};
+
+typedef struct {
+    uint64_t line; // counted from the first line the screen ever had
+    int32_t status; // exit status sent with MARK_DONE, -1 when unknown
+    uint16_t col;
+} prompt_mark;
+
+// Marks of one kind in position order, circular from `head`
+typedef struct {
+    prompt_mark *marks; // PROMPT_MARKS_CAP of them, allocated by the first mark
+    size_t head;
+    size_t count;
+} mark_ring;
+
+/*
+ * Where shell integration said commands start and end. Every lookup is a
+ * binary search over one ring, the scrollback itself is never scanned.
+ * A mark placed before marks already there means the screen was drawn
+ * over them, those are dropped so the rings stay sorted.
+ */
+typedef struct {
+    mark_ring rings[MARK_KINDS];
+} prompt_index;
+
+void prompt_index_free(prompt_index *idx);
+void prompt_index_add(prompt_index *idx, enum prompt_mark_kind kind, prompt_mark mark);
+void prompt_index_trim(prompt_index *idx, uint64_t first_line);
+const prompt_mark *prompt_index_last(const prompt_index *idx, enum prompt_mark_kind kind);
+const prompt_mark *prompt_index_before(const prompt_index *idx, enum prompt_mark_kind kind, uint64_t line, int col);
+const prompt_mark *prompt_index_after(const prompt_index *idx, enum prompt_mark_kind kind, uint64_t line, int col);
+
+#endif // PROMPT_H
@@ -0,0 +1,149 @@
+#include <string.h>
+
+#include "pretty.h"
+#include "raster.h"
+#include "log.h"
+#include "unicode.h"
+#include "trace.h"
+
+// Marks and joiners are shaped with their base, the font places them
+static
+SDL_Surface *render_cluster(TTF_Font *font, uint32_t id)
+{
+    uint32_t cps[CLUSTER_LEN_MAX];
+    char text[CLUSTER_UTF8_MAX];
+
+    cluster_codepoints(id, cps);
+    if (!TTF_FontHasGlyph(font, cps[0])) return NULL;
+
+    return TTF_RenderText_Blended(font, text, cluster_utf8(id, text), (SDL_Color){ 255, 255, 255, 255 });
+}
+
+static
+void *raster_loop(void *arg)
+{
+    raster_worker *worker = arg;
+    raster_pool *pool = worker->pool;
+
+    trace_thread_name("glyph raster");
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->queue_count == 0 && !pool->should_exit)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+
+        if (pool->should_exit) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+
+        raster_job job = pool->queue[pool->queue_head];
+        pool->queue_head = (pool->queue_head + 1) % RASTER_QUEUE_CAP;
+        pool->queue_count--;
+        pthread_mutex_unlock(&pool->lock);
+
+        trace_span span = trace_begin("rasterise");
+        uint32_t cp = job.codepoint & GLYPH_CODEPOINT_MASK;
+        TTF_FontStyleFlags style = ((job.codepoint & GLYPH_BOLD) ? TTF_STYLE_BOLD : 0)
+            | ((job.codepoint & GLYPH_ITALIC) ? TTF_STYLE_ITALIC : 0);
+
+        // changing the style drops the font's own caches, so only when it differs
+        if (style != worker->style) {
+            TTF_SetFontStyle(worker->font, style);
+            worker->style = style;
+        }
+
+        // white coverage, tinted with the colour of each cell when drawn
+        if (cp >= CLUSTER_FIRST) job.surface = render_cluster(worker->font, cp);
+        else if (TTF_FontHasGlyph(worker->font, cp))
+            job.surface = TTF_RenderGlyph_Blended(worker->font, cp, (SDL_Color){ 255, 255, 255, 255 });
+        trace_end(&span);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->done[pool->done_count++] = job;
+        pthread_mutex_unlock(&pool->lock);
+
+        // wakes the event loop, no window is concerned in particular
+        notify_ui_flush(0);
+    }
+}
+
+bool raster_start(raster_pool *pool, TTF_Font *font)
+{
+    *pool = (raster_pool){
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .wake = PTHREAD_COND_INITIALIZER,
+    };
+
+    for (int i = 0; i < RASTER_WORKERS; i++) {
+        raster_worker *worker = &pool->workers[pool->nworkers];
+
+        *worker = (raster_worker){ .pool = pool, .font = TTF_CopyFont(font) };
+        if (worker->font == NULL) {
+            pretty_log(PRETTY_WARN, "Couldn't copy font for a raster worker: %s", SDL_GetError());
+            break;
+        }
+        TTF_SetFontHinting(worker->font, TTF_HINTING_MONO);
+
+        if (pthread_create(&worker->thread, NULL, raster_loop, worker) != 0) {
+            TTF_CloseFont(worker->font);
+            break;
+        }
+        pool->nworkers++;
+    }
+
+    if (pool->nworkers == 0) {
+        pretty_log(PRETTY_ERROR, "No glyph raster worker could be started");
+        return false;
+    }
+    return true;
+}
+
+void raster_stop(raster_pool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->should_exit = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->nworkers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        TTF_CloseFont(pool->workers[i].font);
+    }
+
+    for (size_t i = 0; i < pool->done_count; i++) SDL_DestroySurface(pool->done[i].surface);
+    pool->nworkers = 0;
+    pool->done_count = 0;
+}
+
+// Refuses once RASTER_QUEUE_CAP glyphs are in flight, the caller asks again later
+bool raster_submit(raster_pool *pool, uint32_t codepoint, int cells)
+{
+    bool queued = false;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->nworkers > 0 && pool->in_flight < RASTER_QUEUE_CAP) {
+        size_t tail = (pool->queue_head + pool->queue_count) % RASTER_QUEUE_CAP;
+
+        pool->queue[tail] = (raster_job){ .codepoint = codepoint, .cells = cells };
+        pool->queue_count++;
+        pool->in_flight++;
+        pthread_cond_signal(&pool->wake);
+        queued = true;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return queued;
+}
+
+// Hands over at most `max` finished glyphs, their surfaces now belong to the caller
+size_t raster_collect(raster_pool *pool, raster_job *out, size_t max)
+{
+    pthread_mutex_lock(&pool->lock);
+    size_t n = (pool->done_count < max) ? pool->done_count : max;
+
+    memcpy(out, pool->done + pool->done_count - n, n * sizeof(*out));
+    pool->done_count -= n;
+    pool->in_flight -= n;
+    pthread_mutex_unlock(&pool->lock);
+    return n;
+}
@@ -0,0 +1,63 @@
+#ifndef RASTER_H
+    #define RASTER_H
+
+    #include <pthread.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include <stdint.h>
+
+    #include <SDL3/SDL.h>
+    #include <SDL3_ttf/SDL_ttf.h>
+
+enum { RASTER_WORKERS = 2 };
+// glyphs queued, being rasterised or waiting to be collected, all at once
+enum { RASTER_QUEUE_CAP = 256 };
+
+// glyphs are keyed by codepoint, with the font style in the bits above it
+enum {
+    GLYPH_CODEPOINT_MASK = (1 << 21) - 1,
+    GLYPH_BOLD = 1 << 21,
+    GLYPH_ITALIC = 1 << 22,
+};
+
+typedef struct {
+    uint32_t codepoint; // and style bits
+    int cells;
+    SDL_Surface *surface; // NULL when the font has no glyph for it
+} raster_job;
+
+struct raster_pool;
+
+// TTF fonts can't be shared between threads, each worker owns a copy
+typedef struct {
+    struct raster_pool *pool;
+    TTF_Font *font;
+    TTF_FontStyleFlags style; // the style `font` is set to
+    pthread_t thread;
+} raster_worker;
+
+// Rasterises glyphs off the ui thread
+typedef struct raster_pool {
+    raster_worker workers[RASTER_WORKERS];
+    int nworkers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool should_exit;
+
+    raster_job queue[RASTER_QUEUE_CAP];
+    size_t queue_head;
+    size_t queue_count;
+
+    raster_job done[RASTER_QUEUE_CAP];
+    size_t done_count;
+
+    size_t in_flight;
+} raster_pool;
+
+bool raster_start(raster_pool *pool, TTF_Font *font);
+void raster_stop(raster_pool *pool);
+bool raster_submit(raster_pool *pool, uint32_t codepoint, int cells);
+size_t raster_collect(raster_pool *pool, raster_job *out, size_t max);
+
+#endif // RASTER_H
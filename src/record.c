@@ -0,0 +1,198 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pretty.h"
+#include "record.h"
+#include "screen.h"
+#include "slave.h"
+#include "trace.h"
+#include "log.h"
+
+enum { RECORD_HEADER_SIZE = 13 };
+enum { REPLAY_MAX_SLEEP_MS = 100 };
+
+static
+void put_le(unsigned char *dst, uint64_t v, int size)
+{
+    for (int i = 0; i < size; i++) dst[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static
+uint64_t get_le(const unsigned char *src, int size)
+{
+    uint64_t v = 0;
+
+    for (int i = size - 1; i >= 0; i--) v = (v << 8) | src[i];
+    return v;
+}
+
+bool record_open(recording *rec, const char *path)
+{
+    rec->file = fopen(path, "wb");
+    if (rec->file == NULL) {
+        pretty_log(PRETTY_ERROR, "Couldn't open recording [%s]: %s", path, strerror(errno));
+        return false;
+    }
+
+    if (fwrite(RECORD_MAGIC, 1, sizeof(RECORD_MAGIC) - 1, rec->file) != sizeof(RECORD_MAGIC) - 1) {
+        pretty_log(PRETTY_ERROR, "Couldn't write recording header to [%s]", path);
+        fclose(rec->file);
+        rec->file = NULL;
+        return false;
+    }
+
+    pthread_mutex_init(&rec->lock, NULL);
+    rec->start = trace_now_ns();
+    rec->fast = false;
+    pretty_log(PRETTY_INFO, "Recording session to [%s]", path);
+    return true;
+}
+
+bool replay_open(recording *rec, const char *path, bool fast)
+{
+    char magic[sizeof(RECORD_MAGIC) - 1];
+
+    rec->file = fopen(path, "rb");
+    if (rec->file == NULL) {
+        pretty_log(PRETTY_ERROR, "Couldn't open recording [%s]: %s", path, strerror(errno));
+        return false;
+    }
+
+    if (fread(magic, 1, sizeof(magic), rec->file) != sizeof(magic)
+        || memcmp(magic, RECORD_MAGIC, sizeof(magic)) != 0)
+    {
+        pretty_log(PRETTY_ERROR, "[%s] is not a pretty recording", path);
+        fclose(rec->file);
+        rec->file = NULL;
+        return false;
+    }
+
+    pthread_mutex_init(&rec->lock, NULL);
+    rec->fast = fast;
+    pretty_log(PRETTY_INFO, "Replaying session from [%s]", path);
+    return true;
+}
+
+void record_close(recording *rec)
+{
+    if (rec->file == NULL) return;
+
+    if (fclose(rec->file) != 0)
+        pretty_log(PRETTY_WARN, "Couldn't flush recording: %s", strerror(errno));
+
+    rec->file = NULL;
+    pthread_mutex_destroy(&rec->lock);
+}
+
+void record_event(recording *rec, enum record_kind kind, const void *data, size_t len)
+{
+    unsigned char header[RECORD_HEADER_SIZE];
+
+    if (rec == NULL || rec->file == NULL || len > UINT32_MAX) return;
+
+    pthread_mutex_lock(&rec->lock);
+
+    put_le(header, trace_now_ns() - rec->start, 8);
+    header[8] = kind;
+    put_le(header + 9, len, 4);
+
+    // a short write only truncates the recording, the session goes on
+    if (fwrite(header, 1, sizeof(header), rec->file) != sizeof(header)
+        || fwrite(data, 1, len, rec->file) != len)
+    {
+        pretty_log(PRETTY_WARN, "Recording truncated: %s", strerror(errno));
+        fclose(rec->file);
+        rec->file = NULL;
+    }
+
+    pthread_mutex_unlock(&rec->lock);
+}
+
+// Sleeps until `ts` past the start of the replay, returns false if asked to exit
+static
+bool replay_wait(tty_state *tty, uint64_t ts)
+{
+    recording *rec = tty->recording;
+
+    if (rec->fast) return !tty->should_exit;
+
+    for (uint64_t now; !tty->should_exit && (now = trace_now_ns() - rec->start) < ts;) {
+        uint64_t left = ts - now;
+
+        if (left > REPLAY_MAX_SLEEP_MS * 1000000ULL) left = REPLAY_MAX_SLEEP_MS * 1000000ULL;
+
+        struct timespec req = { left / 1000000000ULL, left % 1000000000ULL };
+        nanosleep(&req, NULL);
+    }
+    return !tty->should_exit;
+}
+
+// Stands in for the pty reader, feeding recorded output through the ring
+void *tty_replay_loop(void *arg)
+{
+    tty_state *tty = arg;
+    recording *rec = tty->recording;
+    unsigned char header[RECORD_HEADER_SIZE];
+    char *payload = NULL;
+    size_t payload_cap = 0;
+
+    trace_thread_name("replay");
+
+    // timestamps count from here, not from when the file was opened before the window
+    rec->start = trace_now_ns();
+    while (fread(header, 1, sizeof(header), rec->file) == sizeof(header)) {
+        uint64_t ts = get_le(header, 8);
+        enum record_kind kind = header[8];
+        size_t len = get_le(header + 9, 4);
+
+        if (len > payload_cap) {
+            char *grown = realloc(payload, len);
+            if (grown == NULL) {
+                pretty_log(PRETTY_ERROR, "Couldn't allocate %zu bytes for replay", len);
+                break;
+            }
+            payload = grown;
+            payload_cap = len;
+        }
+
+        if (fread(payload, 1, len, rec->file) != len) {
+            pretty_log(PRETTY_WARN, "Recording ends with a truncated record");
+            break;
+        }
+
+        if (!replay_wait(tty, ts)) break;
+
+        switch (kind) {
+            case RECORD_OUTPUT:
+                for (size_t done = 0; done < len && !tty->should_exit;)
+                    done += tty_push(tty, payload + done, len - done);
+                break;
+            case RECORD_RESIZE:
+                if (len == 4) {
+                    tty_wait_drained(tty);
+                    screen_resize(tty->screen, get_le((unsigned char *)payload, 2),
+                        get_le((unsigned char *)payload + 2, 2));
+                    // the parser is idle, the lock keeps its sync deadline out
+                    pthread_mutex_lock(&tty->lock);
+                    if (tty_publish(tty)) notify_ui_flush(tty->window_id);
+                    pthread_mutex_unlock(&tty->lock);
+                }
+                break;
+            case RECORD_INPUT:
+                // the recorded output already contains the effects of the input
+                break;
+            default:
+                pretty_log(PRETTY_WARN, "Skipping unknown record kind %d", kind);
+                break;
+        }
+    }
+
+    free(payload);
+    tty->child_exited = true;
+    notify_ui_flush(tty->window_id);
+    return NULL;
+}
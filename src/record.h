@@ -0,0 +1,36 @@
+#ifndef RECORD_H
+    #define RECORD_H
+
+    #include <pthread.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include <stdint.h>
+    #include <stdio.h>
+
+    #define RECORD_MAGIC "PRTYREC1"
+
+/*
+ * A recording is the magic followed by records of
+ * { u64 ns since start, u8 kind, u32 length, length bytes },
+ * all integers little endian.
+ */
+enum record_kind {
+    RECORD_OUTPUT,
+    RECORD_INPUT,
+    RECORD_RESIZE,
+};
+
+typedef struct recording {
+    FILE *file;
+    pthread_mutex_t lock;
+    uint64_t start;
+    bool fast;
+} recording;
+
+bool record_open(recording *rec, const char *path);
+bool replay_open(recording *rec, const char *path, bool fast);
+void record_close(recording *rec);
+void record_event(recording *rec, enum record_kind kind, const void *data, size_t len);
+void *tty_replay_loop(void *arg);
+
+#endif // RECORD_H
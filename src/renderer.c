@@ -1,14 +1,15 @@
-#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "SDL3/SDL_render.h"
 #include "SDL3_ttf/SDL_ttf.h"
+#include "boxdraw.h"
 #include "macro_utils.h"
 #include "renderer.h"
 #include "log.h"
-#include "pthread.h"
-#include "slave.h"
+#include "screen.h"
+#include "trace.h"
 
 static const char *event_name[] = {
     FOREACH_EVENT(GENERATE_STRING)
@@ -32,225 +33,906 @@ void display_fps_metrics(SDL_Window *win)
     }
 }
 
-glyph_atlas *create_atlas(SDL_Renderer *renderer, TTF_Font *font, generic_config *conf)
+static
+SDL_Rect slot_rect(const glyph_cache *cache, int slot, int cells)
 {
-    glyph_atlas *atlas = malloc(sizeof *atlas);
+    return (SDL_Rect){
+        (slot % GLYPH_SHEET_COLS) * cache->w, (slot / GLYPH_SHEET_COLS) * cache->h,
+        cells * cache->w, cache->h
+    };
+}
 
-    if (atlas == NULL)
+// Copies a rasterised glyph into its slot, clipped so it never bleeds into a neighbour
+static
+void sheet_put(glyph_cache *cache, SDL_Surface *glyph, SDL_Rect dst)
+{
+    SDL_Rect src = { 0, 0, SDL_min(glyph->w, dst.w), SDL_min(glyph->h, dst.h) };
+
+    // the alpha of a glyph is its coverage, it is copied as is into the transparent sheet
+    SDL_SetSurfaceBlendMode(glyph, SDL_BLENDMODE_NONE);
+    SDL_BlitSurface(glyph, &src, cache->sheet, &dst);
+}
+
+static
+glyph_entry *glyph_find(glyph_cache *cache, uint32_t codepoint)
+{
+    size_t i = (codepoint * 2654435761U) & (GLYPH_TABLE_CAP - 1);
+
+    while (cache->table[i].state != GLYPH_EMPTY && cache->table[i].codepoint != codepoint)
+        i = (i + 1) & (GLYPH_TABLE_CAP - 1);
+    return &cache->table[i];
+}
+
+// Takes a glyph out of the sheet, its entry stays so the next lookup rasterises it again
+static
+void sheet_evict(glyph_cache *cache, uint32_t key)
+{
+    glyph_entry *entry = glyph_find(cache, key);
+
+    for (int i = 0; i < entry->cells; i++) cache->slot_key[entry->slot + i] = 0;
+    entry->state = GLYPH_EVICTED;
+    cache->evictions++;
+    cache->baked--;
+}
+
+// The run of `cells` slots whose glyphs were looked up longest ago, -1 when the last frame drew them all
+static
+int sheet_oldest(glyph_cache *cache, int cells)
+{
+    uint64_t oldest = cache->frame_start;
+    int best = -1;
+
+    for (int slot = length_of(cache->glyphs); slot + cells <= GLYPH_SLOTS && oldest > 0; slot++) {
+        uint64_t used = 0;
+
+        if (cells == 2 && slot % GLYPH_SHEET_COLS == GLYPH_SHEET_COLS - 1) continue;
+
+        for (int i = 0; i < cells; i++)
+            if (cache->slot_key[slot + i] != 0)
+                used = SDL_max(used, glyph_find(cache, cache->slot_key[slot + i])->used);
+
+        if (used < oldest) (oldest = used, best = slot);
+    }
+    return best;
+}
+
+// A free run of `cells` slots for `key`, taken from older glyphs once the sheet is full
+static
+int sheet_reserve(glyph_cache *cache, uint32_t key, int cells)
+{
+    int slot = cache->next_slot;
+
+    // a wide glyph never wraps around the end of a sheet row
+    if (cells == 2 && slot % GLYPH_SHEET_COLS == GLYPH_SHEET_COLS - 1) slot++;
+
+    if (slot + cells <= GLYPH_SLOTS) cache->next_slot = slot + cells;
+    else if ((slot = sheet_oldest(cache, cells)) < 0) return -1;
+
+    for (int i = 0; i < cells; i++) {
+        if (cache->slot_key[slot + i] != 0) sheet_evict(cache, cache->slot_key[slot + i]);
+        cache->slot_key[slot + i] = key;
+    }
+    return slot;
+}
+
+// Records that `entry` now sits in `slot`, atlases upload its sheet row on their next sync
+static
+void sheet_written(glyph_cache *cache, glyph_entry *entry, int slot)
+{
+    entry->state = GLYPH_READY;
+    entry->slot = slot;
+    entry->version = ++cache->version;
+    cache->row_version[slot / GLYPH_SHEET_COLS] = cache->version;
+    cache->baked++;
+}
+
+// The band of sheet rows written since version `synced`, false when there is none
+bool sheet_dirty(const glyph_cache *cache, uint64_t synced, int *first, int *last)
+{
+    *first = GLYPH_SHEET_ROWS;
+    *last = -1;
+
+    if (synced == cache->version) return false;
+
+    for (int row = 0; row < GLYPH_SHEET_ROWS; row++) {
+        if (cache->row_version[row] <= synced) continue;
+        *first = SDL_min(*first, row);
+        *last = row;
+    }
+    return *last >= 0;
+}
+
+// Box drawing, blocks and braille are drawn from geometry, without going through the font
+static
+void sheet_put_shape(glyph_cache *cache, glyph_entry *entry)
+{
+    int slot = sheet_reserve(cache, entry->codepoint, entry->cells);
+
+    if (slot < 0) {
+        entry->state = GLYPH_EVICTED;
+        return;
+    }
+
+    SDL_Rect dst = slot_rect(cache, slot, entry->cells);
+
+    boxdraw_render(entry->codepoint, cache->shape_mask, dst.w, dst.h);
+
+    // white with the coverage as alpha, like the font glyphs
+    for (int y = 0; y < dst.h; y++) {
+        Uint32 *row = (Uint32 *)((Uint8 *)cache->sheet->pixels + (size_t)(dst.y + y) * cache->sheet->pitch);
+        const uint8_t *coverage = cache->shape_mask + (size_t)y * dst.w;
+
+        for (int x = 0; x < dst.w; x++)
+            row[dst.x + x] = SDL_MapSurfaceRGBA(cache->sheet, 255, 255, 255, coverage[x]);
+    }
+
+    sheet_written(cache, entry, slot);
+    cache->generation++;
+}
+
+// Rasterises at `scale` times the configured size, so glyphs map 1:1 to pixels
+glyph_cache *create_glyph_cache(TTF_Font *base, float scale, generic_config *conf)
+{
+    TRACE_SCOPE("create_glyph_cache");
+    glyph_cache *cache = calloc(1, sizeof *cache);
+
+    if (cache == NULL)
         return NULL;
 
+    TTF_Font *font = TTF_CopyFont(base);
+    if (font == NULL || !TTF_SetFontSize(font, conf->font_size * scale)) {
+        pretty_log(PRETTY_ERROR, "Couldn't size font for scale %.2f: %s", scale, SDL_GetError());
+        goto fail;
+    }
+    TTF_SetFontHinting(font, TTF_HINTING_MONO);
+
     int minx, maxx, miny, maxy, advance;
     TTF_GetGlyphMetrics(font, 'M', &minx, &maxx, &miny, &maxy, &advance);
-    atlas->w = advance;
-    atlas->h = TTF_GetFontHeight(font);
+    cache->w = advance;
+    cache->h = TTF_GetFontHeight(font);
+    cache->scale = scale;
+    cache->font = (font_info){ font, advance, TTF_GetFontLineSkip(font) };
 
-    int atlas_w = atlas->w * 16;
-    int atlas_h = atlas->h * 8;
-    atlas->texture = SDL_CreateTexture(
-        renderer, SDL_PIXELFORMAT_RGBA8888,
-        SDL_TEXTUREACCESS_TARGET, atlas_w, atlas_h);
+    cache->sheet = SDL_CreateSurface(
+        cache->w * GLYPH_SHEET_COLS, cache->h * GLYPH_SHEET_ROWS, SDL_PIXELFORMAT_RGBA8888);
+    cache->shape_mask = malloc((size_t)cache->w * 2 * cache->h);
+    if (cache->sheet == NULL || cache->shape_mask == NULL) goto fail;
 
-    SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
-    SDL_SetRenderTarget(renderer, atlas->texture);
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
-    SDL_RenderClear(renderer);
+    // ascii is needed by every frame, it is baked upfront in the regular style
+    for (int i = ' '; i <= '~'; i++) {
+        SDL_Surface *s = TTF_RenderGlyph_Blended(font, i, (SDL_Color){ 255, 255, 255, 255 });
+        if (!s) continue;
 
+        SDL_Rect dst = slot_rect(cache, i, 1);
+        sheet_put(cache, s, dst);
 
-    SDL_Color text_color = { HEX_TO_RGB(conf->color_palette[15]), .a=255 };
-    SDL_Color bg_color = { HEX_TO_RGB(conf->color_palette[COLOR_BACKGROUND]), .a=255 };
+        // Save the source rect for later
+        cache->glyphs[i] = (SDL_FRect){ dst.x, dst.y, SDL_min(s->w, dst.w), SDL_min(s->h, dst.h) };
+        cache->baked++;
 
-    for (int i = ' '; i <= '~'; i++) {
-        SDL_Surface *s = TTF_RenderGlyph_LCD(font, i, text_color, bg_color);
-        if (!s) continue;
+        SDL_DestroySurface(s);
+    }
+    cache->next_slot = length_of(cache->glyphs);
+    cache->version = 1;
+    for (int row = 0; row * GLYPH_SHEET_COLS < cache->next_slot; row++) cache->row_version[row] = 1;
+
+    // without workers only ascii is drawn
+    if (!raster_start(&cache->raster, font))
+        pretty_log(PRETTY_WARN, "Glyphs outside ascii won't be drawn");
+
+    pretty_log(PRETTY_INFO, "Glyph cache baked for scale %.2f", scale);
+    return cache;
+
+fail:
+    if (font != NULL) TTF_CloseFont(font);
+    SDL_DestroySurface(cache->sheet);
+    free(cache->shape_mask);
+    free(cache);
+    return NULL;
+}
 
-        SDL_Texture *t = SDL_CreateTextureFromSurface(renderer, s);
+void glyph_cache_destroy(glyph_cache *cache)
+{
+    if (cache == NULL) return;
 
-        int col = i % 16;
-        int row = i / 16;
+    raster_stop(&cache->raster);
+    SDL_DestroySurface(cache->sheet);
+    TTF_CloseFont(cache->font.ttf);
+    free(cache->shape_mask);
+    free(cache);
+}
 
-        SDL_FRect dst = {
-            (float)(col * atlas->w),
-            (float)(row * atlas->h),
-            (float)s->w,
-            (float)s->h
-        };
+// Drops the entries of evicted glyphs, false when the table stays too full to probe
+static
+bool glyph_table_compact(glyph_cache *cache)
+{
+    glyph_entry *old = counted_malloc(sizeof cache->table);
 
-        SDL_RenderTexture(renderer, t, NULL, &dst);
+    if (old == NULL) return false;
 
-        // Save the source rect for later
-        atlas->glyphs[i] = dst;
+    memcpy(old, cache->table, sizeof cache->table);
+    memset(cache->table, 0, sizeof cache->table);
+    cache->table_used = 0;
 
-        SDL_DestroySurface(s);
-        SDL_DestroyTexture(t);
+    for (int i = 0; i < GLYPH_TABLE_CAP; i++) {
+        if (old[i].state == GLYPH_EMPTY || old[i].state == GLYPH_EVICTED) continue;
+
+        *glyph_find(cache, old[i].codepoint) = old[i];
+        cache->table_used++;
     }
+    counted_free(old);
 
-    SDL_SetRenderTarget(renderer, NULL);
-    return atlas;
+    pretty_log(PRETTY_DEBUG, "glyph table compacted to %d entries", cache->table_used);
+    return cache->table_used < GLYPH_TABLE_CAP * 3 / 4;
 }
 
-static void calculate_scroll_internal(tty_state *tty, enum event dir)
+// Fills `src` once the glyph is in the atlas, a miss queues it for the raster workers
+enum glyph_state glyph_lookup(glyph_atlas *atlas, uint32_t codepoint, int cells, SDL_FRect *src)
 {
-    switch (dir) {
-        case SCROLL_UP: {
-            if (tty->scroll_tail == 0) break;
+    glyph_cache *cache = atlas->cache;
+    glyph_entry *entry = glyph_find(cache, codepoint);
 
-            size_t pos = (tty->scroll_tail + TTY_RING_CAP - 1) % TTY_RING_CAP;
+    entry->used = ++cache->clock;
 
-            while (pos != 0 && tty->buff[pos] != '\n')
-                pos = (pos + TTY_RING_CAP - 1) % TTY_RING_CAP;
+    if (entry->state == GLYPH_READY) {
+        // in the sheet but not uploaded yet, the next atlas_sync brings it
+        if (entry->version > atlas->synced) return GLYPH_PENDING;
 
-            if (tty->buff[pos] == '\n' && pos != 0) {
-                pos = (pos + TTY_RING_CAP - 1) % TTY_RING_CAP;
+        SDL_Rect r = slot_rect(cache, entry->slot, entry->cells);
 
-                while (pos != 0 && tty->buff[pos] != '\n')
-                    pos = (pos + TTY_RING_CAP - 1) % TTY_RING_CAP;
+        *src = (SDL_FRect){ r.x, r.y, r.w, r.h };
+        return GLYPH_READY;
+    }
+    if (entry->state != GLYPH_EMPTY && entry->state != GLYPH_EVICTED) return entry->state;
 
-                if (tty->buff[pos] == '\n') pos = (pos + 1) % TTY_RING_CAP;
-            }
+    // the table keeps some room free so probing stays short
+    if (entry->state == GLYPH_EMPTY && cache->table_used >= GLYPH_TABLE_CAP * 3 / 4) {
+        if (!glyph_table_compact(cache)) return GLYPH_MISSING;
+        entry = glyph_find(cache, codepoint);
+    }
+    if (entry->state == GLYPH_EMPTY) cache->table_used++;
 
-            tty->scroll_tail = pos;
+    if (boxdraw_supported(codepoint)) {
+        *entry = (glyph_entry){ .codepoint = codepoint, .cells = cells, .used = cache->clock };
+        sheet_put_shape(cache, entry);
+        return GLYPH_PENDING;
+    }
 
-            break;
-        }
-        case SCROLL_DOWN: {
-            if (tty->scroll_tail == tty->head) break;
+    if (raster_submit(&cache->raster, codepoint, cells))
+        *entry = (glyph_entry){ .codepoint = codepoint, .state = GLYPH_PENDING, .cells = cells, .used = cache->clock };
+    else if (cache->raster.nworkers == 0)
+        *entry = (glyph_entry){ .codepoint = codepoint, .state = GLYPH_MISSING };
+    else if (entry->state == GLYPH_EMPTY)
+        *entry = (glyph_entry){ .codepoint = codepoint, .state = GLYPH_EVICTED, .used = cache->clock };
 
-            size_t pos = tty->scroll_tail;
-            while (pos != tty->head && tty->buff[pos] != '\n')
-                pos = (pos + 1) % TTY_RING_CAP;
+    // a full queue is retried on the next frame that redraws the row
+    return entry->state == GLYPH_MISSING ? GLYPH_MISSING : GLYPH_PENDING;
+}
 
-            if (pos != tty->head && tty->buff[pos] == '\n')
-                pos = (pos + 1) % TTY_RING_CAP;
+// Moves finished glyphs into the sheet, at most GLYPH_COMMIT_BUDGET per call
+int glyph_cache_commit(glyph_cache *cache)
+{
+    raster_job jobs[GLYPH_COMMIT_BUDGET];
+    size_t n = raster_collect(&cache->raster, jobs, length_of(jobs));
 
-            if (pos != tty->head) tty->scroll_tail = pos;
+    if (n == 0) return 0;
 
-            break;
+    TRACE_SCOPE("glyph_cache_commit");
+    bool changed = false;
+
+    for (size_t i = 0; i < n; i++) {
+        glyph_entry *entry = glyph_find(cache, jobs[i].codepoint);
+
+        if (jobs[i].surface == NULL) {
+            entry->state = GLYPH_MISSING;
+            changed = true;
+            continue;
         }
-        default:
-            pthread_mutex_unlock(&tty->lock);
-            pretty_log(PRETTY_ERROR, "unhandled scroll event %d", dir);
-            return;
+
+        int slot = sheet_reserve(cache, jobs[i].codepoint, jobs[i].cells);
+
+        // everything in the sheet is on screen, it is tried again once the row is redrawn
+        if (slot < 0) entry->state = GLYPH_EVICTED;
+        else {
+            sheet_put(cache, jobs[i].surface, slot_rect(cache, slot, jobs[i].cells));
+            sheet_written(cache, entry, slot);
+            changed = true;
+        }
+        SDL_DestroySurface(jobs[i].surface);
     }
 
-    pretty_log(PRETTY_DEBUG, "scroll: event=%s, tail=%zu head=%zu",
-            event_name[dir], tty->scroll_tail, tty->head);
+    // frames waiting for glyphs are only drawn again when one of them arrived
+    if (changed) cache->generation++;
+    return n;
 }
 
-bool render_frame(
-    SDL_Renderer *renderer,
-    glyph_atlas *atlas,
-    struct dim win_size,
-    tty_state *tty,
-    char *text,
-    size_t buff_size,
-    size_t *buff_pos,
-    font_info *font,
-    generic_config *conf)
+glyph_atlas *create_atlas(SDL_Renderer *renderer, glyph_cache *cache)
 {
-    pthread_mutex_lock(&tty->lock);
+    TRACE_SCOPE("create_atlas");
+    glyph_atlas *atlas = malloc(sizeof *atlas);
+
+    if (atlas == NULL)
+        return NULL;
+
+    // nothing is rasterised per window, the shared sheet is only uploaded
+    atlas->texture = SDL_CreateTexture(renderer, cache->sheet->format,
+        SDL_TEXTUREACCESS_STATIC, cache->sheet->w, cache->sheet->h);
+    if (atlas->texture == NULL) {
+        free(atlas);
+        return NULL;
+    }
+
+    SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+    memcpy(atlas->glyphs, cache->glyphs, sizeof(atlas->glyphs));
+    atlas->w = cache->w;
+    atlas->h = cache->h;
+    atlas->cache = cache;
+    atlas->synced = 0;
+
+    if (!atlas_sync(atlas)) {
+        atlas_destroy(atlas);
+        return NULL;
+    }
+    return atlas;
+}
 
-    SDL_Color bg = { HEX_TO_RGB(conf->color_palette[COLOR_BACKGROUND]), .a=255 };
-    SDL_SetRenderDrawColor(renderer, bg.r, bg.g, bg.b, bg.a);
+// Uploads the sheet rows holding glyphs committed since the last call, in one batch
+bool atlas_sync(glyph_atlas *atlas)
+{
+    glyph_cache *cache = atlas->cache;
+    int first, last;
 
-    SDL_RenderClear(renderer);
+    if (!sheet_dirty(cache, atlas->synced, &first, &last)) return true;
 
-    unsigned int x = conf->pad_x;
-    unsigned int y = conf->pad_y;
+    SDL_Rect rows = { 0, first * cache->h, cache->sheet->w, (last - first + 1) * cache->h };
+    const char *pixels = (const char *)cache->sheet->pixels + (size_t)rows.y * cache->sheet->pitch;
 
-    size_t line_max_width = (win_size.width - (2 * x)) / font->advance;
-    size_t line_max_count= (win_size.height - (2 * y)) / font->line_skip;
+    if (!SDL_UpdateTexture(atlas->texture, &rows, pixels, cache->sheet->pitch)) {
+        pretty_log(PRETTY_ERROR, "Couldn't upload glyphs: %s", SDL_GetError());
+        return false;
+    }
+    atlas->synced = cache->version;
+    return true;
+}
 
-    size_t pos = tty->scroll_tail;
-    size_t line_count = 0;
+void atlas_destroy(glyph_atlas *atlas)
+{
+    if (atlas == NULL) return;
 
-    while (pos != *buff_pos && line_count < line_max_count) {
-        size_t current_line_len = 0;
+    SDL_DestroyTexture(atlas->texture);
+    free(atlas);
+}
 
-        while (pos != *buff_pos
-            && text[pos] != '\n'
-            && current_line_len < line_max_width)
-        {
-            char c = text[pos];
+// True when a glyph a previous frame had to leave out may have arrived since
+bool frame_needs_glyphs(const frame_state *frame, const glyph_atlas *atlas)
+{
+    return frame->glyphs_pending && frame->glyph_generation != atlas->cache->generation;
+}
 
-            if (isprint(c)) {
-                SDL_FRect src_rect = atlas->glyphs[(unsigned char)c];
+// `win_size` and `font` are in pixels, the configured padding is scaled to match
+struct dim grid_size(struct dim win_size, font_info *font, generic_config *conf, float scale)
+{
+    struct dim grid = {
+        (win_size.width - (2 * (int)(conf->pad_x * scale))) / font->advance,
+        (win_size.height - (2 * (int)(conf->pad_y * scale))) / font->line_skip
+    };
+
+    default_value(grid.width, 1);
+    default_value(grid.height, 1);
+    return grid;
+}
 
-                SDL_FRect dst_rect = {
-                    (float)(x + (current_line_len * font->advance)),
-                    (float)y,
-                    (float)font->advance,
-                    (float)font->line_skip
-                };
+// Drops every row, the counters keep running across resets
+static
+void row_cache_clear(row_cache *cache)
+{
+    for (int i = 0; i < cache->count; i++) SDL_DestroyTexture(cache->lines[i].texture);
+    counted_free(cache->lines);
+    counted_free(cache->hashes);
 
-                SDL_RenderTexture(renderer, atlas->texture, &src_rect, &dst_rect);
-            }
+    *cache = (row_cache){
+        .hits = cache->hits, .misses = cache->misses, .evictions = cache->evictions
+    };
+}
 
-            current_line_len++;
-            pos = (pos + 1) % buff_size;
-        }
+// Cached rows are as wide as the frame, they are thrown away when it is resized
+static
+void row_cache_init(row_cache *cache, int width, int height)
+{
+    row_cache_clear(cache);
+
+    cache->length = (size_t)width * height * 4;
+    cache->cap = (cache->length > 0) ? (int)(ROW_CACHE_BUDGET / cache->length) : 0;
+    if (cache->cap == 0) return;
+
+    cache->lines = counted_calloc(cache->cap, sizeof(*cache->lines));
+    cache->hashes = counted_calloc(cache->cap, sizeof(*cache->hashes));
+
+    // without its arrays the cache stays empty and rows are drawn glyph by glyph
+    if (cache->lines == NULL || cache->hashes == NULL) row_cache_clear(cache);
+}
+
+static
+void lru_unlink(row_cache *cache, line_renderer *line)
+{
+    if (line->prev != NULL) line->prev->next = line->next;
+    else cache->head = line->next;
+
+    if (line->next != NULL) line->next->prev = line->prev;
+    else cache->tail = line->prev;
+}
 
-        if (pos != *buff_pos && text[pos] == '\n') pos = (pos + 1) % buff_size;
+static
+void lru_push_front(row_cache *cache, line_renderer *line)
+{
+    line->prev = NULL;
+    line->next = cache->head;
 
-        line_count++;
+    if (cache->head != NULL) cache->head->prev = line;
+    else cache->tail = line;
+    cache->head = line;
+}
 
-        if (line_count < line_max_count) y += font->line_skip;
+static
+line_renderer *row_cache_find(row_cache *cache, uint64_t hash)
+{
+    for (int i = 0; i < cache->count; i++) {
+        if (cache->hashes[i] != hash) continue;
 
+        line_renderer *line = &cache->lines[i];
+        lru_unlink(cache, line);
+        lru_push_front(cache, line);
+        return line;
     }
+    return NULL;
+}
 
-    if (line_count >= line_max_count && pos != *buff_pos)
-        calculate_scroll_internal(tty, SCROLL_DOWN);
+// A fresh row texture, or the least recently used one once the budget is reached
+static
+line_renderer *row_cache_take(row_cache *cache, SDL_Renderer *renderer, int width, int height)
+{
+    line_renderer *line;
+
+    if (cache->count < cache->cap) {
+        line = &cache->lines[cache->count];
+        line->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888,
+            SDL_TEXTUREACCESS_TARGET, width, height);
+
+        if (line->texture == NULL) return NULL;
+        SDL_SetTextureBlendMode(line->texture, SDL_BLENDMODE_NONE);
+        cache->count++;
+    } else if ((line = cache->tail) != NULL) {
+        lru_unlink(cache, line);
+        cache->evictions++;
+    } else return NULL;
+
+    lru_push_front(cache, line);
+    return line;
+}
 
-    SDL_RenderPresent(renderer);
-    pthread_mutex_unlock(&tty->lock);
+static
+void row_cache_set_hash(row_cache *cache, line_renderer *line, uint64_t hash)
+{
+    line->hash = hash;
+    cache->hashes[line - cache->lines] = hash;
+}
+
+static
+bool frame_prepare(
+    SDL_Renderer *renderer,
+    frame_state *frame,
+    struct dim win_size,
+    int rows,
+    int line_skip,
+    SDL_Color bg)
+{
+    if (frame->texture == NULL
+        || frame->size.width != win_size.width
+        || frame->size.height != win_size.height)
+    {
+        SDL_DestroyTexture(frame->texture);
+        frame->texture = SDL_CreateTexture(
+            renderer, SDL_PIXELFORMAT_RGBA8888,
+            SDL_TEXTUREACCESS_TARGET, win_size.width, win_size.height);
+
+        if (frame->texture == NULL) {
+            pretty_log(PRETTY_ERROR, "Couldn't create frame texture: %s", SDL_GetError());
+            return false;
+        }
+
+        SDL_SetTextureBlendMode(frame->texture, SDL_BLENDMODE_NONE);
+        SDL_SetRenderTarget(renderer, frame->texture);
+        SDL_SetRenderDrawColor(renderer, bg.r, bg.g, bg.b, bg.a);
+        SDL_RenderClear(renderer);
+
+        frame->size = win_size;
+        frame->rows = 0;
+    }
+
+    // rows are as tall as a line of the font the atlas was baked with
+    if (frame->cache.length != (size_t)win_size.width * line_skip * 4)
+        row_cache_init(&frame->cache, win_size.width, line_skip);
+
+    if (frame->rows != rows) {
+        uint64_t *drawn = counted_realloc(frame->drawn, rows * sizeof *drawn);
+
+        if (drawn == NULL) return false;
+        memset(drawn, 0, rows * sizeof *drawn);
+
+        frame->drawn = drawn;
+        frame->rows = rows;
+        frame->origin = 0;
+    }
 
     return true;
 }
 
+// The rows kept from the last frame follow the content, only the exposed ones are left stale
+void scroll_rows(uint64_t *drawn, int rows, int *origin, int64_t delta)
+{
+    if (delta == 0 || delta <= -rows || delta >= rows) return;
+
+    int n = (int)((delta > 0) ? delta : -delta);
+
+    if (delta > 0) memmove(drawn, drawn + n, (rows - n) * sizeof(*drawn));
+    else memmove(drawn + n, drawn, (rows - n) * sizeof(*drawn));
+
+    memset(drawn + ((delta > 0) ? rows - n : 0), 0, n * sizeof(*drawn));
+    *origin = (int)(((*origin + delta) % rows + rows) % rows);
+}
+
+static
+void frame_scroll(frame_state *frame, uint64_t top_line)
+{
+    int64_t delta = (int64_t)(top_line - frame->top_line);
+
+    frame->top_line = top_line;
+    scroll_rows(frame->drawn, frame->rows, &frame->origin, delta);
+}
 
-void calculate_scroll(tty_state *tty, enum event dir)
+static
+float frame_row_y(const frame_state *frame, int row, int pad_y, int line_skip)
 {
-    pthread_mutex_lock(&tty->lock);
-    calculate_scroll_internal(tty, dir);
-    pthread_mutex_unlock(&tty->lock);
+    return (float)(pad_y + ((row + frame->origin) % frame->rows) * line_skip);
 }
 
-void read_to_buff(
-    tty_state *tty,
-    char *buff,
-    size_t buff_size,
-    size_t *buff_pos)
+// Unrolls the circular rows back in order while copying the frame to the window
+static
+void frame_present(SDL_Renderer *renderer, const frame_state *frame, int pad_y, int line_skip)
 {
-    pthread_mutex_lock(&tty->lock);
+    float w = (float)frame->size.width;
+    float top = (float)pad_y;
+    float split = (float)((frame->rows - frame->origin) * line_skip);
+    float wrapped = (float)(frame->origin * line_skip);
+    float bottom = top + split + wrapped;
+
+    SDL_FRect above = { 0, 0, w, top };
+    SDL_FRect first = { 0, top + wrapped, w, split };
+    SDL_FRect second = { 0, top, w, wrapped };
+    SDL_FRect below = { 0, bottom, w, (float)frame->size.height - bottom };
+
+    SDL_RenderTexture(renderer, frame->texture, &above, &above);
+    SDL_RenderTexture(renderer, frame->texture, &first, &(SDL_FRect){ 0, top, w, split });
+    if (frame->origin > 0)
+        SDL_RenderTexture(renderer, frame->texture, &second, &(SDL_FRect){ 0, top + split, w, wrapped });
+    if (below.h > 0) SDL_RenderTexture(renderer, frame->texture, &below, &below);
+}
 
-    const char *p;
-    size_t new_bytes = ring_read_span(tty, &p);
+// What every row of a frame is drawn with
+typedef struct {
+    SDL_Renderer *renderer;
+    glyph_atlas *atlas;
+    font_info *font;
+    const cell_attr *attrs;
+    const uint32_t *palette;
+    int pad_x;
+    int baseline; // from the top of the line
+    float width;
+    int sel_from; // selected columns of the row being drawn, up to `sel_to`
+    int sel_to;
+    int hover_from; // columns of the hovered url, up to `hover_to`
+    int hover_to;
+    uint16_t hover_link; // OSC 8 link under the mouse
+} row_painter;
+
+// Resolves a colour set by SGR against the palette, `fallback` standing for the default one
+uint32_t attr_color(uint32_t color, const uint32_t *palette, uint32_t fallback)
+{
+    switch (ATTR_COLOR_KIND(color)) {
+        case ATTR_COLOR_INDEXED:
+            return palette[color & 0xFF];
+        case ATTR_COLOR_RGB:
+            return (color & 0xFFFFFF) << 8 | 0xFF;
+        default:
+            return fallback;
+    }
+}
 
-    if (new_bytes) {
-        pretty_log(PRETTY_INFO, "Processing %zu new bytes (consumed: %zu, total: %zu)",
-           new_bytes, tty->tail, tty->head);
+// Selected cells show in inverse video, or back to normal when they already were
+void cell_colors(const cell_attr *a, const uint32_t *palette, bool selected, uint32_t *fg, uint32_t *bg)
+{
+    *fg = attr_color(a->fg, palette, palette[COLOR_FOREGROUND]);
+    *bg = attr_color(a->bg, palette, palette[COLOR_BACKGROUND]);
 
-        for (size_t i = 0; i < new_bytes; i++) {
-            char ch = p[i];
+    if (!!(a->flags & ATTR_INVERSE) != selected) {
+        uint32_t tmp = *fg;
 
-            if (ch == '\b' || ch == 0x7f) {
-                if (*buff_pos > 0) {
-                    (*buff_pos)--;
-                    pretty_log(PRETTY_INFO, "Backspace: removed char at position %zu", *buff_pos);
-                    buff[*buff_pos] = '\0';
-                }
-            } else if (*buff_pos < buff_size - 1) {
-                buff[(*buff_pos)++] = ch;
-                buff[*buff_pos] = '\0';
-                pretty_log(PRETTY_INFO, "Added char '%c' at position %zu",
-                    (isprint(ch)) ? ch : '?', *buff_pos - 1);
+        *fg = *bg;
+        *bg = tmp;
+    }
+
+    // faint text sits halfway to the background
+    if (a->flags & ATTR_FAINT) *fg = (((*fg >> 1) & 0x7F7F7F7F) + ((*bg >> 1) & 0x7F7F7F7F)) | 0xFF;
+}
+
+// The atlas key of `c`, box drawing is geometry and looks the same whatever the style
+uint32_t glyph_key(uint32_t c, uint16_t flags)
+{
+    if (boxdraw_supported(c)) return c;
+    return c | ((flags & ATTR_BOLD) ? GLYPH_BOLD : 0) | ((flags & ATTR_ITALIC) ? GLYPH_ITALIC : 0);
+}
+
+// Underlines and strike through, drawn over the glyph of one cell. A hovered link gets an underline
+static
+void draw_decorations(const row_painter *p, const cell_attr *a, uint32_t fg, float x, float y, int span, bool hovered)
+{
+    enum { WAVE_RECTS = 64 };
+    int style = ATTR_UNDERLINE(a->flags);
+    float w = (float)(span * p->font->advance);
+    float t = SDL_max(1, p->font->line_skip / 16);
+    float under = y + SDL_min(p->baseline + t, p->font->line_skip - 3 * t);
+    SDL_Renderer *r = p->renderer;
+
+    if (a->flags & ATTR_STRIKE) {
+        SDL_SetRenderDrawColor(r, RGBA_SPLIT(fg));
+        SDL_RenderFillRect(r, &(SDL_FRect){ x, y + p->baseline * 2 / 3, w, t });
+    }
+    if (hovered && style == UNDERLINE_NONE) style = UNDERLINE_SINGLE;
+    if (style == UNDERLINE_NONE) return;
+
+    uint32_t color = attr_color(a->underline, p->palette, fg);
+    SDL_FRect rects[WAVE_RECTS];
+    int n = 0;
+
+    SDL_SetRenderDrawColor(r, RGBA_SPLIT(color));
+    switch (style) {
+        case UNDERLINE_DOUBLE:
+            rects[n++] = (SDL_FRect){ x, under, w, t };
+            rects[n++] = (SDL_FRect){ x, under + 2 * t, w, t };
+            break;
+        case UNDERLINE_CURLY:
+            // a triangle wave, one period per cell so neighbours join up
+            for (float i = 0; i < w && n < WAVE_RECTS; i += t) {
+                float phase = SDL_fmodf(i, (float)p->font->advance) / p->font->advance;
+                float rise = (phase < 0.5f ? phase : 1 - phase) * 4 * t;
+
+                rects[n++] = (SDL_FRect){ x + i, under - t + rise, t, t };
             }
+            break;
+        case UNDERLINE_DOTTED:
+            for (float i = 0; i < w && n < WAVE_RECTS; i += 2 * t) rects[n++] = (SDL_FRect){ x + i, under, t, t };
+            break;
+        case UNDERLINE_DASHED:
+            for (int i = 0; i < span * 3; i++)
+                rects[n++] = (SDL_FRect){ x + i * w / (span * 3), under, w / (span * 6), t };
+            break;
+        default:
+            rects[n++] = (SDL_FRect){ x, under, w, t };
+            break;
+    }
+    SDL_RenderFillRects(r, rects, n);
+}
+
+static
+bool painter_selected(const row_painter *p, int col)
+{
+    return col >= p->sel_from && col < p->sel_to;
+}
+
+static
+bool painter_hovered(const row_painter *p, int col, const cell_attr *a)
+{
+    return (col >= p->hover_from && col < p->hover_to) || (p->hover_link != 0 && a->link == p->hover_link);
+}
+
+// Returns false when some glyphs were left blank because they are still rasterising
+static
+bool draw_row(const row_painter *p, const cell *cells, int cols, float y)
+{
+    SDL_Renderer *renderer = p->renderer;
+    glyph_atlas *atlas = p->atlas;
+    const uint32_t *palette = p->palette;
+    float advance = (float)p->font->advance;
+    float line_skip = (float)p->font->line_skip;
+    bool complete = true;
+
+    SDL_SetRenderDrawColor(renderer, RGBA_SPLIT(palette[COLOR_BACKGROUND]));
+    SDL_RenderFillRect(renderer, &(SDL_FRect){ 0, y, p->width, line_skip });
+
+    // backgrounds go first, one rectangle per run of cells with the same attributes
+    for (int col = 0; col < cols;) {
+        int start = col;
+        bool selected = painter_selected(p, start);
+        uint32_t fg, bg;
+
+        while (++col < cols && cells[col].attr == cells[start].attr
+            && painter_selected(p, col) == selected);
+
+        if (cells[start].attr == 0 && !selected) continue;
+        cell_colors(&p->attrs[cells[start].attr], palette, selected, &fg, &bg);
+        if (bg == palette[COLOR_BACKGROUND]) continue;
+
+        SDL_SetRenderDrawColor(renderer, RGBA_SPLIT(bg));
+        SDL_RenderFillRect(renderer,
+            &(SDL_FRect){ p->pad_x + start * advance, y, (col - start) * advance, line_skip });
+    }
+
+    // glyphs are white in the atlas, tinted per cell and only when the colour changes
+    uint32_t tint = palette[COLOR_FOREGROUND];
+    SDL_SetTextureColorMod(atlas->texture, RGBA_TO_RGB(tint));
+
+    for (int col = 0; col < cols; col++) {
+        uint32_t c = cells[col].codepoint;
+        const cell_attr *a = &p->attrs[cells[col].attr];
+        int span = (col + 1 < cols && cells[col + 1].codepoint == CELL_WIDE_SPACER) ? 2 : 1;
+        float x = p->pad_x + col * advance;
+        uint32_t fg, bg;
+        SDL_FRect src;
+
+        if (c == CELL_WIDE_SPACER || (a->flags & ATTR_HIDDEN)) continue;
+
+        bool hovered = painter_hovered(p, col, a);
+
+        cell_colors(a, palette, painter_selected(p, col), &fg, &bg);
+        if (hovered || (a->flags & (ATTR_STRIKE | (7 << ATTR_UNDERLINE_SHIFT))))
+            draw_decorations(p, a, fg, x, y, span, hovered);
 
-            if (*buff_pos >= buff_size - 1) {
-                pretty_log(PRETTY_WARN, "buff_pos overflow, resseting");
-                *buff_pos = 0;
+        if (c <= ' ' || c == 0x7F) continue;
+
+        uint32_t key = glyph_key(c, a->flags);
+
+        if (key <= '~') src = atlas->glyphs[key];
+        else {
+            enum glyph_state state = glyph_lookup(atlas, key, span, &src);
+
+            if (state != GLYPH_READY) {
+                complete &= state == GLYPH_MISSING;
+                continue;
             }
         }
-        ring_consume(tty, new_bytes);
+
+        if (fg != tint) {
+            SDL_SetTextureColorMod(atlas->texture, RGBA_TO_RGB(fg));
+            tint = fg;
+        }
+        SDL_RenderTexture(renderer, atlas->texture, &src, &(SDL_FRect){ x, y, span * advance, line_skip });
     }
-    pthread_mutex_unlock(&tty->lock);
+    return complete;
+}
+
+// Copies the row from the cache, or renders it once into a cached texture first
+static
+bool draw_row_cached(const row_painter *p, frame_state *frame, const cell *cells, int cols, uint64_t hash, float y)
+{
+    row_cache *cache = &frame->cache;
+    int width = frame->size.width;
+    int line_skip = p->font->line_skip;
+    SDL_FRect dst = { 0, y, (float)width, (float)line_skip };
+    line_renderer *line = row_cache_find(cache, hash);
+
+    if (line != NULL) {
+        cache->hits++;
+        SDL_RenderTexture(p->renderer, line->texture, NULL, &dst);
+        return true;
+    }
+
+    cache->misses++;
+    line = row_cache_take(cache, p->renderer, width, line_skip);
+    if (line == NULL) return draw_row(p, cells, cols, y);
+
+    SDL_SetRenderTarget(p->renderer, line->texture);
+    bool complete = draw_row(p, cells, cols, 0);
+    SDL_SetRenderTarget(p->renderer, frame->texture);
+
+    // a row missing glyphs is drawn but not kept, the next lookup must miss
+    row_cache_set_hash(cache, line, complete ? hash : 0);
+    SDL_RenderTexture(p->renderer, line->texture, NULL, &dst);
+    return complete;
+}
+
+// Draws in pixels, `font` is the one the atlas glyphs were baked with
+bool render_frame(
+    SDL_Renderer *renderer,
+    glyph_atlas *atlas,
+    frame_state *frame,
+    struct dim win_size,
+    const screen_snapshot *snap,
+    font_info *font,
+    generic_config *conf)
+{
+    TRACE_SCOPE("render_frame");
+    int pad_x = (int)(conf->pad_x * atlas->cache->scale);
+    int pad_y = (int)(conf->pad_y * atlas->cache->scale);
+    SDL_Color bg = { RGBA_SPLIT(conf->color_palette[COLOR_BACKGROUND]) };
+    row_painter painter = {
+        renderer, atlas, font, snap->attrs, conf->color_palette, pad_x,
+        TTF_GetFontAscent(font->ttf), (float)win_size.width, 0, 0, 0, 0, snap->hover_link
+    };
+
+    trace_span span = trace_begin("frame_prepare");
+    bool prepared = frame_prepare(renderer, frame, win_size, snap->rows, font->line_skip, bg);
+    trace_end(&span);
+
+    if (!prepared) return false;
+
+    SDL_SetRenderTarget(renderer, frame->texture);
+
+    frame_scroll(frame, snap->top_line);
+
+    // only rows whose content changed since the last frame are redrawn
+    span = trace_begin("draw_rows");
+    frame->glyphs_pending = false;
+    frame->glyph_generation = atlas->cache->generation;
+    atlas->cache->frame_start = atlas->cache->clock;
+
+    for (int row = 0; row < snap->rows; row++) {
+        if (frame->drawn[row] == snap->row_hash[row]) continue;
+
+        snapshot_selected(snap, row, &painter.sel_from, &painter.sel_to);
+        snapshot_hovered(snap, row, &painter.hover_from, &painter.hover_to);
+        bool complete = draw_row_cached(&painter, frame,
+            snap->cells + (size_t)row * snap->cols, snap->cols, snap->row_hash[row],
+            frame_row_y(frame, row, pad_y, font->line_skip));
+
+        // a row missing glyphs doesn't match any hash, it is drawn again once they land
+        frame->drawn[row] = complete ? snap->row_hash[row] : ~snap->row_hash[row];
+        frame->glyphs_pending |= !complete;
+    }
+    trace_end(&span);
+
+    SDL_SetRenderTarget(renderer, NULL);
+    frame_present(renderer, frame, pad_y, font->line_skip);
+
+    if (snap->cursor_visible) {
+        SDL_FRect cursor = {
+            (float)(pad_x + snap->cursor_x * font->advance),
+            (float)(pad_y + snap->cursor_y * font->line_skip),
+            (float)font->advance,
+            (float)font->line_skip
+        };
+
+        SDL_SetRenderDrawColor(renderer, RGBA_SPLIT(conf->color_palette[REVERSED_COLOR]));
+        SDL_RenderRect(renderer, &cursor);
+    }
+
+    span = trace_begin("present");
+    SDL_RenderPresent(renderer);
+    trace_end(&span);
+
+    return true;
+}
+
+void frame_destroy(frame_state *frame)
+{
+    SDL_DestroyTexture(frame->texture);
+    counted_free(frame->drawn);
+    row_cache_clear(&frame->cache);
+    *frame = (frame_state){ 0 };
+}
+
+void calculate_scroll(screen *scr, enum event dir)
+{
+    switch (dir) {
+        case SCROLL_UP:
+            screen_scroll_view(scr, 1);
+            break;
+        case SCROLL_DOWN:
+            screen_scroll_view(scr, -1);
+            break;
+        default:
+            pretty_log(PRETTY_ERROR, "unhandled scroll event %d", dir);
+            return;
+    }
+
+    pretty_log(PRETTY_DEBUG, "scroll: event=%s", event_name[dir]);
 }
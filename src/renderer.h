@@ -5,7 +5,8 @@
 
     #include "font.h"
     #include "config.h"
-    #include "slave.h"
+    #include "raster.h"
+    #include "screen.h"
 
 
 #define FOREACH_EVENT(EVENT) \
@@ -19,43 +20,149 @@ enum event {
     FOREACH_EVENT(GENERATE_ENUM)
 };
 
+// the sheet is a grid of cell sized slots, ascii takes the first 128 by codepoint
+enum { GLYPH_SHEET_COLS = 64, GLYPH_SHEET_ROWS = 32 };
+enum { GLYPH_SLOTS = GLYPH_SHEET_COLS * GLYPH_SHEET_ROWS };
+enum { GLYPH_TABLE_CAP = 4096 };
+// finished glyphs moved into the sheet per loop iteration, bounds the cost of a burst
+enum { GLYPH_COMMIT_BUDGET = 32 };
+
+enum glyph_state {
+    GLYPH_EMPTY,
+    GLYPH_PENDING,
+    GLYPH_READY,
+    GLYPH_MISSING,
+    GLYPH_EVICTED, // not in the sheet, rasterised again the next time it is drawn
+};
+
+typedef struct {
+    uint32_t codepoint;
+    uint8_t state;
+    uint8_t cells;
+    uint16_t slot;
+    uint64_t used; // `clock` of the last lookup
+    uint64_t version; // `version` of the sheet when the glyph was written into it
+} glyph_entry;
+
+// Glyphs rasterised once per process and display scale, every window uploads them into its own atlas
+typedef struct {
+    font_info font; // pixel metrics at `scale`, the font is a copy owned by the cache
+    float scale;
+
+    SDL_Surface *sheet;
+    SDL_FRect glyphs[128];
+    int w, h;
+
+    /*
+     * Everything past ascii is rasterised on demand, only touched by the ui
+     * thread. Once the sheet is full, the slots whose glyphs were looked up
+     * longest ago are taken over, but never those the last frame drew.
+     */
+    glyph_entry table[GLYPH_TABLE_CAP];
+    int table_used;
+    int next_slot;
+    uint32_t slot_key[GLYPH_SLOTS]; // the glyph in each slot, 0 for a free one
+    uint64_t clock; // bumped by every lookup
+    uint64_t frame_start; // `clock` when the last frame began
+    uint64_t version; // bumped by every write into the sheet
+    uint64_t row_version[GLYPH_SHEET_ROWS];
+    size_t evictions;
+    int baked;
+    uint64_t generation;
+    raster_pool raster;
+    uint8_t *shape_mask; // coverage of one procedural glyph, two cells wide
+} glyph_cache;
+
 typedef struct {
     SDL_Texture *texture;
     SDL_FRect glyphs[128];
     int w, h;
+    glyph_cache *cache;
+    uint64_t synced; // version of the sheet uploaded
 } glyph_atlas;
 
-typedef struct {
-    SDL_Surface *surface;
+// VRAM the pre-rendered rows of one window may take
+enum { ROW_CACHE_BUDGET = 32 * 1024 * 1024 };
+
+// One pre-rendered row, copied as a whole whenever a row with the same content is drawn
+typedef struct line_renderer {
     SDL_Texture *texture;
-    size_t length;
+    uint64_t hash;
+    struct line_renderer *prev; // least recently used order, most recent first
+    struct line_renderer *next;
 } line_renderer;
 
+/*
+ * Rows keyed by content hash, sized so `cap` rows fit ROW_CACHE_BUDGET.
+ * `cap` is a few hundred rows at most, a linear scan over the packed
+ * hashes is cheaper than keeping a map in sync.
+ */
+typedef struct {
+    line_renderer *lines;
+    uint64_t *hashes;
+    int count;
+    int cap;
+    size_t length; // bytes taken by one row texture
+    line_renderer *head;
+    line_renderer *tail;
+
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+} row_cache;
+
 struct dim {
     int width;
     int height;
 };
 
+/*
+ * Last presented frame, kept so unchanged rows don't need to be redrawn.
+ * Rows are stored circularly from `origin`, so a scroll only moves the
+ * origin and the rows it exposes are the only ones drawn.
+ */
+typedef struct {
+    SDL_Texture *texture;
+    struct dim size;
+    uint64_t *drawn;
+    int rows;
+    int origin;
+    uint64_t top_line;
+    row_cache cache;
+
+    /* rows drawn while some of their glyphs were still rasterising */
+    bool glyphs_pending;
+    uint64_t glyph_generation;
+} frame_state;
+
 void display_fps_metrics(SDL_Window *win);
-glyph_atlas* create_atlas(SDL_Renderer *renderer, TTF_Font *font, generic_config *conf);
+glyph_cache *create_glyph_cache(TTF_Font *font, float scale, generic_config *conf);
+void glyph_cache_destroy(glyph_cache *cache);
+int glyph_cache_commit(glyph_cache *cache);
+glyph_atlas *create_atlas(SDL_Renderer *renderer, glyph_cache *cache);
+bool atlas_sync(glyph_atlas *atlas);
+bool sheet_dirty(const glyph_cache *cache, uint64_t synced, int *first, int *last);
+void atlas_destroy(glyph_atlas *atlas);
+bool frame_needs_glyphs(const frame_state *frame, const glyph_atlas *atlas);
 bool render_frame(
     SDL_Renderer *renderer,
     glyph_atlas *atlas,
+    frame_state *frame,
     struct dim win_size,
-    tty_state *tty,
-    char *text,
-    size_t buff_size,
-    size_t *buff_pos,
+    const screen_snapshot *snap,
     font_info *font,
     generic_config *conf
 );
-void read_to_buff(
-    tty_state *tty,
-    char *buff,
-    size_t buff_size,
-    size_t *buff_pos
-);
+void frame_destroy(frame_state *frame);
+void scroll_rows(uint64_t *drawn, int rows, int *origin, int64_t delta);
+
+// shared with the GL renderer, which resolves cells the same way
+enum glyph_state glyph_lookup(glyph_atlas *atlas, uint32_t key, int cells, SDL_FRect *src);
+uint32_t glyph_key(uint32_t c, uint16_t flags);
+uint32_t attr_color(uint32_t color, const uint32_t *palette, uint32_t fallback);
+void cell_colors(const cell_attr *a, const uint32_t *palette, bool selected, uint32_t *fg, uint32_t *bg);
+struct dim grid_size(struct dim win_size, font_info *font, generic_config *conf, float scale);
 
-void calculate_scroll(tty_state *tty, enum event dir);
+void calculate_scroll(screen *scr, enum event dir);
 
 #endif // RENDERER_H
@@ -0,0 +1,1965 @@
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "macro_utils.h"
+#include "pretty.h"
+#include "screen.h"
+#include "log.h"
+#include "trace.h"
+#include "urls.h"
+
+#define PAGE_CELLS ((SCROLLBACK_PAGE_SIZE - sizeof(scrollback_page)) / sizeof(cell))
+// room an attribute of a scrollback line takes, counted in cells
+#define ATTR_CELLS (sizeof(cell_attr) / sizeof(cell))
+
+#define BETWEEN(x, a, b) ((a) <= (x) && (x) <= (b))
+#define CLAMP(x, a, b) ((x) < (a) ? (a) : (x) > (b) ? (b) : (x))
+
+static
+uint64_t attr_key(const cell_attr *a)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    h = (h ^ a->fg) * 0x100000001b3ULL;
+    h = (h ^ a->bg) * 0x100000001b3ULL;
+    h = (h ^ a->underline) * 0x100000001b3ULL;
+    h = (h ^ a->link) * 0x100000001b3ULL;
+    return (h ^ a->flags) * 0x100000001b3ULL;
+}
+
+// Ids can be recycled, so rows hash what their attributes are rather than their ids
+static
+uint64_t row_hash(const attr_table *t, const cell *cells, int n)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (int i = 0; i < n; i++) {
+        h = (h ^ cells[i].codepoint) * 0x100000001b3ULL;
+        if (cells[i].attr != 0) h = (h ^ t->keys[cells[i].attr]) * 0x100000001b3ULL;
+    }
+
+    // 0 is reserved for "never drawn" on the renderer side
+    return h ? h : 1;
+}
+
+static
+void row_clear(grid_row *row, int from, int to)
+{
+    if (from >= to) return;
+
+    memset(row->cells + from, 0, (to - from) * sizeof(cell));
+    row->dirty = true;
+}
+
+static
+bool grid_init(screen_grid *g, int cols, int rows)
+{
+    g->rows = counted_calloc(rows, sizeof *g->rows);
+    if (g->rows == NULL) return false;
+
+    for (int y = 0; y < rows; y++) {
+        g->rows[y].cells = counted_calloc(cols, sizeof(cell));
+        g->rows[y].dirty = true;
+
+        if (g->rows[y].cells == NULL) return false;
+    }
+
+    return true;
+}
+
+static
+bool attr_equal(const cell_attr *a, const cell_attr *b)
+{
+    return a->fg == b->fg && a->bg == b->bg && a->underline == b->underline && a->flags == b->flags
+        && a->link == b->link;
+}
+
+static
+void attr_index_insert(attr_table *t, int id)
+{
+    size_t mask = length_of(t->index) - 1;
+    size_t i = t->keys[id] & mask;
+
+    while (t->index[i] != 0) i = (i + 1) & mask;
+    t->index[i] = id;
+}
+
+// Id of `a` in the table, 0 when it has none
+static
+int attr_find(const attr_table *t, const cell_attr *a, uint64_t key)
+{
+    size_t mask = length_of(t->index) - 1;
+
+    for (size_t i = key & mask; t->index[i] != 0; i = (i + 1) & mask) {
+        int id = t->index[i];
+
+        if (t->keys[id] == key && attr_equal(&t->attrs[id], a)) return id;
+    }
+    return 0;
+}
+
+static
+void mark_cells(uint8_t *live, const cell *cells, int n)
+{
+    for (int i = 0; i < n; i++) live[cells[i].attr] = 1;
+}
+
+/*
+ * Marks the ids some cell on screen or the pen still refers to. History
+ * has its own attributes, only the lines scrolled into view were given
+ * ids again to be drawn.
+ */
+static
+void attr_mark(const screen *scr, uint8_t *live)
+{
+    for (int y = 0; y < scr->rows; y++) {
+        mark_cells(live, scr->primary.rows[y].cells, scr->cols);
+        mark_cells(live, scr->alternate.rows[y].cells, scr->cols);
+    }
+    size_t in_view = (scr->view_offset < scr->history_count) ? scr->view_offset : scr->history_count;
+
+    for (size_t i = scr->history_count - in_view; i < scr->history_count; i++) {
+        const scrollback_line *l = &scr->history[(scr->history_head + i) % scr->history_cap];
+
+        for (int a = 0; a < l->nattrs; a++) live[attr_find(&scr->attrs, &l->attrs[a], attr_key(&l->attrs[a]))] = 1;
+    }
+    if (scr->pen_id > 0) live[scr->pen_id] = 1;
+}
+
+// Frees every id no cell refers to anymore, then rebuilds the index from the live ones
+static
+void attr_collect(screen *scr)
+{
+    attr_table *t = &scr->attrs;
+    uint8_t live[CELL_ATTR_CAP] = { 0 };
+
+    attr_mark(scr, live);
+    memset(t->index, 0, sizeof t->index);
+    t->nfree = 0;
+    t->collected_at = scr->cells_written;
+
+    // pushed from the top so the lowest ids are handed out again first
+    for (int id = t->used - 1; id > 0; id--) {
+        if (live[id]) attr_index_insert(t, id);
+        else t->free_ids[t->nfree++] = id;
+    }
+    pretty_log(PRETTY_DEBUG, "attributes collected, %d ids freed", t->nfree);
+}
+
+// Id standing for `a` in cells, 0 (the default look) once every id is on screen
+static
+int attr_intern(screen *scr, const cell_attr *a)
+{
+    attr_table *t = &scr->attrs;
+    uint64_t key = attr_key(a);
+    int id;
+
+    if (attr_equal(a, &(cell_attr){ 0 })) return 0;
+    if ((id = attr_find(t, a, key)) != 0) return id;
+
+    if (t->used < CELL_ATTR_CAP) id = t->used++;
+    else {
+        // nothing freed an id until at least a line was written over or scrolled away
+        if (t->nfree == 0 && scr->cells_written - t->collected_at >= (uint64_t)scr->cols) attr_collect(scr);
+        if (t->nfree == 0) return 0;
+        id = t->free_ids[--t->nfree];
+    }
+
+    t->attrs[id] = *a;
+    t->keys[id] = key;
+    t->generation++;
+    attr_index_insert(t, id);
+    return id;
+}
+
+static
+void link_index_insert(link_table *t, int id)
+{
+    size_t mask = 2 * (size_t)t->cap - 1;
+    size_t i = t->keys[id] & mask;
+
+    while (t->index[i] != 0) i = (i + 1) & mask;
+    t->index[i] = id;
+}
+
+// Id of the link to `uri` with `key`, 0 when there is none
+static
+int link_find(const link_table *t, const char *uri, uint64_t key)
+{
+    size_t mask = 2 * (size_t)t->cap - 1;
+
+    if (t->cap == 0) return 0;
+
+    for (size_t i = key & mask; t->index[i] != 0; i = (i + 1) & mask) {
+        int id = t->index[i];
+
+        if (t->keys[id] == key && strcmp(t->uris[id], uri) == 0) return id;
+    }
+    return 0;
+}
+
+static
+bool link_grow(link_table *t)
+{
+    int cap = (t->cap > 0) ? t->cap * 2 : SCREEN_LINKS_MIN;
+
+    if (cap > SCREEN_LINKS_MAX) return false;
+
+    char **uris = counted_realloc(t->uris, cap * sizeof *uris);
+    if (uris != NULL) t->uris = uris;
+    uint64_t *keys = counted_realloc(t->keys, cap * sizeof *keys);
+    if (keys != NULL) t->keys = keys;
+    uint64_t *seen = counted_realloc(t->seen, cap * sizeof *seen);
+    if (seen != NULL) t->seen = seen;
+    uint16_t *free_ids = counted_realloc(t->free_ids, cap * sizeof *free_ids);
+    if (free_ids != NULL) t->free_ids = free_ids;
+    uint16_t *index = counted_calloc(2 * (size_t)cap, sizeof *index);
+
+    if (uris == NULL || keys == NULL || seen == NULL || free_ids == NULL || index == NULL) {
+        counted_free(index);
+        return false;
+    }
+
+    counted_free(t->index);
+    t->index = index;
+    t->cap = cap;
+    for (int id = 1; id < t->used; id++)
+        if (t->uris[id] != NULL) link_index_insert(t, id);
+    return true;
+}
+
+typedef struct {
+    uint64_t seen;
+    uint16_t id;
+} link_age;
+
+static
+int link_age_cmp(const void *a, const void *b)
+{
+    const link_age *x = a, *y = b;
+
+    return (x->seen > y->seen) - (x->seen < y->seen);
+}
+
+/*
+ * Drops the oldest of the links only history shows until a quarter of
+ * the ids are free, the lines that had them keep their text and colours.
+ */
+static
+void link_evict(screen *scr, const uint8_t *state)
+{
+    link_table *t = &scr->links;
+    link_age *ages = counted_malloc(t->used * sizeof *ages);
+    int n = 0;
+
+    if (ages == NULL) return;
+
+    for (int id = 1; id < t->used; id++)
+        if (state[id] == 1) ages[n++] = (link_age){ t->seen[id], (uint16_t)id };
+    qsort(ages, n, sizeof *ages, link_age_cmp);
+
+    for (int i = 0; i < n && t->nfree < t->cap / 4; i++) {
+        counted_free(t->uris[ages[i].id]);
+        t->uris[ages[i].id] = NULL;
+        t->free_ids[t->nfree++] = ages[i].id;
+    }
+    counted_free(ages);
+
+    for (size_t i = 0; i < scr->history_count; i++) {
+        scrollback_line *l = &scr->history[(scr->history_head + i) % scr->history_cap];
+
+        for (int a = 0; a < l->nattrs; a++) {
+            if (l->attrs[a].link == 0 || t->uris[l->attrs[a].link] != NULL) continue;
+
+            l->attrs[a].link = 0;
+            l->hash = 0;
+        }
+    }
+    if (scr->hover.link != 0 && t->uris[scr->hover.link] == NULL) scr->hover = (link_hover){ 0 };
+}
+
+// Frees the links no cell refers to anymore, and the oldest in history when that is not enough
+static
+void link_collect(screen *scr)
+{
+    link_table *t = &scr->links;
+    uint8_t live[CELL_ATTR_CAP] = { 0 };
+    uint8_t *state = (t->cap > 0) ? counted_calloc(t->cap, 1) : NULL; // 1 in history, 2 on screen
+
+    if (state == NULL) return;
+
+    attr_mark(scr, live);
+    for (size_t i = 0; i < scr->history_count; i++) {
+        const scrollback_line *l = &scr->history[(scr->history_head + i) % scr->history_cap];
+
+        for (int a = 0; a < l->nattrs; a++) state[l->attrs[a].link] = 1;
+    }
+    for (int i = 1; i < scr->attrs.used; i++)
+        if (live[i]) state[scr->attrs.attrs[i].link] = 2;
+    state[scr->pen.link] = state[scr->primary.saved_pen.link] = state[scr->alternate.saved_pen.link] = 2;
+
+    // pushed from the top so the lowest ids are handed out again first
+    t->nfree = 0;
+    for (int id = t->used - 1; id > 0; id--) {
+        if (state[id] != 0) continue;
+
+        counted_free(t->uris[id]);
+        t->uris[id] = NULL;
+        t->free_ids[t->nfree++] = id;
+    }
+    int freed = t->nfree;
+
+    if (t->nfree < t->cap / 4) link_evict(scr, state);
+    counted_free(state);
+
+    memset(t->index, 0, 2 * (size_t)t->cap * sizeof *t->index);
+    for (int id = 1; id < t->used; id++)
+        if (t->uris[id] != NULL) link_index_insert(t, id);
+    pretty_log(PRETTY_DEBUG, "links collected, %d ids freed and %d dropped from history", freed, t->nfree - freed);
+}
+
+// Only the id parameter tells apart two links to the same uri, the others are ignored
+static
+uint64_t link_key(const char *params, const char *params_end, const char *uri)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for (const char *p = params, *next; p < params_end; p = next + 1) {
+        next = memchr(p, ':', params_end - p);
+        if (next == NULL) next = params_end;
+
+        if (next - p > 3 && strncmp(p, "id=", 3) == 0)
+            for (const char *c = p + 3; c < next; c++) h = (h ^ (unsigned char)*c) * 0x100000001b3ULL;
+    }
+
+    h = (h ^ ';') * 0x100000001b3ULL;
+    for (const char *c = uri; *c != '\0'; c++) h = (h ^ (unsigned char)*c) * 0x100000001b3ULL;
+    return h;
+}
+
+// Id of the link to `uri`, 0 (no link) only when the screen alone shows SCREEN_LINKS_MAX of them
+static
+int link_intern(screen *scr, const char *params, const char *params_end, const char *uri)
+{
+    link_table *t = &scr->links;
+    uint64_t key = link_key(params, params_end, uri);
+    int id = link_find(t, uri, key);
+
+    if (id == 0) {
+        if (t->used >= t->cap && t->nfree == 0 && !link_grow(t)) link_collect(scr);
+
+        if (t->used < t->cap) id = t->used++;
+        else if (t->nfree > 0) id = t->free_ids[--t->nfree];
+        else return 0;
+
+        size_t size = strlen(uri) + 1;
+
+        t->uris[id] = counted_malloc(size);
+        if (t->uris[id] == NULL) {
+            t->free_ids[t->nfree++] = id;
+            return 0;
+        }
+
+        memcpy(t->uris[id], uri, size);
+        t->keys[id] = key;
+        link_index_insert(t, id);
+    }
+    t->seen[id] = scr->history_pushed;
+    return id;
+}
+
+static
+int pen_attr(screen *scr)
+{
+    if (scr->pen_id < 0) scr->pen_id = attr_intern(scr, &scr->pen);
+    return scr->pen_id;
+}
+
+static
+void grid_destroy(screen_grid *g, int rows)
+{
+    if (g->rows == NULL) return;
+
+    for (int y = 0; y < rows; y++) counted_free(g->rows[y].cells);
+    counted_free(g->rows);
+}
+
+bool screen_init(screen *scr, int cols, int rows, size_t history_cap)
+{
+    *scr = (screen){
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .snapshot_lock = PTHREAD_MUTEX_INITIALIZER,
+        .cols = cols,
+        .rows = rows,
+        .mode = MODE_WRAP | MODE_UTF8,
+        .scroll_bottom = rows - 1,
+        .history_cap = history_cap,
+        .snap_front = 0,
+        .snap_ready = 1,
+        .snap_back = 2,
+    };
+
+    // id 0 is the default look and never goes through the table
+    scr->attrs.used = scr->links.used = 1;
+    scr->active = &scr->primary;
+    scr->history = counted_calloc(history_cap, sizeof *scr->history);
+    pool_init(&scr->history_pages, SCROLLBACK_PAGE_SIZE, SCROLLBACK_PAGES_PER_BLOCK);
+
+    return scr->history != NULL
+        && grid_init(&scr->primary, cols, rows)
+        && grid_init(&scr->alternate, cols, rows);
+}
+
+void screen_destroy(screen *scr)
+{
+    grid_destroy(&scr->primary, scr->rows);
+    grid_destroy(&scr->alternate, scr->rows);
+
+    // only lines wider than a page own their cells
+    for (size_t i = 0; i < scr->history_count; i++) {
+        scrollback_line *l = &scr->history[(scr->history_head + i) % scr->history_cap];
+
+        if (l->page == NULL) counted_free(l->cells);
+    }
+    counted_free(scr->history);
+    pool_destroy(&scr->history_pages);
+    prompt_index_free(&scr->prompts);
+
+    for (int i = 1; i < scr->links.used; i++) counted_free(scr->links.uris[i]);
+    counted_free(scr->links.uris);
+    counted_free(scr->links.keys);
+    counted_free(scr->links.seen);
+    counted_free(scr->links.index);
+    counted_free(scr->links.free_ids);
+
+    for (int i = 0; i < SNAPSHOT_COUNT; i++) {
+        counted_free(scr->snapshots[i].cells);
+        counted_free(scr->snapshots[i].row_hash);
+        counted_free(scr->snapshots[i].text_hash);
+    }
+}
+
+static
+void history_release(screen *scr, scrollback_line *l)
+{
+    scrollback_page *page = l->page;
+
+    if (page == NULL) counted_free(l->cells);
+    else if (--page->live == 0 && page != scr->history_page) pool_put(&scr->history_pages, page);
+
+    *l = (scrollback_line){ 0 };
+}
+
+// Lines are evicted in the order they were pushed, so pages empty out front to back
+static
+cell *history_alloc(screen *scr, int len, scrollback_page **owner)
+{
+    scrollback_page *page = scr->history_page;
+
+    *owner = NULL;
+    if (len == 0) return NULL;
+    if ((size_t)len > PAGE_CELLS) return counted_malloc(len * sizeof(cell));
+
+    if (page == NULL || page->used + len > PAGE_CELLS) {
+        if (page != NULL && page->live == 0) pool_put(&scr->history_pages, page);
+
+        page = scr->history_page = pool_get(&scr->history_pages);
+        if (page == NULL) return NULL;
+
+        page->used = page->live = 0;
+    }
+
+    cell *cells = page->cells + page->used;
+    page->used += len;
+    page->live++;
+    *owner = page;
+    return cells;
+}
+
+static
+void history_push(screen *scr, const cell *row)
+{
+    size_t slot;
+
+    // lines are numbered even without a scrollback, marks on screen follow them
+    scr->history_pushed++;
+    if (scr->history_cap == 0) return;
+
+    if (scr->history_count == scr->history_cap) {
+        slot = scr->history_head;
+        history_release(scr, &scr->history[slot]);
+        scr->history_head = (scr->history_head + 1) % scr->history_cap;
+        prompt_index_trim(&scr->prompts, scr->history_pushed - scr->history_count);
+    } else slot = (scr->history_head + scr->history_count++) % scr->history_cap;
+
+    // trailing blanks are dropped unless they carry a colour
+    int len = scr->cols;
+    while (len > 0 && row[len - 1].codepoint == 0 && row[len - 1].attr == 0) len--;
+
+    // the line gets a table of the attributes it uses, renumbered from 1
+    attr_table *t = &scr->attrs;
+    uint16_t ids[CELL_ATTR_CAP];
+    int nattrs = 0;
+
+    for (int x = 0; x < len; x++) {
+        int id = row[x].attr;
+
+        if (id == 0 || t->line_stamp[id] == scr->history_pushed) continue;
+
+        t->line_stamp[id] = scr->history_pushed;
+        t->line_id[id] = (nattrs < CELL_ATTR_CAP - 1) ? nattrs + 1 : 0;
+        if (t->line_id[id] != 0) ids[nattrs++] = id;
+    }
+
+    scrollback_line *l = &scr->history[slot];
+    l->len = len;
+    l->nattrs = nattrs;
+    l->cells = history_alloc(scr, len + nattrs * ATTR_CELLS, &l->page);
+    l->attrs = (l->cells != NULL) ? (cell_attr *)(l->cells + len) : NULL;
+
+    if (l->cells == NULL) l->len = l->nattrs = 0;
+
+    for (int x = 0; x < l->len; x++)
+        l->cells[x] = (cell){ .codepoint = row[x].codepoint, .attr = (row[x].attr != 0) ? t->line_id[row[x].attr] : 0 };
+    for (int a = 0; a < l->nattrs; a++) l->attrs[a] = t->attrs[ids[a]];
+
+    // hashed lazily, at the width the line ends up displayed with
+    l->hash = 0;
+
+    // keep the viewport anchored on the same lines while output scrolls
+    if (scr->view_offset > 0 && scr->view_offset < scr->history_count)
+        scr->view_offset++;
+}
+
+static
+void scroll_up(screen *scr, int top, int n, bool save)
+{
+    grid_row *rows = scr->active->rows;
+    int bottom = scr->scroll_bottom;
+
+    n = CLAMP(n, 0, bottom - top + 1);
+    if (top == 0 && bottom == scr->rows - 1) scr->scrolled += n;
+    scr->cells_written += (uint64_t)n * scr->cols;
+
+    // the alternate screen never feeds the scrollback
+    if (save && top == 0 && scr->active == &scr->primary)
+        for (int i = 0; i < n; i++) history_push(scr, rows[i].cells);
+
+    // rotate row structs so scrolled rows keep their cached hash
+    for (int i = 0; i < n; i++) {
+        grid_row tmp = rows[top];
+
+        memmove(rows + top, rows + top + 1, (bottom - top) * sizeof *rows);
+        rows[bottom] = tmp;
+        row_clear(&rows[bottom], 0, scr->cols);
+    }
+}
+
+static
+void scroll_down(screen *scr, int top, int n)
+{
+    grid_row *rows = scr->active->rows;
+    int bottom = scr->scroll_bottom;
+
+    n = CLAMP(n, 0, bottom - top + 1);
+    if (top == 0 && bottom == scr->rows - 1) scr->scrolled -= n;
+    scr->cells_written += (uint64_t)n * scr->cols;
+
+    for (int i = 0; i < n; i++) {
+        grid_row tmp = rows[bottom];
+
+        memmove(rows + top + 1, rows + top, (bottom - top) * sizeof *rows);
+        rows[top] = tmp;
+        row_clear(&rows[top], 0, scr->cols);
+    }
+}
+
+static
+void line_feed(screen *scr)
+{
+    if (scr->cursor_y == scr->scroll_bottom) scroll_up(scr, scr->scroll_top, 1, true);
+    else if (scr->cursor_y < scr->rows - 1) scr->cursor_y++;
+}
+
+static
+void reverse_line_feed(screen *scr)
+{
+    if (scr->cursor_y == scr->scroll_top) scroll_down(scr, scr->scroll_top, 1);
+    else if (scr->cursor_y > 0) scr->cursor_y--;
+}
+
+static
+void move_to(screen *scr, int x, int y)
+{
+    scr->cursor_x = CLAMP(x, 0, scr->cols - 1);
+    scr->cursor_y = CLAMP(y, 0, scr->rows - 1);
+    scr->wrap_next = false;
+}
+
+static
+void clear_region(screen *scr, int x1, int y1, int x2, int y2)
+{
+    for (int y = y1; y <= y2; y++)
+        row_clear(&scr->active->rows[y], x1, x2 + 1);
+}
+
+// Overwriting either half of a wide character blanks the other one
+static
+void split_wide(grid_row *row, int x, int width, int cols)
+{
+    if (row->cells[x].codepoint == CELL_WIDE_SPACER && x > 0) row->cells[x - 1].codepoint = 0;
+    if (x + width < cols && row->cells[x + width].codepoint == CELL_WIDE_SPACER)
+        row->cells[x + width].codepoint = 0;
+}
+
+// VS16 asks for the emoji presentation of a pictograph, which takes two cells
+static
+void cluster_widen(screen *scr, grid_row *row, int x)
+{
+    uint32_t cps[CLUSTER_LEN_MAX];
+
+    cluster_codepoints(row->cells[x].codepoint, cps);
+
+    // only a narrow pictograph right before the cursor, one in the last column stays narrow
+    if (unicode_width(cps[0]) != 1 || !unicode_extended_pictographic(cps[0])
+        || x + 1 >= scr->cols || scr->cursor_y != scr->cluster_y || scr->cursor_x != x + 1 || scr->wrap_next)
+        return;
+
+    split_wide(row, x + 1, 1, scr->cols);
+    row->cells[x + 1] = (cell){ .codepoint = CELL_WIDE_SPACER, .attr = row->cells[x].attr };
+
+    if (x + 2 >= scr->cols) scr->wrap_next = true;
+    else scr->cursor_x = x + 2;
+}
+
+// Codepoints continuing a grapheme cluster join the cell it started in
+static
+void cluster_continue(screen *scr, uint32_t cp)
+{
+    // controls end a cluster, so the cursor can't have moved since it started
+    if (!scr->cluster_open || scr->cluster_y >= scr->rows || scr->cluster_x >= scr->cols) return;
+
+    grid_row *row = &scr->active->rows[scr->cluster_y];
+
+    row->cells[scr->cluster_x].codepoint = cluster_append(row->cells[scr->cluster_x].codepoint, cp);
+    row->dirty = true;
+
+    if (cp == 0xFE0F) cluster_widen(scr, row, scr->cluster_x);
+}
+
+static
+void put_codepoint(screen *scr, uint32_t cp)
+{
+    int width = unicode_width(cp);
+
+    if (!grapheme_break(&scr->grapheme, cp)) {
+        cluster_continue(scr, cp);
+        return;
+    }
+
+    // a mark with nothing to combine with is dropped, and so is what follows it
+    scr->cluster_open = width > 0;
+    if (width == 0) return;
+    if (width > scr->cols) width = 1;
+
+    // a wide character never straddles two lines
+    if (width == 2 && scr->cursor_x == scr->cols - 1 && !scr->wrap_next) {
+        grid_row *row = &scr->active->rows[scr->cursor_y];
+
+        row->cells[scr->cursor_x].codepoint = 0;
+        row->dirty = true;
+        scr->wrap_next = true;
+    }
+
+    if (scr->wrap_next && (scr->mode & MODE_WRAP)) {
+        scr->cursor_x = 0;
+        line_feed(scr);
+    }
+    scr->wrap_next = false;
+
+    grid_row *row = &scr->active->rows[scr->cursor_y];
+    if (width == 2 && scr->cursor_x == scr->cols - 1) scr->cursor_x--;
+
+    if (scr->mode & MODE_INSERT)
+        memmove(row->cells + scr->cursor_x + width, row->cells + scr->cursor_x,
+            (scr->cols - scr->cursor_x - width) * sizeof(cell));
+    else split_wide(row, scr->cursor_x, width, scr->cols);
+
+    int attr = pen_attr(scr);
+
+    row->cells[scr->cursor_x] = (cell){ .codepoint = cp, .attr = attr };
+    if (width == 2) row->cells[scr->cursor_x + 1] = (cell){ .codepoint = CELL_WIDE_SPACER, .attr = attr };
+    row->dirty = true;
+    scr->cells_written += width;
+    scr->cluster_x = scr->cursor_x;
+    scr->cluster_y = scr->cursor_y;
+
+    if (scr->cursor_x + width >= scr->cols) {
+        scr->cursor_x = scr->cols - 1;
+        scr->wrap_next = true;
+    } else scr->cursor_x += width;
+}
+
+static
+void cursor_save(screen *scr)
+{
+    scr->active->saved_x = scr->cursor_x;
+    scr->active->saved_y = scr->cursor_y;
+    scr->active->saved_pen = scr->pen;
+}
+
+static
+void cursor_restore(screen *scr)
+{
+    move_to(scr, scr->active->saved_x, scr->active->saved_y);
+    scr->pen = scr->active->saved_pen;
+    scr->pen_id = -1;
+}
+
+static
+void switch_screen(screen *scr, bool alt)
+{
+    if (alt == !!(scr->mode & MODE_ALTSCREEN)) return;
+
+    scr->mode ^= MODE_ALTSCREEN;
+    scr->active = alt ? &scr->alternate : &scr->primary;
+    scr->view_offset = 0;
+    scr->sel.active = false;
+    scr->hover = (link_hover){ 0 };
+}
+
+static
+void set_private_mode(screen *scr, int mode, bool set)
+{
+    switch (mode) {
+        case 7:
+            scr->mode = set ? (scr->mode | MODE_WRAP) : (scr->mode & ~MODE_WRAP);
+            break;
+        case 25:
+            scr->mode = set ? (scr->mode & ~MODE_HIDE) : (scr->mode | MODE_HIDE);
+            break;
+        case 1049:
+            if (set) {
+                cursor_save(scr);
+                switch_screen(scr, true);
+                clear_region(scr, 0, 0, scr->cols - 1, scr->rows - 1);
+            } else {
+                switch_screen(scr, false);
+                cursor_restore(scr);
+            }
+            break;
+        case 1047:
+            if (!set && (scr->mode & MODE_ALTSCREEN))
+                clear_region(scr, 0, 0, scr->cols - 1, scr->rows - 1);
+            /* fallthrough */
+        case 47:
+            switch_screen(scr, set);
+            break;
+        case 2026:
+            if (set && !(scr->mode & MODE_SYNC)) scr->sync_start = trace_now_ns();
+            scr->mode = set ? (scr->mode | MODE_SYNC) : (scr->mode & ~MODE_SYNC);
+            break;
+        default:
+            pretty_log(PRETTY_DEBUG, "unhandled private mode %d", mode);
+            break;
+    }
+}
+
+static
+int private_mode_status(const screen *scr, int mode)
+{
+    unsigned int flag;
+
+    switch (mode) {
+        case 7:
+            flag = MODE_WRAP;
+            break;
+        case 25:
+            return (scr->mode & MODE_HIDE) ? 2 : 1;
+        case 47:
+        case 1047:
+        case 1049:
+            flag = MODE_ALTSCREEN;
+            break;
+        case 2026:
+            flag = MODE_SYNC;
+            break;
+        default:
+            return 0;
+    }
+    return (scr->mode & flag) ? 1 : 2;
+}
+
+static __attribute__((format(printf, 2, 3)))
+void reply(screen *scr, const char *fmt, ...)
+{
+    va_list ap;
+    size_t room = sizeof scr->reply - scr->reply_len;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(scr->reply + scr->reply_len, room, fmt, ap);
+    va_end(ap);
+
+    if (n > 0 && (size_t)n < room) scr->reply_len += n;
+}
+
+static
+void set_mode(screen *scr, bool set)
+{
+    for (int i = 0; i < scr->nparams; i++) {
+        if (scr->csi_private == '?') set_private_mode(scr, scr->params[i], set);
+        else if (scr->params[i] == 4)
+            scr->mode = set ? (scr->mode | MODE_INSERT) : (scr->mode & ~MODE_INSERT);
+    }
+}
+
+static
+int param(const screen *scr, int i, int def)
+{
+    return (i < scr->nparams && scr->params[i] != 0) ? scr->params[i] : def;
+}
+
+static
+bool param_is_sub(const screen *scr, int i)
+{
+    return i < scr->nparams && (scr->param_colon >> i & 1);
+}
+
+// Colour of a 38, 48 or 58 at params[*i], from either the ';' or the ':' form
+static
+bool sgr_color(screen *scr, int *i, uint32_t *color)
+{
+    const int *p = scr->params;
+    int at = *i + 1;
+    int subs = 0;
+
+    while (param_is_sub(scr, at + subs)) subs++;
+
+    // 38:2:r:g:b, or 38:2:id:r:g:b with a colour space id
+    if (subs > 0) {
+        int rgb = (subs >= 5) ? at + 2 : at + 1;
+
+        *i += subs;
+        if (p[at] == 5 && subs >= 2) *color = ATTR_COLOR_INDEXED | CLAMP(p[at + 1], 0, 255);
+        else if (p[at] == 2 && subs >= 4)
+            *color = ATTR_COLOR_RGB | CLAMP(p[rgb], 0, 255) << 16
+                | CLAMP(p[rgb + 1], 0, 255) << 8 | CLAMP(p[rgb + 2], 0, 255);
+        else return false;
+        return true;
+    }
+
+    if (at + 1 < scr->nparams && p[at] == 5) {
+        *color = ATTR_COLOR_INDEXED | CLAMP(p[at + 1], 0, 255);
+        *i += 2;
+        return true;
+    }
+    if (at + 3 < scr->nparams && p[at] == 2) {
+        *color = ATTR_COLOR_RGB | CLAMP(p[at + 1], 0, 255) << 16
+            | CLAMP(p[at + 2], 0, 255) << 8 | CLAMP(p[at + 3], 0, 255);
+        *i += 4;
+        return true;
+    }
+
+    // the rest can't be told apart from more attributes, it is dropped
+    *i = scr->nparams;
+    return false;
+}
+
+static
+void set_underline(cell_attr *pen, int style)
+{
+    pen->flags &= ~(7 << ATTR_UNDERLINE_SHIFT);
+    pen->flags |= style << ATTR_UNDERLINE_SHIFT;
+}
+
+static
+void select_graphic_rendition(screen *scr)
+{
+    cell_attr *pen = &scr->pen;
+
+    for (int i = 0; i < scr->nparams; i++) {
+        int p = scr->params[i];
+
+        switch (p) {
+            // a link only ends with its own OSC 8
+            case 0:
+                *pen = (cell_attr){ .link = pen->link };
+                break;
+            case 1:
+                pen->flags |= ATTR_BOLD;
+                break;
+            case 2:
+                pen->flags |= ATTR_FAINT;
+                break;
+            case 3:
+                pen->flags |= ATTR_ITALIC;
+                break;
+            case 4:
+                // 4:0 to 4:5 pick the style, plain 4 is a single line
+                if (param_is_sub(scr, i + 1)) {
+                    i++;
+                    set_underline(pen, BETWEEN(scr->params[i], 0, UNDERLINE_DASHED) ? scr->params[i] : 1);
+                } else set_underline(pen, UNDERLINE_SINGLE);
+                break;
+            case 7:
+                pen->flags |= ATTR_INVERSE;
+                break;
+            case 8:
+                pen->flags |= ATTR_HIDDEN;
+                break;
+            case 9:
+                pen->flags |= ATTR_STRIKE;
+                break;
+            case 21:
+                set_underline(pen, UNDERLINE_DOUBLE);
+                break;
+            case 22:
+                pen->flags &= ~(ATTR_BOLD | ATTR_FAINT);
+                break;
+            case 23:
+                pen->flags &= ~ATTR_ITALIC;
+                break;
+            case 24:
+                set_underline(pen, UNDERLINE_NONE);
+                break;
+            case 27:
+                pen->flags &= ~ATTR_INVERSE;
+                break;
+            case 28:
+                pen->flags &= ~ATTR_HIDDEN;
+                break;
+            case 29:
+                pen->flags &= ~ATTR_STRIKE;
+                break;
+            case 38:
+                sgr_color(scr, &i, &pen->fg);
+                break;
+            case 39:
+                pen->fg = ATTR_COLOR_DEFAULT;
+                break;
+            case 48:
+                sgr_color(scr, &i, &pen->bg);
+                break;
+            case 49:
+                pen->bg = ATTR_COLOR_DEFAULT;
+                break;
+            case 58:
+                sgr_color(scr, &i, &pen->underline);
+                break;
+            case 59:
+                pen->underline = ATTR_COLOR_DEFAULT;
+                break;
+            default:
+                if (BETWEEN(p, 30, 37)) pen->fg = ATTR_COLOR_INDEXED | (p - 30);
+                else if (BETWEEN(p, 40, 47)) pen->bg = ATTR_COLOR_INDEXED | (p - 40);
+                else if (BETWEEN(p, 90, 97)) pen->fg = ATTR_COLOR_INDEXED | (p - 90 + 8);
+                else if (BETWEEN(p, 100, 107)) pen->bg = ATTR_COLOR_INDEXED | (p - 100 + 8);
+                else pretty_log(PRETTY_DEBUG, "unhandled SGR %d", p);
+                break;
+        }
+    }
+    scr->pen_id = -1;
+}
+
+static
+void csi_dispatch(screen *scr, char final)
+{
+    grid_row *row = &scr->active->rows[scr->cursor_y];
+    int n = param(scr, 0, 1);
+
+    switch (final) {
+        case 'A':
+            move_to(scr, scr->cursor_x, scr->cursor_y - n);
+            break;
+        case 'B':
+        case 'e':
+            move_to(scr, scr->cursor_x, scr->cursor_y + n);
+            break;
+        case 'C':
+        case 'a':
+            move_to(scr, scr->cursor_x + n, scr->cursor_y);
+            break;
+        case 'D':
+            move_to(scr, scr->cursor_x - n, scr->cursor_y);
+            break;
+        case 'E':
+            move_to(scr, 0, scr->cursor_y + n);
+            break;
+        case 'F':
+            move_to(scr, 0, scr->cursor_y - n);
+            break;
+        case 'G':
+        case '`':
+            move_to(scr, n - 1, scr->cursor_y);
+            break;
+        case 'd':
+            move_to(scr, scr->cursor_x, n - 1);
+            break;
+        case 'H':
+        case 'f':
+            move_to(scr, param(scr, 1, 1) - 1, n - 1);
+            break;
+        case 'J':
+            switch (param(scr, 0, 0)) {
+                case 0:
+                    clear_region(scr, scr->cursor_x, scr->cursor_y, scr->cols - 1, scr->cursor_y);
+                    if (scr->cursor_y < scr->rows - 1)
+                        clear_region(scr, 0, scr->cursor_y + 1, scr->cols - 1, scr->rows - 1);
+                    break;
+                case 1:
+                    if (scr->cursor_y > 0)
+                        clear_region(scr, 0, 0, scr->cols - 1, scr->cursor_y - 1);
+                    clear_region(scr, 0, scr->cursor_y, scr->cursor_x, scr->cursor_y);
+                    break;
+                case 2:
+                case 3:
+                    clear_region(scr, 0, 0, scr->cols - 1, scr->rows - 1);
+                    break;
+            }
+            break;
+        case 'K':
+            switch (param(scr, 0, 0)) {
+                case 0:
+                    row_clear(row, scr->cursor_x, scr->cols);
+                    break;
+                case 1:
+                    row_clear(row, 0, scr->cursor_x + 1);
+                    break;
+                case 2:
+                    row_clear(row, 0, scr->cols);
+                    break;
+            }
+            break;
+        case 'L':
+        case 'M':
+            if (!BETWEEN(scr->cursor_y, scr->scroll_top, scr->scroll_bottom)) break;
+
+            if (final == 'L') scroll_down(scr, scr->cursor_y, n);
+            else scroll_up(scr, scr->cursor_y, n, false);
+            scr->cursor_x = 0;
+            break;
+        case 'S':
+            scroll_up(scr, scr->scroll_top, n, true);
+            break;
+        case 'T':
+            scroll_down(scr, scr->scroll_top, n);
+            break;
+        case 'P':
+            n = CLAMP(n, 0, scr->cols - scr->cursor_x);
+            memmove(row->cells + scr->cursor_x, row->cells + scr->cursor_x + n,
+                (scr->cols - scr->cursor_x - n) * sizeof(cell));
+            row_clear(row, scr->cols - n, scr->cols);
+            break;
+        case '@':
+            n = CLAMP(n, 0, scr->cols - scr->cursor_x);
+            memmove(row->cells + scr->cursor_x + n, row->cells + scr->cursor_x,
+                (scr->cols - scr->cursor_x - n) * sizeof(cell));
+            row_clear(row, scr->cursor_x, scr->cursor_x + n);
+            break;
+        case 'X':
+            row_clear(row, scr->cursor_x, CLAMP(scr->cursor_x + n, 0, scr->cols));
+            break;
+        case 'r': {
+            int top = param(scr, 0, 1) - 1;
+            int bottom = param(scr, 1, scr->rows) - 1;
+
+            if (top >= bottom || bottom >= scr->rows) break;
+
+            scr->scroll_top = top;
+            scr->scroll_bottom = bottom;
+            move_to(scr, 0, 0);
+            break;
+        }
+        case 's':
+            cursor_save(scr);
+            break;
+        case 'u':
+            cursor_restore(scr);
+            break;
+        case 'h':
+            set_mode(scr, true);
+            break;
+        case 'l':
+            set_mode(scr, false);
+            break;
+        case 'm':
+            // CSI > ... m sets xterm key modifiers, not attributes
+            if (scr->csi_private == '\0') select_graphic_rendition(scr);
+            break;
+        case 'n':
+            if (scr->csi_private != '\0') break;
+            if (param(scr, 0, 0) == 5) reply(scr, "\033[0n");
+            else if (param(scr, 0, 0) == 6)
+                reply(scr, "\033[%d;%dR", scr->cursor_y + 1, scr->cursor_x + 1);
+            break;
+        case 'p':
+            // DECRQM, lets applications probe for synchronized updates
+            if (scr->csi_intermediate == '$' && scr->csi_private == '?')
+                reply(scr, "\033[?%d;%d$y", scr->params[0],
+                    private_mode_status(scr, scr->params[0]));
+            break;
+        default:
+            pretty_log(PRETTY_DEBUG, "unhandled CSI %c%c",
+                scr->csi_private ? scr->csi_private : ' ', final);
+            break;
+    }
+}
+
+static
+void handle_control(screen *scr, unsigned char c)
+{
+    switch (c) {
+        case '\n':
+        case '\v':
+        case '\f':
+            line_feed(scr);
+            break;
+        case '\r':
+            scr->cursor_x = 0;
+            break;
+        case '\b':
+            if (scr->cursor_x > 0) scr->cursor_x--;
+            break;
+        case '\t':
+            scr->cursor_x = (scr->cursor_x + 8) & ~7;
+            if (scr->cursor_x >= scr->cols) scr->cursor_x = scr->cols - 1;
+            break;
+        case 0x1B:
+            scr->state = STATE_ESCAPE;
+            return;
+        case 0x18:
+        case 0x1A:
+            scr->state = STATE_GROUND;
+            return;
+        default:
+            return;
+    }
+    scr->wrap_next = false;
+}
+
+static
+void handle_escape(screen *scr, unsigned char c)
+{
+    scr->state = STATE_GROUND;
+
+    switch (c) {
+        case '[':
+            memset(scr->params, 0, sizeof scr->params);
+            scr->nparams = 1;
+            scr->param_colon = 0;
+            scr->csi_private = '\0';
+            scr->csi_intermediate = '\0';
+            scr->state = STATE_CSI;
+            break;
+        case ']':
+        case 'P':
+        case '_':
+        case '^':
+        case 'X':
+            scr->string_kind = c;
+            scr->osc_len = 0;
+            scr->state = STATE_STRING;
+            break;
+        case '7':
+            cursor_save(scr);
+            break;
+        case '8':
+            cursor_restore(scr);
+            break;
+        case 'D':
+            line_feed(scr);
+            break;
+        case 'E':
+            scr->cursor_x = 0;
+            line_feed(scr);
+            break;
+        case 'M':
+            reverse_line_feed(scr);
+            break;
+        case 'c':
+            switch_screen(scr, false);
+            scr->mode = MODE_WRAP | MODE_UTF8;
+            scr->scroll_top = 0;
+            scr->scroll_bottom = scr->rows - 1;
+            scr->pen = (cell_attr){ 0 };
+            scr->pen_id = -1;
+            clear_region(scr, 0, 0, scr->cols - 1, scr->rows - 1);
+            move_to(scr, 0, 0);
+            break;
+        case '(':
+        case ')':
+        case '#':
+        case '%':
+            // charset designations carry one more byte we don't act on
+            scr->state = STATE_STRING_ESC;
+            break;
+        default:
+            break;
+    }
+}
+
+static
+void handle_csi(screen *scr, unsigned char c)
+{
+    if (BETWEEN(c, '0', '9')) {
+        int *p = &scr->params[scr->nparams - 1];
+
+        if (*p < 65535) *p = *p * 10 + (c - '0');
+    } else if (c == ';' || c == ':') {
+        if (scr->nparams == CSI_MAX_PARAMS) return;
+
+        // sub-parameters, as in 38:2:r:g:b or 4:3
+        if (c == ':') scr->param_colon |= 1U << scr->nparams;
+        scr->nparams++;
+    } else if (BETWEEN(c, '<', '?')) scr->csi_private = c;
+    else if (BETWEEN(c, 0x20, 0x2F)) scr->csi_intermediate = c;
+    else if (BETWEEN(c, 0x40, 0x7E)) {
+        scr->state = STATE_GROUND;
+        csi_dispatch(scr, c);
+    } else if (c < 0x20) handle_control(scr, c);
+}
+
+// OSC 133 from shell integration, marks where prompts, commands and their output start
+static
+void shell_mark(screen *scr, const char *arg)
+{
+    static const char kinds[] = "ABCD";
+    const char *kind = (arg[0] != '\0') ? strchr(kinds, arg[0]) : NULL;
+
+    // full screen programs draw over the shell, their marks mean nothing
+    if (kind == NULL || scr->active != &scr->primary) return;
+
+    prompt_mark mark = {
+        .line = scr->history_pushed + scr->cursor_y,
+        .col = scr->cursor_x,
+        .status = -1,
+    };
+
+    if (*kind == 'D' && arg[1] == ';') mark.status = atoi(arg + 2);
+    prompt_index_add(&scr->prompts, kind - kinds, mark);
+}
+
+// OSC 8 from programs printing links, "<params>;<uri>" where an empty uri ends the link
+static
+void hyperlink(screen *scr, const char *arg)
+{
+    const char *uri = strchr(arg, ';');
+
+    if (uri == NULL) return;
+
+    uint16_t link = (uri[1] != '\0') ? link_intern(scr, arg, uri, uri + 1) : 0;
+
+    if (link != scr->pen.link) {
+        scr->pen.link = link;
+        scr->pen_id = -1;
+    }
+}
+
+// Acts on the OSC just terminated, its payload is "<number>;<arguments>"
+static
+void osc_dispatch(screen *scr)
+{
+    if (scr->osc_len > SCREEN_OSC_CAP) return;
+
+    char *arg;
+
+    scr->osc[scr->osc_len] = '\0';
+    long command = strtol(scr->osc, &arg, 10);
+
+    if (*arg == ';') arg++;
+
+    switch (command) {
+        case 8:
+            hyperlink(scr, arg);
+            break;
+        case 133:
+            shell_mark(scr, arg);
+            break;
+        default:
+            break;
+    }
+}
+
+static
+void string_end(screen *scr)
+{
+    if (scr->string_kind == ']') osc_dispatch(scr);
+
+    scr->string_kind = '\0';
+    scr->state = STATE_GROUND;
+}
+
+// tmux -CC opens a DCS with "1000p" and sends its notifications inside it
+static
+void dcs_byte(screen *scr, unsigned char c)
+{
+    static const char control[] = "1000p";
+
+    if (scr->osc_len >= sizeof(control) - 1) return;
+
+    scr->osc[scr->osc_len++] = c;
+    if (scr->osc_len == sizeof(control) - 1 && memcmp(scr->osc, control, scr->osc_len) == 0) {
+        scr->control_mode = true;
+        scr->string_kind = '\0';
+        scr->state = STATE_GROUND;
+    }
+}
+
+static
+void feed_byte(screen *scr, unsigned char c)
+{
+    switch (scr->state) {
+        case STATE_ESCAPE:
+            handle_escape(scr, c);
+            return;
+        case STATE_CSI:
+            handle_csi(scr, c);
+            return;
+        case STATE_STRING:
+            if (c == 0x07) string_end(scr);
+            else if (c == 0x1B) scr->state = STATE_STRING_ESC;
+            else if (scr->string_kind == 'P') dcs_byte(scr, c);
+            // one past the cap marks the payload as too long
+            else if (scr->string_kind == ']' && scr->osc_len <= SCREEN_OSC_CAP) {
+                if (scr->osc_len < SCREEN_OSC_CAP) scr->osc[scr->osc_len] = c;
+                scr->osc_len++;
+            }
+            return;
+        case STATE_STRING_ESC:
+            // ST is ESC '\', anything else just ends the sequence
+            string_end(scr);
+            return;
+        case STATE_GROUND:
+            break;
+    }
+
+    if (scr->utf8_left > 0) {
+        if ((c & 0xC0) == 0x80) {
+            scr->utf8_cp = (scr->utf8_cp << 6) | (c & 0x3F);
+            if (--scr->utf8_left == 0) put_codepoint(scr, scr->utf8_cp);
+            return;
+        }
+        // truncated sequence, emit a replacement and reprocess the byte
+        scr->utf8_left = 0;
+        put_codepoint(scr, 0xFFFD);
+    }
+
+    if (c < 0x20 || c == 0x7F) {
+        // controls and escape sequences end the cluster being printed
+        scr->grapheme = (grapheme_state){ 0 };
+        handle_control(scr, c);
+    } else if (c < 0x80) put_codepoint(scr, c);
+    else if ((c & 0xE0) == 0xC0) (scr->utf8_cp = c & 0x1F, scr->utf8_left = 1);
+    else if ((c & 0xF0) == 0xE0) (scr->utf8_cp = c & 0x0F, scr->utf8_left = 2);
+    else if ((c & 0xF8) == 0xF0) (scr->utf8_cp = c & 0x07, scr->utf8_left = 3);
+    else put_codepoint(scr, 0xFFFD);
+}
+
+// Parses at most SCREEN_FEED_SLICE bytes of `buf`, returns how many were used
+size_t screen_feed(screen *scr, const char *buf, size_t n)
+{
+    size_t i = 0;
+
+    if (n > SCREEN_FEED_SLICE) n = SCREEN_FEED_SLICE;
+
+    pthread_mutex_lock(&scr->lock);
+    while (i < n) {
+        bool was_sync = scr->mode & MODE_SYNC;
+
+        feed_byte(scr, (unsigned char)buf[i++]);
+
+        // stop right where a synchronized update ends so it can be published whole
+        if (was_sync && !(scr->mode & MODE_SYNC)) break;
+        // what follows is for the tmux client, see tmux_feed
+        if (scr->control_mode) break;
+    }
+    pthread_mutex_unlock(&scr->lock);
+
+    return i;
+}
+
+static
+bool grid_resize(screen *scr, screen_grid *g, int cursor_y, int cols, int rows)
+{
+    // push the top lines into history so the cursor stays on screen
+    int shift = cursor_y - (rows - 1);
+
+    if (shift > 0) {
+        if (g == &scr->primary)
+            for (int y = 0; y < shift; y++) history_push(scr, g->rows[y].cells);
+
+        for (int y = 0; y < shift; y++) counted_free(g->rows[y].cells);
+        memmove(g->rows, g->rows + shift, (scr->rows - shift) * sizeof *g->rows);
+    } else shift = 0;
+
+    int kept = scr->rows - shift;
+    for (int y = rows; y < kept; y++) counted_free(g->rows[y].cells);
+
+    grid_row *grown = counted_realloc(g->rows, rows * sizeof *grown);
+    if (grown == NULL) return false;
+    g->rows = grown;
+
+    for (int y = 0; y < rows; y++) {
+        cell *cells = (y < kept) ? counted_realloc(grown[y].cells, cols * sizeof(cell)) : NULL;
+
+        if (cells == NULL) {
+            if (y < kept) counted_free(grown[y].cells);
+            cells = counted_calloc(cols, sizeof(cell));
+        } else if (cols > scr->cols)
+            memset(cells + scr->cols, 0, (cols - scr->cols) * sizeof(cell));
+
+        grown[y] = (grid_row){ .cells = cells, .dirty = true };
+    }
+
+    g->saved_y = CLAMP(g->saved_y - shift, 0, rows - 1);
+    g->saved_x = CLAMP(g->saved_x, 0, cols - 1);
+    return true;
+}
+
+void screen_resize(screen *scr, int cols, int rows)
+{
+    if (cols < 1) cols = 1;
+    if (rows < 1) rows = 1;
+
+    pthread_mutex_lock(&scr->lock);
+
+    if (cols == scr->cols && rows == scr->rows) goto unlock;
+
+    screen_grid *inactive = (scr->active == &scr->primary) ? &scr->alternate : &scr->primary;
+    int shift = scr->cursor_y - (rows - 1);
+
+    if (!grid_resize(scr, scr->active, scr->cursor_y, cols, rows)
+        || !grid_resize(scr, inactive, inactive->saved_y, cols, rows))
+        die("Failed to resize screen to %dx%d", cols, rows);
+
+    if (shift > 0) scr->cursor_y -= shift;
+
+    // history lines are hashed at the width they are shown with, their urls were found at the old one
+    if (cols != scr->cols)
+        for (size_t i = 0; i < scr->history_count; i++) scr->history[(scr->history_head + i) % scr->history_cap].hash = 0;
+
+    scr->cols = cols;
+    scr->rows = rows;
+    scr->scroll_top = 0;
+    scr->scroll_bottom = rows - 1;
+
+    scr->cursor_x = CLAMP(scr->cursor_x, 0, cols - 1);
+    scr->wrap_next = false;
+    scr->grapheme = (grapheme_state){ 0 };
+
+    pretty_log(PRETTY_DEBUG, "screen resized to %dx%d", cols, rows);
+unlock:
+    pthread_mutex_unlock(&scr->lock);
+}
+
+void screen_scroll_view(screen *scr, int lines)
+{
+    pthread_mutex_lock(&scr->lock);
+
+    if (lines < 0 && (size_t)-lines > scr->view_offset) scr->view_offset = 0;
+    else scr->view_offset += lines;
+
+    if (scr->view_offset > scr->history_count) scr->view_offset = scr->history_count;
+    if (scr->mode & MODE_ALTSCREEN) scr->view_offset = 0;
+
+    pthread_mutex_unlock(&scr->lock);
+}
+
+void screen_history_usage(screen *scr, size_t *lines, size_t *bytes)
+{
+    pthread_mutex_lock(&scr->lock);
+
+    *lines = scr->history_count;
+    *bytes = scr->history_cap * sizeof(*scr->history);
+
+    for (size_t i = 0; i < scr->history_count; i++) {
+        const scrollback_line *l = &scr->history[(scr->history_head + i) % scr->history_cap];
+
+        *bytes += l->len * sizeof(cell) + l->nattrs * sizeof(cell_attr);
+    }
+
+    pthread_mutex_unlock(&scr->lock);
+}
+
+// Moves the view to the prompt above its top line (dir < 0) or below it, false when there is none
+bool screen_jump_prompt(screen *scr, int dir)
+{
+    pthread_mutex_lock(&scr->lock);
+
+    uint64_t top = scr->history_pushed - scr->view_offset;
+    const prompt_mark *mark = (dir < 0)
+        ? prompt_index_before(&scr->prompts, MARK_PROMPT, top, 0)
+        : prompt_index_after(&scr->prompts, MARK_PROMPT, top + 1, 0);
+
+    // a prompt still on the screen brings the view back down
+    if (mark != NULL && !(scr->mode & MODE_ALTSCREEN))
+        scr->view_offset = (mark->line < scr->history_pushed) ? scr->history_pushed - mark->line : 0;
+
+    pthread_mutex_unlock(&scr->lock);
+    return mark != NULL;
+}
+
+// Cells of a line by number, NULL once it left the scrollback
+static
+const cell *screen_line(const screen *scr, uint64_t line, int *len)
+{
+    uint64_t first = scr->history_pushed - scr->history_count;
+
+    if (line < first) return NULL;
+
+    if (line < scr->history_pushed) {
+        const scrollback_line *l = &scr->history[(scr->history_head + (line - first)) % scr->history_cap];
+
+        *len = l->len;
+        return l->cells;
+    }
+
+    if (line - scr->history_pushed >= (uint64_t)scr->rows) return NULL;
+    *len = scr->cols;
+    return scr->active->rows[line - scr->history_pushed].cells;
+}
+
+/*
+ * Text between two positions as UTF-8, one line per row with trailing
+ * blanks dropped. Returns NULL when nothing is left, the caller frees
+ * the text with counted_free.
+ */
+static
+char *screen_text(const screen *scr, uint64_t from_line, int from_col, uint64_t to_line, int to_col, size_t *len)
+{
+    size_t cap = 1;
+    const cell *cells;
+    int n;
+
+    // a cluster takes more than the 4 bytes of a codepoint
+    for (uint64_t line = from_line; line <= to_line; line++) {
+        if ((cells = screen_line(scr, line, &n)) == NULL) continue;
+
+        cap += (size_t)n * 4 + 1;
+        for (int x = 0; x < n; x++)
+            if (cells[x].codepoint >= CLUSTER_FIRST) cap += CLUSTER_UTF8_MAX - 4;
+    }
+
+    char *text = counted_malloc(cap);
+    if (text == NULL) return NULL;
+
+    *len = 0;
+    for (uint64_t line = from_line; line <= to_line; line++) {
+        if ((cells = screen_line(scr, line, &n)) == NULL) continue;
+
+        int start = (line == from_line) ? from_col : 0;
+        int end = (line == to_line) ? CLAMP(to_col, 0, n) : n;
+
+        while (end > start && (cells[end - 1].codepoint == 0 || cells[end - 1].codepoint == ' ')) end--;
+
+        for (int x = start; x < end; x++) {
+            uint32_t cp = cells[x].codepoint;
+
+            if (cp == CELL_WIDE_SPACER) continue;
+            *len += cluster_utf8((cp == 0) ? ' ' : cp, text + *len);
+        }
+        if (line != to_line) text[(*len)++] = '\n';
+    }
+    text[*len] = '\0';
+    return text;
+}
+
+// Orders the ends of the selection, `to` ends up just past its last cell
+static
+bool selection_range(const screen *scr, text_pos *from, text_pos *to)
+{
+    const selection *sel = &scr->sel;
+
+    if (!sel->active) return false;
+
+    bool forward = sel->anchor.line < sel->head.line
+        || (sel->anchor.line == sel->head.line && sel->anchor.col <= sel->head.col);
+
+    *from = forward ? sel->anchor : sel->head;
+    *to = forward ? sel->head : sel->anchor;
+    to->col++;
+    return true;
+}
+
+// Starts a selection at a visible cell, or moves its free end there when `extend`
+void screen_select(screen *scr, int x, int y, bool extend)
+{
+    pthread_mutex_lock(&scr->lock);
+
+    text_pos pos = {
+        .line = scr->history_pushed - scr->view_offset + CLAMP(y, 0, scr->rows - 1),
+        .col = CLAMP(x, 0, scr->cols - 1),
+    };
+
+    if (extend) {
+        scr->sel.head = pos;
+        scr->sel.active = pos.line != scr->sel.anchor.line || pos.col != scr->sel.anchor.col;
+    } else scr->sel = (selection){ pos, pos, false };
+
+    pthread_mutex_unlock(&scr->lock);
+}
+
+// The whole scrollback and screen, the alternate screen has no scrollback of its own
+void screen_select_all(screen *scr)
+{
+    pthread_mutex_lock(&scr->lock);
+
+    uint64_t first = (scr->mode & MODE_ALTSCREEN)
+        ? scr->history_pushed : scr->history_pushed - scr->history_count;
+
+    scr->sel = (selection){
+        .anchor = { first, 0 },
+        .head = { scr->history_pushed + scr->rows - 1, scr->cols - 1 },
+        .active = true,
+    };
+
+    pthread_mutex_unlock(&scr->lock);
+}
+
+// What the last command printed, from its OSC 133 C mark up to its D mark or the cursor
+bool screen_select_output(screen *scr)
+{
+    pthread_mutex_lock(&scr->lock);
+
+    const prompt_mark *output = prompt_index_last(&scr->prompts, MARK_OUTPUT);
+    const prompt_mark *done = NULL;
+    text_pos end = { scr->history_pushed + scr->cursor_y, scr->cursor_x };
+
+    if (output != NULL) done = prompt_index_after(&scr->prompts, MARK_DONE, output->line, output->col);
+    if (done != NULL) end = (text_pos){ done->line, done->col };
+
+    // the marks are on the primary screen, and the selection ends on the cell before `end`
+    bool found = output != NULL && !(scr->mode & MODE_ALTSCREEN)
+        && (end.line > output->line || (end.line == output->line && end.col > output->col));
+
+    if (found) {
+        end = (end.col > 0) ? (text_pos){ end.line, end.col - 1 } : (text_pos){ end.line - 1, scr->cols - 1 };
+        scr->sel = (selection){ { output->line, output->col }, end, true };
+    }
+
+    pthread_mutex_unlock(&scr->lock);
+    return found;
+}
+
+void screen_select_clear(screen *scr)
+{
+    pthread_mutex_lock(&scr->lock);
+    scr->sel.active = false;
+    pthread_mutex_unlock(&scr->lock);
+}
+
+// The ordered ends of the selection, false when nothing is selected
+bool screen_selection(screen *scr, text_pos *from, text_pos *to)
+{
+    pthread_mutex_lock(&scr->lock);
+    bool active = selection_range(scr, from, to);
+    pthread_mutex_unlock(&scr->lock);
+
+    return active;
+}
+
+/*
+ * Lines `first` to `last` of the text between `from` and `to`. A large
+ * selection is read a chunk at a time so the parser is never held up for
+ * long, lines that left the scrollback meanwhile are skipped.
+ */
+char *screen_selection_text(screen *scr, text_pos from, text_pos to, uint64_t first, uint64_t last, size_t *len)
+{
+    pthread_mutex_lock(&scr->lock);
+    char *text = screen_text(scr, first, (first == from.line) ? from.col : 0,
+        last, (last == to.line) ? to.col : INT_MAX, len);
+    pthread_mutex_unlock(&scr->lock);
+
+    return text;
+}
+
+// Columns of a visible row inside the selection, `from` == `to` when there are none
+void snapshot_selected(const screen_snapshot *snap, int row, int *from, int *to)
+{
+    *from = *to = 0;
+    if (!snap->has_selection || row < snap->sel_start_y || row > snap->sel_end_y) return;
+
+    *from = (row == snap->sel_start_y) ? snap->sel_start_x : 0;
+    *to = (row == snap->sel_end_y) ? snap->sel_end_x : snap->cols;
+}
+
+// Where the selection crosses the rows on display, the rows it covers hash differently
+static
+void snapshot_selection(const screen *scr, screen_snapshot *snap)
+{
+    uint64_t top = scr->history_pushed - scr->view_offset;
+    uint64_t bottom = top + scr->rows;
+    text_pos from, to;
+
+    snap->has_selection = selection_range(scr, &from, &to) && from.line < bottom && to.line >= top;
+    if (!snap->has_selection) return;
+
+    snap->sel_start_y = (from.line < top) ? 0 : (int)(from.line - top);
+    snap->sel_start_x = (from.line < top) ? 0 : from.col;
+    snap->sel_end_y = (to.line >= bottom) ? scr->rows - 1 : (int)(to.line - top);
+    snap->sel_end_x = (to.line >= bottom) ? scr->cols : to.col;
+
+    for (int y = snap->sel_start_y; y <= snap->sel_end_y; y++) {
+        int a, b;
+
+        snapshot_selected(snap, y, &a, &b);
+        uint64_t h = (snap->row_hash[y] ^ ((uint64_t)a << 32 | (uint32_t)b)) * 0x100000001b3ULL;
+        snap->row_hash[y] = h ? h : 1;
+    }
+}
+
+// Underlines OSC 8 link `link`, or else columns `from` to `to` of visible row `y`. True when that changed
+bool screen_hover(screen *scr, int y, int from, int to, uint16_t link)
+{
+    pthread_mutex_lock(&scr->lock);
+
+    link_hover hover = { .link = link };
+
+    if (link == 0 && from < to) {
+        hover.line = scr->history_pushed - scr->view_offset + CLAMP(y, 0, scr->rows - 1);
+        hover.from = from;
+        hover.to = to;
+    }
+
+    bool changed = hover.link != scr->hover.link || hover.line != scr->hover.line
+        || hover.from != scr->hover.from || hover.to != scr->hover.to;
+
+    scr->hover = hover;
+    pthread_mutex_unlock(&scr->lock);
+    return changed;
+}
+
+// Where OSC 8 link `link` goes, NULL once it is gone. The caller frees it with counted_free
+char *screen_link_uri(screen *scr, uint16_t link)
+{
+    char *uri = NULL;
+
+    pthread_mutex_lock(&scr->lock);
+    if (link < scr->links.used && scr->links.uris[link] != NULL) {
+        size_t size = strlen(scr->links.uris[link]) + 1;
+
+        if ((uri = counted_malloc(size)) != NULL) memcpy(uri, scr->links.uris[link], size);
+    }
+    pthread_mutex_unlock(&scr->lock);
+    return uri;
+}
+
+// Columns of a visible row under the hovered url, `from` == `to` when there are none
+void snapshot_hovered(const screen_snapshot *snap, int row, int *from, int *to)
+{
+    *from = *to = 0;
+    if (row != snap->hover_y) return;
+
+    *from = snap->hover_from;
+    *to = snap->hover_to;
+}
+
+static
+void hover_mix(screen_snapshot *snap, int y, uint64_t what)
+{
+    uint64_t h = (snap->row_hash[y] ^ what ^ 0x9e3779b97f4a7c15ULL) * 0x100000001b3ULL;
+
+    snap->row_hash[y] = h ? h : 1;
+}
+
+// Like the selection, rows under the hovered link hash differently and only they are drawn again
+static
+void snapshot_hover(const screen *scr, screen_snapshot *snap)
+{
+    const link_hover *hover = &scr->hover;
+    uint64_t top = scr->history_pushed - scr->view_offset;
+
+    snap->hover_link = hover->link;
+    snap->hover_y = -1;
+    snap->hover_from = snap->hover_to = 0;
+
+    if (hover->from < hover->to && hover->line >= top && hover->line < top + scr->rows) {
+        snap->hover_y = (int)(hover->line - top);
+        snap->hover_from = hover->from;
+        snap->hover_to = hover->to;
+        hover_mix(snap, snap->hover_y, (uint64_t)hover->from << 32 | (uint32_t)hover->to);
+    }
+    if (hover->link == 0) return;
+
+    for (int y = 0; y < snap->rows; y++) {
+        const cell *cells = snap->cells + (size_t)y * snap->cols;
+
+        for (int x = 0; x < snap->cols; x++) {
+            if (snap->attrs[cells[x].attr].link != hover->link) continue;
+
+            hover_mix(snap, y, hover->link);
+            break;
+        }
+    }
+}
+
+static
+bool snapshot_reserve(screen_snapshot *snap, int cols, int rows)
+{
+    size_t need = (size_t)cols * rows;
+
+    if (snap->cap < need) {
+        cell *cells = counted_realloc(snap->cells, need * sizeof(cell));
+
+        if (cells == NULL) return false;
+        snap->cells = cells;
+        snap->cap = need;
+    }
+
+    if (snap->row_cap < rows) {
+        uint64_t *hashes = counted_realloc(snap->row_hash, rows * sizeof(uint64_t));
+
+        if (hashes == NULL) return false;
+        snap->row_hash = hashes;
+
+        hashes = counted_realloc(snap->text_hash, rows * sizeof(uint64_t));
+        if (hashes == NULL) return false;
+        snap->text_hash = hashes;
+        snap->row_cap = rows;
+    }
+
+    return true;
+}
+
+// Cells of a scrollback line with the ids its attributes have on screen, they are interned again
+static
+void history_cells(screen *scr, const scrollback_line *l, cell *dst, int len)
+{
+    uint16_t ids[CELL_ATTR_CAP];
+
+    for (int a = 0; a < l->nattrs; a++) ids[a + 1] = attr_intern(scr, &l->attrs[a]);
+    ids[0] = 0;
+
+    for (int x = 0; x < len; x++) dst[x] = (cell){ .codepoint = l->cells[x].codepoint, .attr = ids[l->cells[x].attr] };
+}
+
+static
+void snapshot_fill(screen *scr, screen_snapshot *snap)
+{
+    if (!snapshot_reserve(snap, scr->cols, scr->rows)) return;
+
+    snap->cols = scr->cols;
+    snap->rows = scr->rows;
+
+    size_t from_history = scr->view_offset;
+    if (from_history > (size_t)scr->rows) from_history = scr->rows;
+
+    for (int y = 0; y < scr->rows; y++) {
+        cell *dst = snap->cells + (size_t)y * scr->cols;
+
+        if ((size_t)y < from_history) {
+            size_t index = scr->history_count - scr->view_offset + y;
+            scrollback_line *l = &scr->history[(scr->history_head + index) % scr->history_cap];
+            int len = (l->len < scr->cols) ? l->len : scr->cols;
+
+            history_cells(scr, l, dst, len);
+            memset(dst + len, 0, (scr->cols - len) * sizeof(cell));
+
+            if (l->hash == 0) {
+                l->hash = row_hash(&scr->attrs, dst, scr->cols);
+                if (scr->urls != NULL) url_submit(scr->urls, l->hash, dst, scr->cols);
+            }
+            snap->text_hash[y] = l->hash;
+        } else {
+            grid_row *row = &scr->active->rows[y - from_history];
+
+            memcpy(dst, row->cells, scr->cols * sizeof(cell));
+
+            // rows keep their hash until touched, even across screen switches
+            // and only the rows hashed again are looked at for urls
+            if (row->dirty) {
+                row->hash = row_hash(&scr->attrs, row->cells, scr->cols);
+                row->dirty = false;
+                if (scr->urls != NULL) url_submit(scr->urls, row->hash, row->cells, scr->cols);
+            }
+            snap->text_hash[y] = row->hash;
+        }
+    }
+
+    // the table only changes when text gets a look it never had before, history in view included
+    if (snap->attrs_generation != scr->attrs.generation) {
+        memcpy(snap->attrs, scr->attrs.attrs, scr->attrs.used * sizeof(cell_attr));
+        snap->nattrs = scr->attrs.used;
+        snap->attrs_generation = scr->attrs.generation;
+    }
+
+    snap->cursor_x = scr->cursor_x;
+    snap->cursor_y = scr->cursor_y + from_history;
+    snap->cursor_visible = snap->cursor_y < scr->rows && !(scr->mode & MODE_HIDE);
+    snap->seq = ++scr->seq;
+
+    // looking back through history moves the view the other way
+    snap->top_line = scr->scrolled - scr->view_offset;
+    memcpy(snap->row_hash, snap->text_hash, scr->rows * sizeof(uint64_t));
+    snapshot_selection(scr, snap);
+    snapshot_hover(scr, snap);
+}
+
+static
+bool sync_held(screen *scr)
+{
+    if (!(scr->mode & MODE_SYNC)) return false;
+
+    if (trace_now_ns() - scr->sync_start < SYNC_TIMEOUT_MS * 1000000ULL) return true;
+
+    pretty_log(PRETTY_DEBUG, "synchronized update timed out");
+    scr->mode &= ~MODE_SYNC;
+    return false;
+}
+
+bool screen_sync_deadline(screen *scr, uint64_t *deadline)
+{
+    pthread_mutex_lock(&scr->lock);
+
+    bool held = scr->mode & MODE_SYNC;
+    *deadline = scr->sync_start + SYNC_TIMEOUT_MS * 1000000ULL;
+
+    pthread_mutex_unlock(&scr->lock);
+    return held;
+}
+
+bool screen_publish(screen *scr)
+{
+    pthread_mutex_lock(&scr->lock);
+
+    // keep showing the last complete frame while an update is in flight
+    if (sync_held(scr)) {
+        pthread_mutex_unlock(&scr->lock);
+        return false;
+    }
+
+    snapshot_fill(scr, &scr->snapshots[scr->snap_back]);
+
+    pthread_mutex_lock(&scr->snapshot_lock);
+
+    int tmp = scr->snap_ready;
+    scr->snap_ready = scr->snap_back;
+    scr->snap_back = tmp;
+
+    bool was_fresh = scr->snap_fresh;
+    scr->snap_fresh = true;
+
+    pthread_mutex_unlock(&scr->snapshot_lock);
+    pthread_mutex_unlock(&scr->lock);
+
+    return !was_fresh;
+}
+
+const screen_snapshot *screen_acquire(screen *scr, bool *fresh)
+{
+    pthread_mutex_lock(&scr->snapshot_lock);
+
+    *fresh = scr->snap_fresh;
+    if (scr->snap_fresh) {
+        int tmp = scr->snap_front;
+        scr->snap_front = scr->snap_ready;
+        scr->snap_ready = tmp;
+        scr->snap_fresh = false;
+    }
+
+    pthread_mutex_unlock(&scr->snapshot_lock);
+    return &scr->snapshots[scr->snap_front];
+}
@@ -0,0 +1,308 @@
+#ifndef SCREEN_H
+    #define SCREEN_H
+
+    #include <pthread.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include <stdatomic.h>
+    #include <stdint.h>
+
+    #include "alloc.h"
+    #include "prompt.h"
+    #include "slave.h"
+    #include "unicode.h"
+
+enum { SCREEN_HISTORY_CAP = 10000 };
+enum { SNAPSHOT_COUNT = 3 };
+enum { CSI_MAX_PARAMS = 16 };
+enum { SCREEN_REPLY_CAP = 256 };
+// bytes parsed per hold of the lock, the UI gets a turn to scroll, select or resize in between
+enum { SCREEN_FEED_SLICE = 64 * 1024 };
+// longer OSC payloads are dropped whole rather than acted on truncated
+enum { SCREEN_OSC_CAP = 2048 };
+
+// how long a synchronized update (DEC mode 2026) may hold back frames
+enum { SYNC_TIMEOUT_MS = 150 };
+
+// scrollback lines are carved out of fixed size pages recycled through a pool
+enum { SCROLLBACK_PAGE_SIZE = 64 * 1024 };
+enum { SCROLLBACK_PAGES_PER_BLOCK = 4 };
+
+// attributes are interned per screen, a cell only keeps their id and stays 4 bytes
+enum { CELL_ATTR_BITS = 11, CELL_ATTR_CAP = 1 << CELL_ATTR_BITS };
+
+typedef struct {
+    uint32_t codepoint : 21;
+    uint32_t attr : CELL_ATTR_BITS; // 0 is the default look
+} cell;
+
+// colours as set by SGR, resolved against the palette only when drawn
+enum {
+    ATTR_COLOR_DEFAULT = 0,
+    ATTR_COLOR_INDEXED = 1 << 24,
+    ATTR_COLOR_RGB = 2 << 24,
+};
+
+    #define ATTR_COLOR_KIND(c) ((c) & 0xFF000000)
+
+enum underline_style {
+    UNDERLINE_NONE,
+    UNDERLINE_SINGLE,
+    UNDERLINE_DOUBLE,
+    UNDERLINE_CURLY,
+    UNDERLINE_DOTTED,
+    UNDERLINE_DASHED,
+};
+
+enum {
+    ATTR_BOLD = 1 << 0,
+    ATTR_FAINT = 1 << 1,
+    ATTR_ITALIC = 1 << 2,
+    ATTR_INVERSE = 1 << 3,
+    ATTR_HIDDEN = 1 << 4,
+    ATTR_STRIKE = 1 << 5,
+    ATTR_UNDERLINE_SHIFT = 6, // enum underline_style in the next 3 bits
+};
+
+    #define ATTR_UNDERLINE(flags) (((flags) >> ATTR_UNDERLINE_SHIFT) & 7)
+
+typedef struct {
+    uint32_t fg;
+    uint32_t bg;
+    uint32_t underline; // colour of the underline, default follows fg
+    uint16_t flags;
+    uint16_t link; // OSC 8 hyperlink, 0 for none
+} cell_attr;
+
+/*
+ * Attributes of the cells on screen, ids are only recycled once no cell
+ * there refers to them anymore. Scrollback lines carry a copy of the
+ * attributes they use, so history never holds on to an id.
+ */
+typedef struct {
+    cell_attr attrs[CELL_ATTR_CAP];
+    uint64_t keys[CELL_ATTR_CAP]; // hash of the attribute itself, mixed into row hashes
+    uint16_t index[CELL_ATTR_CAP * 2]; // open addressing on `keys`, 0 is a free bucket
+    uint16_t free_ids[CELL_ATTR_CAP];
+    int nfree;
+    int used; // ids handed out so far, the highest one plus one
+    uint64_t generation; // bumped whenever an id is handed out
+    uint64_t collected_at; // cells written when a collection last found nothing to free
+
+    /* ids a line being pushed to history has in its own table, valid for the line numbered `line_stamp` */
+    uint64_t line_stamp[CELL_ATTR_CAP];
+    uint16_t line_id[CELL_ATTR_CAP];
+} attr_table;
+
+// hyperlinks are interned per screen too, carried by the attributes of the cells they cover
+enum { SCREEN_LINKS_MIN = 256, SCREEN_LINKS_MAX = 1 << 16 };
+
+/*
+ * The table doubles up to SCREEN_LINKS_MAX ids. Once they are all taken
+ * the links nothing refers to are freed, and if that leaves less than a
+ * quarter free, the ones only history still shows are dropped oldest
+ * first, so the next collection is that many links away.
+ */
+typedef struct {
+    char **uris; // NULL for a free id, id 0 is no link
+    uint64_t *keys; // hash of the id parameter and the uri, cells with both equal form one link
+    uint64_t *seen; // lines pushed to history when the link was last printed
+    uint16_t *index; // open addressing on `keys` over twice the ids, 0 is a free bucket
+    uint16_t *free_ids;
+    int nfree;
+    int used; // ids handed out so far, the highest one plus one
+    int cap;
+} link_table;
+
+// right half of a wide character, outside the unicode range so it never clashes
+enum { CELL_WIDE_SPACER = 0x110000 };
+
+typedef struct {
+    size_t used;
+    size_t live;
+    cell cells[];
+} scrollback_page;
+
+// The attr of its cells indexes `attrs` from 1, both are carved out of the same page
+typedef struct {
+    cell *cells;
+    cell_attr *attrs;
+    scrollback_page *page;
+    int len;
+    int nattrs;
+    uint64_t hash;
+} scrollback_line;
+
+typedef struct {
+    cell *cells;
+    uint64_t hash;
+    bool dirty;
+} grid_row;
+
+typedef struct {
+    grid_row *rows;
+    int saved_x;
+    int saved_y;
+    cell_attr saved_pen;
+} screen_grid;
+
+// A place in the text, lines counted from the first line the screen ever had
+typedef struct {
+    uint64_t line;
+    int col;
+} text_pos;
+
+// What is selected, kept as two positions so selecting all of the scrollback costs nothing
+typedef struct {
+    text_pos anchor; // where the selection started
+    text_pos head; // where it is now, on either side of `anchor`
+    bool active;
+} selection;
+
+// The link under the mouse, underlined until it moves away
+typedef struct {
+    uint16_t link; // an OSC 8 link, every cell of it is underlined
+    uint64_t line; // or a url found in the text, on that line
+    int from;
+    int to; // `from` == `to` when there is none
+} link_hover;
+
+enum parse_state {
+    STATE_GROUND,
+    STATE_ESCAPE,
+    STATE_CSI,
+    STATE_STRING,
+    STATE_STRING_ESC,
+};
+
+// Immutable copy of the visible rows, handed from the parser to the renderer
+typedef struct {
+    cell *cells;
+    uint64_t *row_hash; // what the rows look like, selection and hover included
+    uint64_t *text_hash; // what they hold, found urls are remembered by it
+    cell_attr attrs[CELL_ATTR_CAP]; // copied up to `nattrs` when the table changed
+    int nattrs;
+    uint64_t attrs_generation;
+    size_t cap;
+    int row_cap;
+    int cols;
+    int rows;
+    int cursor_x;
+    int cursor_y;
+    bool cursor_visible;
+    uint64_t seq;
+    uint64_t top_line; // moves by N when the whole screen scrolls by N rows
+
+    /* the visible part of the selection, up to but not including (sel_end_x, sel_end_y) */
+    bool has_selection;
+    int sel_start_x;
+    int sel_start_y;
+    int sel_end_x;
+    int sel_end_y;
+
+    /* the hovered link, columns hover_from up to hover_to of row hover_y or every cell of `hover_link` */
+    uint16_t hover_link;
+    int hover_y;
+    int hover_from;
+    int hover_to;
+} screen_snapshot;
+
+typedef struct screen {
+    pthread_mutex_t lock;
+
+    int cols;
+    int rows;
+    unsigned int mode;
+
+    /* both grids are allocated upfront, switching only swaps `active` */
+    screen_grid primary;
+    screen_grid alternate;
+    screen_grid *active;
+
+    int cursor_x;
+    int cursor_y;
+    bool wrap_next;
+    int scroll_top;
+    int scroll_bottom;
+    uint64_t scrolled; // rows the whole screen scrolled up, minus the ones it scrolled down
+
+    /* what SGR set for the next characters, interned the first time one is printed */
+    cell_attr pen;
+    int pen_id; // -1 until interned
+    uint64_t cells_written; // printed or scrolled away, what can free an attribute id
+    attr_table attrs;
+    link_table links;
+
+    enum parse_state state;
+    int params[CSI_MAX_PARAMS];
+    uint32_t param_colon; // bit i is set when param i followed a ':'
+    int nparams;
+    char csi_private;
+    char csi_intermediate;
+
+    /* payload of the OSC being received, acted on once the string ends */
+    char string_kind; // the byte that opened the string, ']' for an OSC
+    char osc[SCREEN_OSC_CAP + 1]; // also the first bytes of a DCS
+    size_t osc_len;
+
+    bool control_mode; // tmux -CC took over the tty, cleared by whoever feeds the screen
+
+    /* answers to queries, written back to the tty by the parser thread */
+    char reply[SCREEN_REPLY_CAP];
+    size_t reply_len;
+
+    uint64_t sync_start;
+
+    uint32_t utf8_cp;
+    int utf8_left;
+    grapheme_state grapheme;
+    bool cluster_open; // the cell at cluster_x, cluster_y takes the rest of the cluster
+    int cluster_x;
+    int cluster_y;
+
+    scrollback_line *history;
+    pool history_pages;
+    scrollback_page *history_page;
+    size_t history_cap;
+    size_t history_head;
+    size_t history_count;
+    size_t view_offset;
+    uint64_t history_pushed; // lines that ever left the top of the primary screen
+    prompt_index prompts;
+    selection sel;
+    link_hover hover;
+    struct url_finder *urls; // told about the rows that changed, none when NULL
+    atomic_int borrowed; // clipboard workers still reading, the screen must outlive them
+
+    /* triple buffer: the parser fills `back`, the renderer owns `front` */
+    pthread_mutex_t snapshot_lock;
+    screen_snapshot snapshots[SNAPSHOT_COUNT];
+    int snap_front;
+    int snap_ready;
+    int snap_back;
+    bool snap_fresh;
+    uint64_t seq;
+} screen;
+
+bool screen_init(screen *scr, int cols, int rows, size_t history_cap);
+void screen_destroy(screen *scr);
+void screen_resize(screen *scr, int cols, int rows);
+size_t screen_feed(screen *scr, const char *buf, size_t n);
+void screen_scroll_view(screen *scr, int lines);
+void screen_history_usage(screen *scr, size_t *lines, size_t *bytes);
+bool screen_jump_prompt(screen *scr, int dir);
+void screen_select(screen *scr, int x, int y, bool extend);
+void screen_select_all(screen *scr);
+bool screen_select_output(screen *scr);
+void screen_select_clear(screen *scr);
+bool screen_selection(screen *scr, text_pos *from, text_pos *to);
+char *screen_selection_text(screen *scr, text_pos from, text_pos to, uint64_t first, uint64_t last, size_t *len);
+void snapshot_selected(const screen_snapshot *snap, int row, int *from, int *to);
+bool screen_hover(screen *scr, int y, int from, int to, uint16_t link);
+char *screen_link_uri(screen *scr, uint16_t link);
+void snapshot_hovered(const screen_snapshot *snap, int row, int *from, int *to);
+bool screen_publish(screen *scr);
+bool screen_sync_deadline(screen *scr, uint64_t *deadline);
+const screen_snapshot *screen_acquire(screen *scr, bool *fresh);
+
+#endif // SCREEN_H
@@ -0,0 +1,169 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "SDL3/SDL_events.h"
+#include "server.h"
+#include "log.h"
+
+static
+bool socket_path(const char *path, struct sockaddr_un *addr)
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    int n;
+
+    *addr = (struct sockaddr_un){ .sun_family = AF_UNIX };
+
+    if (path != NULL) n = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s", path);
+    else if (dir != NULL && *dir != '\0')
+        n = snprintf(addr->sun_path, sizeof(addr->sun_path), "%s/pretty-server.sock", dir);
+    else n = snprintf(addr->sun_path, sizeof(addr->sun_path), "/tmp/pretty-server-%u.sock", getuid());
+
+    if (n < 0 || (size_t)n >= sizeof(addr->sun_path)) {
+        pretty_log(PRETTY_ERROR, "Server socket path is too long");
+        return false;
+    }
+    return true;
+}
+
+static
+int read_line(int fd, char *line, size_t size)
+{
+    size_t len = 0;
+
+    while (len < size - 1) {
+        ssize_t n = recv(fd, line + len, 1, 0);
+
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0 || line[len] == '\n') break;
+        len++;
+    }
+
+    line[len] = '\0';
+    return len;
+}
+
+static
+void serve_client(server *srv, int fd)
+{
+    char line[SERVER_LINE_CAP];
+    const char *reply = "ok\n";
+
+    // a client that never sends its command doesn't block the next ones
+    struct timeval timeout = { .tv_sec = 1 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    read_line(fd, line, sizeof(line));
+
+    if (strcmp(line, "new-window") == 0) {
+        SDL_Event ev = { .type = srv->event_type };
+
+        if (!SDL_PushEvent(&ev)) reply = "error: event queue full\n";
+    } else if (strcmp(line, "ping") != 0) reply = "error: unknown command\n";
+
+    send(fd, reply, strlen(reply), MSG_NOSIGNAL);
+    close(fd);
+}
+
+static
+void *server_loop(void *arg)
+{
+    server *srv = arg;
+
+    for (;;) {
+        int fd = accept(srv->listen_fd, NULL, NULL);
+
+        if (fd >= 0) serve_client(srv, fd);
+        else if (errno != EINTR && errno != ECONNABORTED) break;
+    }
+    return NULL;
+}
+
+bool server_start(server *srv, const char *path)
+{
+    struct sockaddr_un addr;
+
+    *srv = (server){ .listen_fd = -1 };
+
+    if (!socket_path(path, &addr)) return false;
+
+    // a socket nobody answers on is left over from a crashed server
+    if (server_request(addr.sun_path, "ping")) {
+        pretty_log(PRETTY_ERROR, "A server is already listening on [%s]", addr.sun_path);
+        return false;
+    }
+    unlink(addr.sun_path);
+
+    srv->event_type = SDL_RegisterEvents(1);
+    if (srv->event_type == 0) {
+        pretty_log(PRETTY_ERROR, "Couldn't register the server event: %s", SDL_GetError());
+        return false;
+    }
+
+    srv->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (srv->listen_fd < 0) {
+        pretty_log(PRETTY_ERROR, "Couldn't create server socket: %s", strerror(errno));
+        return false;
+    }
+
+    if (bind(srv->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+        || listen(srv->listen_fd, 8) < 0)
+    {
+        pretty_log(PRETTY_ERROR, "Couldn't listen on [%s]: %s", addr.sun_path, strerror(errno));
+        goto fail;
+    }
+
+    srv->path = strdup(addr.sun_path);
+    if (srv->path == NULL || pthread_create(&srv->thread, NULL, server_loop, srv) != 0) {
+        unlink(addr.sun_path);
+        goto fail;
+    }
+
+    pretty_log(PRETTY_INFO, "Server listening on [%s]", srv->path);
+    return true;
+
+fail:
+    close(srv->listen_fd);
+    free(srv->path);
+    *srv = (server){ .listen_fd = -1 };
+    return false;
+}
+
+void server_stop(server *srv)
+{
+    if (srv->listen_fd < 0) return;
+
+    // wakes the blocked accept()
+    shutdown(srv->listen_fd, SHUT_RDWR);
+    pthread_join(srv->thread, NULL);
+
+    close(srv->listen_fd);
+    unlink(srv->path);
+    free(srv->path);
+    *srv = (server){ .listen_fd = -1 };
+}
+
+bool server_request(const char *path, const char *command)
+{
+    struct sockaddr_un addr;
+    char reply[SERVER_LINE_CAP];
+
+    if (!socket_path(path, &addr)) return false;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+
+    bool ok = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0
+        && send(fd, command, strlen(command), MSG_NOSIGNAL) >= 0
+        && send(fd, "\n", 1, MSG_NOSIGNAL) >= 0
+        && read_line(fd, reply, sizeof(reply)) > 0
+        && strcmp(reply, "ok") == 0;
+
+    close(fd);
+    return ok;
+}
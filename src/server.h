@@ -0,0 +1,22 @@
+#ifndef SERVER_H
+    #define SERVER_H
+
+    #include <pthread.h>
+    #include <stdbool.h>
+    #include <stdint.h>
+
+enum { SERVER_LINE_CAP = 64 };
+
+// Lets `pretty --new-window` ask a running `pretty --server` for a window
+typedef struct {
+    int listen_fd;
+    char *path;
+    pthread_t thread;
+    uint32_t event_type;
+} server;
+
+bool server_start(server *srv, const char *path);
+void server_stop(server *srv);
+bool server_request(const char *path, const char *command);
+
+#endif // SERVER_H
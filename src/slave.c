@@ -6,32 +6,71 @@
 #include <pwd.h>
 #include <signal.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "alloc.h"
 #include "pretty.h"
+#include "record.h"
+#include "screen.h"
+#include "tmux.h"
+#include "trace.h"
 #include "slave.h"
 #include "macro_utils.h"
 #include "pthread.h"
 #include "log.h"
 
-static pid_t pid;
+// A shell started by tty_new, the main thread claims and frees it, the handler only reaps
+typedef struct {
+    volatile sig_atomic_t pid; // 0 for a free slot
+    volatile sig_atomic_t status;
+    volatile sig_atomic_t exited;
+} tty_child;
+
+static tty_child children[TTY_CHILDREN_MAX];
 
 static
 void sigchld(int a)
 {
     int stat;
-    pid_t p = waitpid(pid, &stat, WNOHANG);
+    int saved_errno = errno;
+
+    // other children, like the helpers SDL_OpenURL starts, are left to whoever waits for them
+    for (size_t i = 0; i < length_of(children); i++) {
+        pid_t pid = children[i].pid;
+
+        if (pid > 0 && !children[i].exited && waitpid(pid, &stat, WNOHANG) == pid) {
+            children[i].status = stat;
+            children[i].exited = 1;
+        }
+    }
+
+    errno = saved_errno;
+}
+
+// Logs how the shells reaped since the last call ended, pretty_log can't run in the handler
+void tty_reap_children(void)
+{
+    for (size_t i = 0; i < length_of(children); i++) {
+        if (children[i].pid == 0 || !children[i].exited) continue;
 
-    if (p < 0) die("waiting for pid %hd failed: %s", pid, strerror(errno));
+        pid_t p = children[i].pid;
+        int stat = children[i].status;
 
-    if (p == 0 || pid != p) return;
+        if (WIFEXITED(stat) && WEXITSTATUS(stat))
+            pretty_log(PRETTY_WARN, "child %d exited with status %d", p, WEXITSTATUS(stat));
+        else if (WIFSIGNALED(stat))
+            pretty_log(PRETTY_WARN, "child %d terminated due to signal %d", p, WTERMSIG(stat));
 
-    if (WIFEXITED(stat) && WEXITSTATUS(stat)) die("child exited with status %d", WEXITSTATUS(stat));
-    else if (WIFSIGNALED(stat)) die("child terminated due to signal %d", WTERMSIG(stat));
+        children[i].pid = 0;
+    }
 }
 
 static
@@ -70,17 +109,28 @@ int tty_new(char *args[static 1])
     int cmdfd = -1;
     int master;
     int slave;
+    pid_t pid;
+    sigset_t block, old;
+    size_t slot = 0;
 
     if (openpty(&master, &slave, NULL, NULL, NULL) < 0)
         die("openpty call failed: %s", strerror(errno));
 
     pretty_log(PRETTY_INFO, "Successfully opened a new tty");
 
+    while (slot < length_of(children) && children[slot].pid != 0) slot++;
+
+    // a child exiting right away is only reaped once its pid is in the table
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+
     switch (pid = fork()) {
         case -1:
             die("fork failed: %s", strerror(errno));
             break;
         case 0:
+            pthread_sigmask(SIG_SETMASK, &old, NULL);
             setsid();
             dup2(slave, STDIN_FILENO);
             dup2(slave, STDOUT_FILENO);
@@ -95,7 +145,18 @@ int tty_new(char *args[static 1])
         default:
             close(slave);
             cmdfd = master;
+
+            if (slot < length_of(children)) {
+                children[slot].exited = 0;
+                children[slot].pid = pid;
+            } else pretty_log(PRETTY_WARN, "More than %d shells, child %d won't be reaped", TTY_CHILDREN_MAX, pid);
+
             signal(SIGCHLD, sigchld);
+            pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+            // the reader writes replies only as far as the pty takes them, see tty_flush_replies
+            if (fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK) < 0)
+                die("fcntl O_NONBLOCK failed: %s", strerror(errno));
             break;
     }
 
@@ -111,7 +172,12 @@ void tty_write_raw(tty_state *tty, const char *s, size_t n)
         r = write(tty->pty_master_fd, s, n);
 
         if (r < 0) {
-            if (errno == EINTR || errno == EAGAIN) continue;
+            // input typed by the user waits for the child to read, unlike replies
+            if (errno == EAGAIN) {
+                poll(&(struct pollfd){ .fd = tty->pty_master_fd, .events = POLLOUT }, 1, -1);
+                continue;
+            }
+            if (errno == EINTR) continue;
             die("write error on tty: %s", strerror(errno));
         }
 
@@ -124,6 +190,9 @@ void tty_write(tty_state *tty, const char *s, size_t n)
 {
     const char *next;
 
+    if (tty->pty_master_fd < 0) return;
+    record_event(tty->recording, RECORD_INPUT, s, n);
+
     // This is similar to how the kernel handles ONLCR for ttys
     while (n > 0) {
         if (*s == '\r') {
@@ -140,102 +209,500 @@ void tty_write(tty_state *tty, const char *s, size_t n)
 }
 
 static
-inline size_t ring_count(const tty_state *tty)
+void tty_wake(tty_state *tty)
 {
-    return (tty->head >= tty->tail)
-        ? (tty->head - tty->tail)
-        : (TTY_RING_CAP - (tty->tail - tty->head));
+    ssize_t r = write(tty->wake[1], "", 1);
+
+    // a full pipe already wakes the reader
+    UNUSED(r);
 }
 
+/*
+ * Queues bytes for the reader to write once the pty has room, so a child
+ * that doesn't read never holds up the caller. False when they don't fit.
+ */
+bool tty_queue(tty_state *tty, const char *s, size_t n)
+{
+    if (tty->pty_master_fd < 0) return false;
+
+    pthread_mutex_lock(&tty->lock);
+    bool fits = tty->replies_len + n <= TTY_REPLY_CAP;
+
+    if (fits) {
+        record_event(tty->recording, RECORD_INPUT, s, n);
+        memcpy(tty->replies + tty->replies_len, s, n);
+        tty->replies_len += n;
+    }
+
+    // the reader may be waiting for space in the ring rather than polling
+    pthread_cond_broadcast(&tty->space_ready);
+    pthread_mutex_unlock(&tty->lock);
+    if (fits) tty_wake(tty);
+    return fits;
+}
+
+// Waits until `n` more bytes fit in the queue, or the child is gone
+void tty_wait_queue(tty_state *tty, size_t n)
+{
+    pthread_mutex_lock(&tty->lock);
+    while (!tty->should_exit && !tty->child_exited && tty->replies_len + n > TTY_REPLY_CAP)
+        pthread_cond_wait(&tty->space_ready, &tty->lock);
+    pthread_mutex_unlock(&tty->lock);
+}
+
+// Answers of the parser to queries, dropped rather than waited for
 static
-size_t ring_write(tty_state *tty, const char *src, size_t nbytes)
+void tty_reply(tty_state *tty, const char *s, size_t n)
+{
+    if (!tty_queue(tty, s, n) && tty->pty_master_fd >= 0 && tty->replies_dropped++ == 0)
+        pretty_log(PRETTY_WARN, "The child doesn't read, replies to its queries are dropped");
+}
+
+// Writes as much of the queued replies as the pty takes without blocking
+static
+void tty_flush_replies(tty_state *tty)
+{
+    pthread_mutex_lock(&tty->lock);
+    ssize_t n = write(tty->pty_master_fd, tty->replies, tty->replies_len);
+
+    if (n > 0) {
+        memmove(tty->replies, tty->replies + n, tty->replies_len - n);
+        tty->replies_len -= n;
+        pthread_cond_broadcast(&tty->space_ready);
+    }
+    pthread_mutex_unlock(&tty->lock);
+}
+
+size_t ring_count(const tty_state *tty)
+{
+    return (tty->head - tty->tail) & (tty->cap - 1);
+}
+
+static
+inline size_t ring_high_watermark(const tty_state *tty)
+{
+    return tty->cap / 4 * 3;
+}
+
+static
+inline size_t ring_low_watermark(const tty_state *tty)
+{
+    return tty->cap / 4;
+}
+
+static
+size_t round_pow2(size_t n)
+{
+    size_t p = TTY_RING_MIN_CAP;
+
+    while (p < n && p <= SIZE_MAX / 2) p <<= 1;
+    return p;
+}
+
+// Also opens the pipe the parser wakes the reader through when it has replies or freed space
+bool ring_init(tty_state *tty, size_t cap, size_t max_cap)
 {
-    size_t space = TTY_RING_CAP - 1 - ring_count(tty);
+    tty->min_cap = round_pow2(cap);
+    tty->max_cap = round_pow2(max_cap);
 
-    if (nbytes > space) {
-        // drop excess
-        if (!tty->overwrite_oldest) nbytes = space;
+    if (tty->max_cap < tty->min_cap) tty->max_cap = tty->min_cap;
 
-        // advance tail to free necessary bytes
-        else {
-            size_t fneed = nbytes - space;
-            tty->tail = (tty->tail + fneed) % TTY_RING_CAP;
-        };
+    tty->cap = tty->min_cap;
+    tty->head = tty->tail = 0;
+    tty->buff = counted_malloc(tty->cap);
+    if (tty->buff == NULL) return false;
+
+    if (pipe(tty->wake) < 0) {
+        pretty_log(PRETTY_ERROR, "Couldn't open the reader wake pipe: %s", strerror(errno));
+        counted_free(tty->buff);
+        tty->buff = NULL;
+        return false;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(tty->wake[i], F_SETFL, O_NONBLOCK);
+        fcntl(tty->wake[i], F_SETFD, FD_CLOEXEC);
     }
+    return true;
+}
+
+void ring_free(tty_state *tty)
+{
+    if (tty->buff == NULL) return;
+
+    close(tty->wake[0]);
+    close(tty->wake[1]);
+    counted_free(tty->buff);
+    tty->buff = NULL;
+}
+
+// Caller holds `lock` and made sure no other thread is inside the buffer
+static
+void ring_resize(tty_state *tty, size_t cap)
+{
+    size_t count = ring_count(tty);
+
+    if (cap <= count || cap == tty->cap) return;
+
+    char *buff = counted_malloc(cap);
+    if (buff == NULL) {
+        pretty_log(PRETTY_WARN, "Couldn't resize tty ring to %zu bytes", cap);
+        return;
+    }
+
+    // unwrap the pending bytes at the start of the new buffer
+    size_t first = tty->cap - tty->tail;
+    if (first > count) first = count;
+
+    memcpy(buff, tty->buff + tty->tail, first);
+    memcpy(buff + first, tty->buff, count - first);
+
+    pretty_log(PRETTY_DEBUG, "tty ring resized %zu -> %zu bytes", tty->cap, cap);
+
+    counted_free(tty->buff);
+    tty->buff = buff;
+    tty->cap = cap;
+    tty->tail = 0;
+    tty->head = count;
+}
+
+size_t ring_write(tty_state *tty, const char *src, size_t nbytes)
+{
+    size_t space = tty->cap - 1 - ring_count(tty);
+
+    // the reader never asks for more than fits, unread bytes are never overwritten
+    if (nbytes > space) nbytes = space;
 
     // split copy across end if needed
     size_t first = nbytes;
-    size_t end_space = TTY_RING_CAP - tty->head;
+    size_t end_space = tty->cap - tty->head;
 
     if (first > end_space) first = end_space;
 
     memcpy(tty->buff + tty->head, src, first);
     memcpy(tty->buff, src + first, nbytes - first);
 
-    tty->head = (tty->head + nbytes) % TTY_RING_CAP;
+    tty->head = (tty->head + nbytes) & (tty->cap - 1);
 
     return nbytes;
 }
 
+static
+void tty_wait_for_space(tty_state *tty)
+{
+    if (ring_count(tty) < ring_high_watermark(tty)) return;
+
+    tty->stalls++;
+    pretty_log(PRETTY_DEBUG, "Ring full, pausing reads (stall #%zu)", tty->stalls);
+
+    // sustained throughput, let the parser grow the ring on its next pass
+    if (tty->cap < tty->max_cap) tty->want_cap = tty->cap * 2;
+
+    // stop draining the pty, the kernel throttles the child meanwhile, replies still go out
+    for (size_t cap = tty->cap; !tty->should_exit && cap == tty->cap
+        && ring_count(tty) > ring_low_watermark(tty) && tty->replies_len == 0;)
+        pthread_cond_wait(&tty->space_ready, &tty->lock);
+}
+
+static
+void tty_idle(tty_state *tty)
+{
+    if (++tty->idle_polls < TTY_RING_IDLE_POLLS) return;
+    tty->idle_polls = 0;
+
+    pthread_mutex_lock(&tty->lock);
+    if (tty->cap > tty->min_cap && !tty->parsing) ring_resize(tty, tty->cap / 2);
+    pthread_mutex_unlock(&tty->lock);
+}
+
 static
 bool tty_update(tty_state *tty)
 {
-    struct pollfd pfd = { .fd = tty->pty_master_fd, .events = POLLIN };
-    int ret = poll(&pfd, 1, 100);
+    struct iovec iov[2];
+
+    pthread_mutex_lock(&tty->lock);
+    tty_wait_for_space(tty);
+
+    // woken for replies while the ring is still full, write them without reading
+    bool paused = ring_count(tty) >= ring_high_watermark(tty);
+    bool replies = tty->replies_len > 0;
+
+    // read straight into the free part of the ring, which may wrap around
+    size_t space = tty->cap - 1 - ring_count(tty);
+    size_t first = tty->cap - tty->head;
+
+    if (first > space) first = space;
+
+    iov[0] = (struct iovec){ tty->buff + tty->head, first };
+    iov[1] = (struct iovec){ tty->buff, space - first };
+    tty->reading = true;
+    pthread_mutex_unlock(&tty->lock);
+
+    bool alive = true;
+
+    if (tty->should_exit) goto done;
+
+    struct pollfd pfds[2] = {
+        { .fd = tty->pty_master_fd, .events = (paused ? 0 : POLLIN) | (replies ? POLLOUT : 0) },
+        { .fd = tty->wake[0], .events = POLLIN },
+    };
+
+    trace_span span = trace_begin("tty_poll");
+    int ret = poll(pfds, 2, 100);
+    trace_end(&span);
 
     if (ret < 0) {
-        if (errno == EINTR) return true;
-        perror("poll");
-        return false;
+        if (errno != EINTR) (perror("poll"), alive = false);
+        goto done;
     }
 
-    if (ret == 0) return true;
+    if (pfds[1].revents & POLLIN) {
+        char drain[64];
+        while (read(tty->wake[0], drain, sizeof drain) > 0);
+    }
 
-    if (pfd.revents & (POLLHUP | POLLERR)) {
-        pretty_log(PRETTY_INFO, "TTY(%d) hangup or error", tty->pty_master_fd);
-        return false;
+    if (pfds[0].revents & POLLOUT) tty_flush_replies(tty);
+
+    // a hangup is only acted on once the ring has room for what the child left
+    if (paused && (pfds[0].revents & (POLLHUP | POLLERR)) && !(pfds[0].revents & POLLIN)) {
+        pthread_mutex_lock(&tty->lock);
+        tty->replies_len = 0;
+        tty->reading = false;
+        pthread_cond_broadcast(&tty->space_ready);
+        pthread_mutex_unlock(&tty->lock);
+        return true;
     }
 
-    if (pfd.revents & POLLIN) {
-        char temp[TTY_RING_CAP];
-        ssize_t n = read(tty->pty_master_fd, temp, sizeof temp);
+    if ((pfds[0].revents & ~POLLOUT) == 0) {
+        pthread_mutex_lock(&tty->lock);
+        tty->reading = false;
+        pthread_mutex_unlock(&tty->lock);
+
+        if (ret == 0) tty_idle(tty);
+        return true;
+    }
+
+    // drain what the child wrote before it hung up
+    if (pfds[0].revents & POLLIN) {
+        span = trace_begin("tty_read");
+        ssize_t n = readv(tty->pty_master_fd, iov, iov[1].iov_len ? 2 : 1);
+        trace_end(&span);
 
         if (n > 0) {
-            pthread_mutex_lock(&tty->lock);
+            span = trace_begin("ring_write");
 
-            size_t wrote = ring_write(tty, temp, (size_t)n);
+            // the bytes are still private to the reader until `head` moves
+            size_t in_first = (size_t)n < iov[0].iov_len ? (size_t)n : iov[0].iov_len;
 
-            if (wrote < (size_t)n)
-                pretty_log(PRETTY_DEBUG, "Ring %s: replaced %zu oldest bytes",
-                           tty->overwrite_oldest ? "Overwrite" : "Dropped",
-                           (size_t)n - wrote);
+            record_event(tty->recording, RECORD_OUTPUT, iov[0].iov_base, in_first);
+            if ((size_t)n > in_first)
+                record_event(tty->recording, RECORD_OUTPUT, iov[1].iov_base, n - in_first);
+
+            pthread_mutex_lock(&tty->lock);
 
-            if (!tty->buff_changed) (tty->buff_changed = true, notify_ui_flush());
+            tty->head = (tty->head + n) & (tty->cap - 1);
+            tty->bytes_read += n;
+            tty->reading = false;
+            tty->idle_polls = 0;
+
+            if (!tty->buff_changed) {
+                tty->buff_changed = true;
+                pthread_cond_signal(&tty->data_ready);
+            }
 
             pthread_mutex_unlock(&tty->lock);
-        } else if (n < 0 && errno == EIO) perror("read");
+            trace_end(&span);
+            return true;
+        }
+
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) goto done;
     }
 
-    return true;
+    pretty_log(PRETTY_INFO, "TTY(%d) hangup or error", tty->pty_master_fd);
+    alive = false;
+
+done:
+    pthread_mutex_lock(&tty->lock);
+    tty->reading = false;
+    pthread_mutex_unlock(&tty->lock);
+
+    return alive;
 }
 
 void *tty_poll_loop(void *arg)
 {
     tty_state *tty = arg;
 
-    while (!tty->should_exit) {
+    trace_thread_name("tty reader");
+    while (!tty->should_exit)
         if ((tty->child_exited = !tty_update(tty))) break;
 
-        pthread_mutex_lock(&tty->lock);
-        if (tty->buff_changed && tty->tail < tty->head) {
-            notify_ui_flush();
-            tty->buff_changed = false;
+    // nothing writes queued bytes anymore, whoever waits for room gives up
+    pthread_mutex_lock(&tty->lock);
+    pthread_cond_broadcast(&tty->space_ready);
+    pthread_mutex_unlock(&tty->lock);
+
+    // let the ui notice the hangup even if the parser has nothing left to publish
+    notify_ui_flush(tty->window_id);
+    return NULL;
+}
+
+static
+void wait_until(tty_state *tty, uint64_t deadline)
+{
+    uint64_t now_ns = trace_now_ns();
+    if (deadline <= now_ns) return;
+
+    // the condition variable waits on the realtime clock
+    uint64_t wake = deadline - now_ns;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    wake += ts.tv_nsec;
+    ts.tv_sec += wake / 1000000000ULL;
+    ts.tv_nsec = wake % 1000000000ULL;
+
+    pthread_cond_timedwait(&tty->data_ready, &tty->lock, &ts);
+}
+
+// Bytes go to the tmux panes while control mode is on, to the screen otherwise
+static
+size_t tty_feed(tty_state *tty, const char *p, size_t n)
+{
+    if (tty->tmux != NULL && tmux_active(tty->tmux)) return tmux_feed(tty->tmux, tty, p, n);
+
+    size_t used = screen_feed(tty->screen, p, n);
+
+    if (tty->screen->control_mode) {
+        tty->screen->control_mode = false;
+        if (tty->tmux != NULL) tmux_start(tty->tmux, tty);
+    }
+    return used;
+}
+
+// Only the parser calls this, or another thread holding `lock` while the ring is drained
+bool tty_publish(tty_state *tty)
+{
+    if (tty->tmux != NULL && tmux_active(tty->tmux)) return tmux_publish(tty->tmux);
+    return screen_publish(tty->screen);
+}
+
+// The earliest held synchronized update among the screens `tty_publish` publishes
+static
+bool tty_sync_deadline(tty_state *tty, uint64_t *deadline)
+{
+    if (tty->tmux != NULL && tmux_active(tty->tmux)) return tmux_sync_deadline(tty->tmux, deadline);
+    return screen_sync_deadline(tty->screen, deadline);
+}
+
+void *tty_parse_loop(void *arg)
+{
+    tty_state *tty = arg;
+    const char *p;
+    uint64_t deadline;
+    uint64_t last_publish = 0;
+    trace_span span;
+
+    trace_thread_name("tty parser");
+    pthread_mutex_lock(&tty->lock);
+    while (!tty->should_exit) {
+        if (!tty->buff_changed) {
+            // a synchronized update is flushed even if the closing sequence never comes
+            if (!tty_sync_deadline(tty, &deadline))
+                pthread_cond_wait(&tty->data_ready, &tty->lock);
+            else {
+                wait_until(tty, deadline);
+                if (tty_publish(tty)) notify_ui_flush(tty->window_id);
+            }
+            continue;
+        }
+
+        tty->buff_changed = false;
+
+        for (size_t n; (n = ring_read_span(tty, &p)) > 0;) {
+            size_t backlog = ring_count(tty);
+
+            // the reader only appends to free space, so the span stays valid unlocked
+            tty->parsing = true;
+            pthread_mutex_unlock(&tty->lock);
+            span = trace_begin("screen_feed");
+            size_t used = tty_feed(tty, p, n);
+            trace_end(&span);
+
+            if (tty->screen->reply_len > 0) {
+                tty_reply(tty, tty->screen->reply, tty->screen->reply_len);
+                tty->screen->reply_len = 0;
+            }
+
+            // during a flood, parse ahead and only publish at the display rate
+            uint64_t now = trace_now_ns();
+
+            bool publish = backlog - used <= ring_low_watermark(tty)
+                || now - last_publish >= TTY_FRAME_INTERVAL_MS * 1000000ULL;
+
+            if (publish) {
+                span = trace_begin("screen_publish");
+                if (tty_publish(tty)) notify_ui_flush(tty->window_id);
+                trace_end(&span);
+                last_publish = now;
+            }
+
+            pthread_mutex_lock(&tty->lock);
+            if (!publish) tty->frames_skipped++;
+            ring_consume(tty, used);
+            tty->parsing = false;
+
+            if (tty->want_cap > tty->cap && !tty->reading) {
+                ring_resize(tty, tty->want_cap);
+                pthread_cond_signal(&tty->space_ready);
+            }
+
+            if (ring_count(tty) <= ring_low_watermark(tty))
+                pthread_cond_signal(&tty->space_ready);
         }
-        pthread_mutex_unlock(&tty->lock);
     }
+    pthread_mutex_unlock(&tty->lock);
     return NULL;
 }
 
+void tty_wait_drained(tty_state *tty)
+{
+    pthread_mutex_lock(&tty->lock);
+
+    while (!tty->should_exit && (tty->parsing || ring_count(tty) > 0))
+        pthread_cond_wait(&tty->space_ready, &tty->lock);
+
+    pthread_mutex_unlock(&tty->lock);
+}
+
+void tty_resize(tty_state *tty, int cols, int rows)
+{
+    struct winsize ws = { .ws_row = rows, .ws_col = cols };
+    unsigned char size[4] = { cols & 0xFF, cols >> 8, rows & 0xFF, rows >> 8 };
+
+    if (tty->pty_master_fd < 0) return;
+    record_event(tty->recording, RECORD_RESIZE, size, sizeof(size));
+
+    if (ioctl(tty->pty_master_fd, TIOCSWINSZ, &ws) < 0)
+        pretty_log(PRETTY_WARN, "Couldn't set tty size: %s", strerror(errno));
+}
+
+// Queues bytes for the parser as if they came from the pty, used by replays
+size_t tty_push(tty_state *tty, const char *s, size_t n)
+{
+    pthread_mutex_lock(&tty->lock);
+    tty_wait_for_space(tty);
+
+    n = tty->should_exit ? 0 : ring_write(tty, s, n);
+    tty->bytes_read += n;
+
+    if (n > 0 && !tty->buff_changed) {
+        tty->buff_changed = true;
+        pthread_cond_signal(&tty->data_ready);
+    }
+
+    pthread_mutex_unlock(&tty->lock);
+    return n;
+}
 
 size_t ring_read_span(const tty_state *tty, const char **ptr)
 {
@@ -244,7 +711,7 @@ size_t ring_read_span(const tty_state *tty, const char **ptr)
 
     size_t end_contig = (tty->head >= tty->tail)
         ? (tty->head - tty->tail)
-        : (TTY_RING_CAP - tty->tail);
+        : (tty->cap - tty->tail);
 
     *ptr = tty->buff + tty->tail;
     return end_contig;
@@ -255,5 +722,5 @@ void ring_consume(tty_state *tty, size_t k)
     size_t cont = ring_count(tty);
     if (k > cont) k = cont;
 
-    tty->tail = (tty->tail + k) % TTY_RING_CAP;
+    tty->tail = (tty->tail + k) & (tty->cap - 1);
 }
@@ -14,31 +14,82 @@ enum term_mode {
     MODE_ECHO        = 1 << 4,
     MODE_PRINT       = 1 << 5,
     MODE_UTF8        = 1 << 6,
+    MODE_HIDE        = 1 << 7,
+    MODE_SYNC        = 1 << 8,
 };
 
-enum { TTY_RING_CAP = 64 * 1024 };
+enum {
+    TTY_RING_MIN_CAP = 4 * 1024,
+    TTY_RING_DEFAULT_CAP = 16 * 1024,
+    TTY_RING_DEFAULT_MAX_CAP = 4 * 1024 * 1024,
+    TTY_RING_IDLE_POLLS = 10,
+    TTY_FRAME_INTERVAL_MS = 16,
+    TTY_REPLY_CAP = 64 * 1024, // answers the child hasn't read yet, more are dropped
+    TTY_CHILDREN_MAX = 64, // shells the SIGCHLD handler keeps track of
+};
+
+struct screen;
+struct recording;
+struct tmux_client;
 
 typedef struct {
     int pty_master_fd;
 
-    char buff[TTY_RING_CAP]; /* TODO: think about this */
+    /* ring buffer, `cap` is always a power of two */
+    char *buff;
+    size_t cap;
+    size_t min_cap;
+    size_t max_cap;
+    size_t want_cap;
     size_t head;
     size_t tail;
-    size_t scroll_tail;
+
+    /* set while a thread touches `buff` outside of `lock` */
+    bool reading;
+    bool parsing;
+    unsigned int idle_polls;
+
+    struct screen *screen;
+    unsigned int window_id;
+    struct recording *recording;
+    struct tmux_client *tmux; // takes the bytes over while tmux -CC runs
+
+    /* answers of the parser to queries, written by the reader once the pty takes them */
+    char replies[TTY_REPLY_CAP];
+    size_t replies_len;
+    size_t replies_dropped;
+    int wake[2]; // a byte in the pipe gets the reader out of poll
 
     pthread_t thread;
+    pthread_t parser;
     pthread_mutex_t lock;
+    pthread_cond_t data_ready;
+    pthread_cond_t space_ready;
 
     bool child_exited;
     bool buff_changed;
     bool should_exit;
 
-    bool overwrite_oldest;
+    size_t stalls;
+    size_t bytes_read;
+    size_t frames_skipped;
 } tty_state;
 
 int tty_new(char *args[static 1]);
+void tty_reap_children(void);
 void *tty_poll_loop(void *arg);
+void *tty_parse_loop(void *arg);
+void tty_resize(tty_state *tty, int cols, int rows);
+void tty_wait_drained(tty_state *tty);
+bool tty_publish(tty_state *tty);
 void tty_write(tty_state *tty, const char *s, size_t n);
+bool tty_queue(tty_state *tty, const char *s, size_t n);
+void tty_wait_queue(tty_state *tty, size_t n);
+size_t tty_push(tty_state *tty, const char *s, size_t n);
+bool ring_init(tty_state *tty, size_t cap, size_t max_cap);
+void ring_free(tty_state *tty);
+size_t ring_count(const tty_state *tty);
+size_t ring_write(tty_state *tty, const char *src, size_t nbytes);
 size_t ring_read_span(const tty_state *tty, const char **ptr);
 void ring_consume(tty_state *tty, size_t k);
 
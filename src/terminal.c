@@ -0,0 +1,627 @@
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "SDL3/SDL_clipboard.h"
+#include "SDL3/SDL_events.h"
+#include "SDL3/SDL_keycode.h"
+#include "macro_utils.h"
+#include "terminal.h"
+#include "log.h"
+
+static
+void thread_join(pthread_t thread)
+{
+    pretty_log(PRETTY_DEBUG, "waiting for thread [%lu] to exit", thread);
+
+    void *res;
+    int s = pthread_join(thread, &res);
+
+    if (s != 0) pretty_log(PRETTY_ERROR, "pthread_join failed");
+    else pretty_log(PRETTY_DEBUG, "thread [%lu] exited cleanly", thread);
+}
+
+static
+void thread_handle_quit(tty_state *tty)
+{
+    pthread_mutex_lock(&tty->lock);
+    tty->should_exit = true;
+    pthread_cond_broadcast(&tty->data_ready);
+    pthread_cond_broadcast(&tty->space_ready);
+    pthread_mutex_unlock(&tty->lock);
+
+    thread_join(tty->thread);
+    thread_join(tty->parser);
+
+    pretty_log(PRETTY_DEBUG, "tty reads stalled %zu times on a full ring", tty->stalls);
+}
+
+static
+void bench_report(tty_state *tty, Uint64 start, size_t frames)
+{
+    double secs = (double)(SDL_GetTicksNS() - start) / 1e9;
+    double mib = (double)tty->bytes_read / (1024 * 1024);
+
+    pretty_log(PRETTY_INFO,
+        "bench: %zu bytes in %.3fs (%.2f MB/s), %zu frames rendered, %zu skipped",
+        tty->bytes_read, secs, mib / secs, frames, tty->frames_skipped);
+}
+
+// Opens the child, or the replay, and starts the reader and parser threads
+static
+bool terminal_start_tty(terminal *term)
+{
+    const terminal_options *opts = term->opts;
+    generic_config *config = term->shared->config;
+
+    // benchmark mode measures how fast a file can be pushed through the terminal
+    char **command = (opts->bench_file != NULL)
+        ? (char *[]){ "cat", opts->bench_file, NULL }
+        : (char *[]){ "/bin/sh", NULL };
+
+    // a replay feeds a recorded session instead of spawning a child
+    if (opts->replay_file != NULL && !replay_open(&term->rec, opts->replay_file, opts->fast))
+        return false;
+    if (opts->record_file != NULL && opts->replay_file == NULL
+        && !record_open(&term->rec, opts->record_file))
+        return false;
+
+    // --control without a path listens in $XDG_RUNTIME_DIR
+    if (opts->control_socket) control_open(&term->ctl, opts->control_path, &term->stats);
+
+    term->start = SDL_GetTicksNS();
+    term->tty = (tty_state){
+        .pty_master_fd = (opts->replay_file != NULL) ? -1 : tty_new(command),
+        .screen = &term->scr,
+        .window_id = SDL_GetWindowID(term->win),
+        .recording = (term->rec.file != NULL) ? &term->rec : NULL,
+        .tmux = &term->tmux,
+        .buff_changed = false,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .data_ready = PTHREAD_COND_INITIALIZER,
+        .space_ready = PTHREAD_COND_INITIALIZER,
+        .child_exited = false
+    };
+
+    if (!ring_init(&term->tty, config->buffer_size, config->buffer_max_size)) {
+        pretty_log(PRETTY_ERROR, "Failed to allocate the tty buffer");
+        return false;
+    }
+
+    if (pthread_create(&term->tty.thread, NULL,
+            (opts->replay_file != NULL) ? tty_replay_loop : tty_poll_loop, &term->tty) != 0)
+        return false;
+
+    if (pthread_create(&term->tty.parser, NULL, tty_parse_loop, &term->tty) != 0) {
+        pthread_mutex_lock(&term->tty.lock);
+        term->tty.should_exit = true;
+        pthread_cond_broadcast(&term->tty.space_ready);
+        pthread_mutex_unlock(&term->tty.lock);
+
+        thread_join(term->tty.thread);
+        return false;
+    }
+
+    // stats are served from here on, a replay included
+    if (term->ctl.listen_fd >= 0) control_start(&term->ctl, &term->tty);
+    return true;
+}
+
+// Returns the index of the glyph cache baked for `scale`, baking it on first use
+static
+int shared_glyphs(shared_resources *shared, float scale)
+{
+    int closest = -1;
+
+    for (int i = 0; i < shared->nglyphs; i++) {
+        float diff = SDL_fabsf(shared->glyphs[i]->scale - scale);
+
+        if (diff < 0.01f) return i;
+        if (closest < 0 || diff < SDL_fabsf(shared->glyphs[closest]->scale - scale)) closest = i;
+    }
+
+    if (shared->nglyphs < GLYPH_SCALES_MAX) {
+        glyph_cache *cache = create_glyph_cache(shared->font.ttf, scale, shared->config);
+
+        if (cache != NULL) {
+            shared->glyphs[shared->nglyphs] = cache;
+            return shared->nglyphs++;
+        }
+    }
+
+    // out of variants, text is drawn at the nearest scale already baked
+    if (closest >= 0)
+        pretty_log(PRETTY_WARN, "No glyphs for scale %.2f, using %.2f",
+            scale, shared->glyphs[closest]->scale);
+    return closest;
+}
+
+// Switches to the atlas matching the display the window is on
+static
+bool terminal_set_scale(terminal *term)
+{
+    float scale = SDL_GetWindowPixelDensity(term->win);
+    int i = shared_glyphs(term->shared, (scale > 0) ? scale : 1.0f);
+
+    if (i < 0) return false;
+
+    // the GL renderer keeps a single atlas, uploaded again on a scale change
+    if (term->gl != NULL) {
+        term->atlas = gl_set_glyphs(term->gl, term->shared->glyphs[i]);
+        return term->atlas != NULL;
+    }
+    if (term->atlas != NULL && term->atlas == term->atlases[i]) return true;
+
+    if (term->atlases[i] == NULL) term->atlases[i] = create_atlas(term->renderer, term->shared->glyphs[i]);
+    if (term->atlases[i] == NULL) {
+        pretty_log(PRETTY_ERROR, "Failed to upload glyph atlas");
+        return false;
+    }
+
+    term->atlas = term->atlases[i];
+    pretty_log(PRETTY_INFO, "Window drawn at scale %.2f", term->atlas->cache->scale);
+
+    // every row has to be drawn again with the new glyphs
+    frame_destroy(&term->frame);
+    return true;
+}
+
+static
+void terminal_atlases_destroy(terminal *term)
+{
+    for (int i = 0; i < GLYPH_SCALES_MAX; i++) atlas_destroy(term->atlases[i]);
+}
+
+static
+struct dim terminal_grid(terminal *term)
+{
+    glyph_cache *cache = term->atlas->cache;
+
+    return grid_size(term->pixel_size, &cache->font, term->shared->config, cache->scale);
+}
+
+terminal *terminal_open(shared_resources *shared, const terminal_options *opts)
+{
+    generic_config *config = shared->config;
+    terminal *term = calloc(1, sizeof *term);
+
+    if (term == NULL) return NULL;
+
+    term->opts = opts;
+    term->shared = shared;
+    term->ctl.listen_fd = -1;
+    tmux_init(&term->tmux);
+    term->win_size = (struct dim){ SCREEN_WIDTH, SCREEN_HEIGHT };
+
+    SDL_WindowFlags flags = SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY | SDL_WINDOW_TRANSPARENT;
+
+    if (opts->gl) flags |= gl_window_flags();
+
+    term->win = SDL_CreateWindow("Pretty", term->win_size.width, term->win_size.height, flags);
+    if (term->win == NULL) {
+        pretty_log(PRETTY_ERROR, "Couldn't create window: %s", SDL_GetError());
+        goto fail;
+    }
+
+    if (opts->gl && (term->gl = gl_renderer_create(term->win)) == NULL)
+        pretty_log(PRETTY_WARN, "OpenGL unavailable, falling back to the SDL renderer");
+
+    if (term->gl == NULL) {
+        term->renderer = SDL_CreateRenderer(term->win, NULL);
+        if (term->renderer == NULL) {
+            pretty_log(PRETTY_ERROR, "Couldn't create renderer: %s", SDL_GetError());
+            goto fail_window;
+        }
+        SDL_SetRenderDrawColor(term->renderer,
+            RGBA_SPLIT(config->color_palette[COLOR_BACKGROUND]));
+    }
+
+    SDL_GetWindowSizeInPixels(term->win, &term->pixel_size.width, &term->pixel_size.height);
+    if (!terminal_set_scale(term)) goto fail_atlas;
+
+    atomic_store(&term->stats.atlas_capacity, (int)GLYPH_SLOTS);
+
+    if (!screen_init(&term->scr, 80, 24, SCREEN_HISTORY_CAP)) {
+        pretty_log(PRETTY_ERROR, "Failed to allocate screen");
+        goto fail_atlas;
+    }
+    term->scr.urls = &shared->urls;
+    term->tmux.urls = &shared->urls;
+
+    if (!terminal_start_tty(term)) goto fail_screen;
+
+    // replays keep the grid size that was recorded
+    struct dim grid = terminal_grid(term);
+    if (opts->replay_file == NULL) {
+        screen_resize(&term->scr, grid.width, grid.height);
+        tty_resize(&term->tty, grid.width, grid.height);
+        tmux_resize(&term->tmux, &term->tty, grid.width, grid.height);
+    }
+    screen_publish(&term->scr);
+    return term;
+
+fail_screen:
+    ring_free(&term->tty);
+    record_close(&term->rec);
+    control_close(&term->ctl);
+    tmux_free(&term->tmux);
+    screen_destroy(&term->scr);
+fail_atlas:
+    terminal_atlases_destroy(term);
+    gl_renderer_destroy(term->gl);
+    if (term->renderer != NULL) SDL_DestroyRenderer(term->renderer);
+fail_window:
+    SDL_DestroyWindow(term->win);
+fail:
+    free(term);
+    return NULL;
+}
+
+void terminal_close(terminal *term)
+{
+    control_close(&term->ctl);
+    thread_handle_quit(&term->tty);
+    clip_detach(&term->clip);
+
+    // hangs up on the child if it is still running
+    if (term->tty.pty_master_fd >= 0) close(term->tty.pty_master_fd);
+
+    frame_destroy(&term->frame);
+    terminal_atlases_destroy(term);
+    ring_free(&term->tty);
+    record_close(&term->rec);
+    tmux_free(&term->tmux);
+    screen_destroy(&term->scr);
+    gl_renderer_destroy(term->gl);
+    if (term->renderer != NULL) SDL_DestroyRenderer(term->renderer);
+    SDL_DestroyWindow(term->win);
+    free(term);
+}
+
+static
+void stats_row_cache(render_stats *stats, const row_cache *cache)
+{
+    atomic_store_explicit(&stats->row_cache_hits, cache->hits, memory_order_relaxed);
+    atomic_store_explicit(&stats->row_cache_misses, cache->misses, memory_order_relaxed);
+    atomic_store_explicit(&stats->row_cache_evictions, cache->evictions, memory_order_relaxed);
+    atomic_store(&stats->row_cache_rows, cache->count);
+    atomic_store(&stats->row_cache_capacity, cache->cap);
+}
+
+// The screen the window shows, the active tmux pane while tmux -CC runs
+static
+screen *terminal_screen(terminal *term)
+{
+    screen *pane = tmux_shown(&term->tmux);
+
+    return (pane != NULL) ? pane : &term->scr;
+}
+
+// Input for the child, through tmux when it draws the panes itself
+static
+void terminal_input(terminal *term, const char *s, size_t n)
+{
+    if (tmux_active(&term->tmux)) tmux_send_keys(&term->tmux, &term->tty, s, n);
+    else tty_write(&term->tty, s, n);
+}
+
+static
+bool terminal_render(terminal *term, bool only_fresh)
+{
+    shared_resources *shared = term->shared;
+    screen *scr = terminal_screen(term);
+    bool fresh;
+    const screen_snapshot *snap = screen_acquire(scr, &fresh);
+
+    // another screen came up, what it published earlier was never drawn
+    if (scr != term->shown) {
+        term->shown = scr;
+        only_fresh = false;
+    }
+    term->snap = snap;
+
+    // the parser may have been overtaken by a resize or scroll
+    if (only_fresh && !fresh) return true;
+    if (term->opts->no_render) return true;
+
+    Uint64 frame_start = SDL_GetTicksNS();
+
+    if (term->gl != NULL) {
+        if (!gl_render_frame(term->gl, term->pixel_size, snap, shared->config)) return false;
+    } else {
+        if (!atlas_sync(term->atlas)) return false;
+        if (!render_frame(term->renderer, term->atlas, &term->frame, term->pixel_size, snap,
+                &term->atlas->cache->font, shared->config))
+            return false;
+        stats_row_cache(&term->stats, &term->frame.cache);
+    }
+
+    atomic_store(&term->stats.atlas_glyphs, term->atlas->cache->baked);
+    term->last_frame = SDL_GetTicksNS();
+    render_stats_frame(&term->stats, term->last_frame - frame_start);
+
+    if (SDL_GetKeyboardFocus() == term->win) display_fps_metrics(term->win);
+    return true;
+}
+
+// Ctrl+Shift shortcuts over the scrollback and the selection
+static
+bool terminal_shortcut(terminal *term, SDL_Keycode key)
+{
+    screen *scr = terminal_screen(term);
+
+    switch (key) {
+        case SDLK_UP:
+        case SDLK_DOWN:
+            if (screen_jump_prompt(scr, (key == SDLK_UP) ? -1 : 1)) {
+                screen_publish(scr);
+                term->redraw = true;
+            }
+            return true;
+        // the next or previous tmux pane, tmux tells which one became active
+        case SDLK_LEFT:
+        case SDLK_RIGHT:
+            if (!tmux_active(&term->tmux)) return false;
+
+            tmux_select_pane(&term->tmux, &term->tty, (key == SDLK_LEFT) ? -1 : 1);
+            return true;
+        case SDLK_A:
+            screen_select_all(scr);
+            screen_publish(scr);
+            term->redraw = true;
+            return true;
+        case SDLK_C:
+            clip_copy(scr, &term->clip);
+            return true;
+        // the output of the last command, found through the OSC 133 marks of the shell
+        case SDLK_O:
+            if (!screen_select_output(scr)) return true;
+
+            screen_publish(scr);
+            term->redraw = true;
+            clip_copy(scr, &term->clip);
+            return true;
+        default:
+            return false;
+    }
+}
+
+static
+void terminal_key(terminal *term, const SDL_KeyboardEvent *key)
+{
+    SDL_Keymod mod = SDL_GetModState();
+
+    if ((mod & SDL_KMOD_CTRL) && (mod & SDL_KMOD_SHIFT) && terminal_shortcut(term, key->key)) return;
+
+    if (mod & SDL_KMOD_LCTRL) switch (key->key) {
+        case SDLK_C:
+            terminal_input(term, "\x03", 1);
+            break;
+        case SDLK_D:
+            terminal_input(term, "\x04", 1);
+            break;
+        case SDLK_Z:
+            terminal_input(term, "\x1A", 1);
+            break;
+        default:
+            pretty_log(PRETTY_DEBUG, "unhandled key combination: LCtrl+%s",
+                    SDL_GetKeyName(key->key));
+            break;
+    }
+
+    else if (key->key <= UCHAR_MAX && isprint(key->key))
+        terminal_input(term, (const char *)&key->key, sizeof(char));
+
+    else if (key->key == SDLK_RETURN)
+        terminal_input(term, "\r", length_of("\r"));
+
+    else if (key->key == SDLK_BACKSPACE)
+        terminal_input(term, "\x7f", 1);
+
+    else pretty_log(PRETTY_DEBUG, "unhandled key: %s", SDL_GetKeyName(key->key));
+}
+
+// Picks up the new pixel size and scale, then fits the grid to them
+static
+bool terminal_resize(terminal *term)
+{
+    SDL_GetWindowSizeInPixels(term->win, &term->pixel_size.width, &term->pixel_size.height);
+    if (!terminal_set_scale(term)) return false;
+
+    if (term->opts->replay_file == NULL) {
+        struct dim grid = terminal_grid(term);
+
+        screen_resize(&term->scr, grid.width, grid.height);
+        tty_resize(&term->tty, grid.width, grid.height);
+        tmux_resize(&term->tmux, &term->tty, grid.width, grid.height);
+        screen_publish(&term->scr);
+    }
+    return terminal_render(term, false);
+}
+
+// True when glyphs the last frame had to leave blank may have been rasterised since
+static
+bool terminal_needs_glyphs(const terminal *term)
+{
+    if (term->gl != NULL) return gl_needs_glyphs(term->gl);
+    return frame_needs_glyphs(&term->frame, term->atlas);
+}
+
+// The cell under a point of the window, it may be outside the grid
+static
+void terminal_cell_at(terminal *term, float x, float y, int *col, int *row)
+{
+    glyph_cache *cache = term->atlas->cache;
+    generic_config *config = term->shared->config;
+    float density = SDL_GetWindowPixelDensity(term->win);
+
+    *col = (int)SDL_floorf((x * density - (int)(config->pad_x * cache->scale)) / cache->font.advance);
+    *row = (int)SDL_floorf((y * density - (int)(config->pad_y * cache->scale)) / cache->font.line_skip);
+}
+
+// A left click starts a selection, dragging moves its other end
+static
+void terminal_select(terminal *term, float x, float y, bool extend)
+{
+    screen *scr = terminal_screen(term);
+    int col, row;
+
+    terminal_cell_at(term, x, y, &col, &row);
+    screen_select(scr, col, row, extend);
+    screen_publish(scr);
+    term->redraw = true;
+}
+
+// The link at a cell of the last frame, sent with OSC 8 or found in the text of its row
+static
+bool terminal_link_at(terminal *term, int col, int row, uint16_t *link, url_span *span)
+{
+    const screen_snapshot *snap = term->snap;
+
+    if (snap == NULL || term->shown != terminal_screen(term)) return false;
+    if (col < 0 || row < 0 || col >= snap->cols || row >= snap->rows) return false;
+
+    const cell *cells = snap->cells + (size_t)row * snap->cols;
+
+    *link = snap->attrs[cells[col].attr].link;
+    if (*link != 0) return true;
+
+    return url_find(&term->shared->urls, snap->text_hash[row], cells, snap->cols, col, span);
+}
+
+// Underlines the link under the mouse, only the rows it crosses are drawn again
+static
+void terminal_hover(terminal *term, float x, float y, bool inside)
+{
+    screen *scr = terminal_screen(term);
+    uint16_t link = 0;
+    url_span span = { 0, 0 };
+    int col = -1, row = -1;
+
+    if (inside) {
+        terminal_cell_at(term, x, y, &col, &row);
+        terminal_link_at(term, col, row, &link, &span);
+    }
+
+    if (screen_hover(scr, row, span.from, span.to, link)) {
+        screen_publish(scr);
+        term->redraw = true;
+    }
+}
+
+// Ctrl+click opens the link under the mouse, returns false when there is none
+static
+bool terminal_open_link(terminal *term, float x, float y)
+{
+    uint16_t link = 0;
+    url_span span = { 0, 0 };
+    int col, row;
+
+    terminal_cell_at(term, x, y, &col, &row);
+    if (!terminal_link_at(term, col, row, &link, &span)) return false;
+
+    char *uri = (link != 0)
+        ? screen_link_uri(term->shown, link)
+        : url_target(term->snap->cells + (size_t)row * term->snap->cols, term->snap->cols, span);
+
+    if (uri == NULL) return false;
+
+    pretty_log(PRETTY_INFO, "Opening [%s]", uri);
+    if (!SDL_OpenURL(uri)) pretty_log(PRETTY_WARN, "Couldn't open [%s]: %s", uri, SDL_GetError());
+    counted_free(uri);
+    return true;
+}
+
+static
+void terminal_wheel(terminal *term, float y)
+{
+    screen *scr = terminal_screen(term);
+
+    if (y > 0) calculate_scroll(scr, SCROLL_UP);
+    else if (y < 0) calculate_scroll(scr, SCROLL_DOWN);
+
+    screen_publish(scr);
+}
+
+// Returns false once the window should be closed
+bool terminal_handle_event(terminal *term, const SDL_Event *event)
+{
+    switch (event->type) {
+        case SDL_EVENT_WINDOW_CLOSE_REQUESTED:
+            return false;
+        case SDL_EVENT_WINDOW_RESIZED:
+            term->win_size.width = event->window.data1;
+            term->win_size.height = event->window.data2;
+            pretty_log(PRETTY_INFO, "Window resized: %dx%d",
+                    term->win_size.width, term->win_size.height);
+            return terminal_resize(term);
+        // moving to a display with another scale changes the pixel size, not the window size
+        case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
+        case SDL_EVENT_WINDOW_DISPLAY_SCALE_CHANGED:
+            return terminal_resize(term);
+        case SDL_EVENT_WINDOW_EXPOSED:
+            return terminal_render(term, false);
+        case SDL_EVENT_KEY_DOWN:
+            terminal_key(term, &event->key);
+            return true;
+        case SDL_EVENT_MOUSE_WHEEL:
+            terminal_wheel(term, event->wheel.y);
+            return terminal_render(term, false);
+        case SDL_EVENT_MOUSE_BUTTON_DOWN:
+            if (event->button.button != SDL_BUTTON_LEFT) return true;
+
+            bool ctrl = SDL_GetModState() & SDL_KMOD_CTRL;
+
+            if (!ctrl || !terminal_open_link(term, event->button.x, event->button.y))
+                terminal_select(term, event->button.x, event->button.y, false);
+            return true;
+        case SDL_EVENT_MOUSE_MOTION:
+            if (event->motion.state & SDL_BUTTON_LMASK)
+                terminal_select(term, event->motion.x, event->motion.y, true);
+            else terminal_hover(term, event->motion.x, event->motion.y, true);
+            return true;
+        case SDL_EVENT_WINDOW_MOUSE_LEAVE:
+            terminal_hover(term, 0, 0, false);
+            return true;
+        // coalesced with the other updates of this frame, see terminal_update
+        case SDL_EVENT_USER:
+            term->redraw = true;
+            return true;
+        default:
+            return true;
+    }
+}
+
+// Returns false once the child is gone and the window should be closed
+bool terminal_update(terminal *term)
+{
+    const terminal_options *opts = term->opts;
+
+    bool glyphs = terminal_needs_glyphs(term);
+
+    if ((term->redraw || glyphs) && terminal_timeout(term, SDL_GetTicksNS()) == 0) {
+        term->redraw = false;
+        if (!terminal_render(term, !glyphs)) return false;
+    }
+
+    if (!term->tty.child_exited) return true;
+
+    if (opts->bench_file != NULL || opts->replay_file != NULL) {
+        tty_wait_drained(&term->tty);
+        terminal_render(term, false);
+        bench_report(&term->tty, term->start, atomic_load(&term->stats.frames_rendered));
+    }
+    return false;
+}
+
+// Milliseconds until this window wants its next frame, -1 when it has nothing to draw
+Sint32 terminal_timeout(const terminal *term, Uint64 now)
+{
+    if (!term->redraw && !terminal_needs_glyphs(term)) return -1;
+
+    Uint64 due = term->last_frame + TTY_FRAME_INTERVAL_MS * SDL_NS_PER_MS;
+    return (now >= due) ? 0 : (Sint32)((due - now + SDL_NS_PER_MS - 1) / SDL_NS_PER_MS);
+}
@@ -0,0 +1,87 @@
+#ifndef TERMINAL_H
+    #define TERMINAL_H
+
+    #include <stdbool.h>
+
+    #include <SDL3/SDL.h>
+
+    #include "clipboard.h"
+    #include "config.h"
+    #include "control.h"
+    #include "font.h"
+    #include "gl_renderer.h"
+    #include "record.h"
+    #include "renderer.h"
+    #include "screen.h"
+    #include "slave.h"
+    #include "tmux.h"
+    #include "urls.h"
+
+    #define SCREEN_WIDTH 1280
+    #define SCREEN_HEIGHT 720
+
+// distinct display scales a process keeps glyphs baked for
+enum { GLYPH_SCALES_MAX = 4 };
+
+typedef struct {
+    char *bench_file;
+    char *record_file;
+    char *replay_file;
+    char *control_path;
+    bool control_socket;
+    bool no_render;
+    bool fast;
+    bool gl; // instanced OpenGL renderer, the SDL one when GL is missing
+} terminal_options;
+
+// Loaded once per process and shared by every window
+typedef struct {
+    generic_config *config;
+    font_info font;
+
+    /* baked the first time a window shows up on a display with that scale */
+    glyph_cache *glyphs[GLYPH_SCALES_MAX];
+    int nglyphs;
+
+    url_finder urls; // one worker looks for links in the rows of every window
+} shared_resources;
+
+// One window with its own tty, its address must not change once opened
+typedef struct terminal {
+    struct terminal *next;
+
+    SDL_Window *win;
+    SDL_Renderer *renderer;
+    gl_renderer *gl; // draws instead of `renderer` when set
+    struct dim win_size;
+    struct dim pixel_size;
+    glyph_atlas *atlases[GLYPH_SCALES_MAX]; // one per shared glyph cache, uploaded on demand
+    glyph_atlas *atlas;
+    frame_state frame;
+
+    screen scr;
+    screen *shown; // drawn by the last frame, `scr` or a tmux pane
+    const screen_snapshot *snap; // what of `shown` the last frame drew, links are looked up in it
+    tty_state tty;
+    tmux_client tmux;
+    clip_source *clip; // the last selection copied from this window, while the clipboard has it
+    recording rec;
+    control ctl;
+    render_stats stats;
+
+    const terminal_options *opts;
+    shared_resources *shared;
+    Uint64 start;
+
+    /* the parser published a frame, drawn at most once per TTY_FRAME_INTERVAL_MS */
+    bool redraw;
+    Uint64 last_frame;
+} terminal;
+
+terminal *terminal_open(shared_resources *shared, const terminal_options *opts);
+void terminal_close(terminal *term);
+bool terminal_handle_event(terminal *term, const SDL_Event *event);
+bool terminal_update(terminal *term);
+Sint32 terminal_timeout(const terminal *term, Uint64 now);
+
+#endif // TERMINAL_H
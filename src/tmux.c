@@ -0,0 +1,656 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "log.h"
+#include "pretty.h"
+#include "tmux.h"
+
+// bytes sent by one send-keys, each takes three characters of the command
+enum { KEYS_PER_COMMAND = 64 };
+
+#define BETWEEN(x, a, b) ((a) <= (x) && (x) <= (b))
+#define PANES_FORMAT \
+    "#{pane_id} #{window_id} #{pane_width} #{pane_height} #{pane_active} #{cursor_x} #{cursor_y}"
+
+void tmux_init(tmux_client *tc)
+{
+    *tc = (tmux_client){
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .window = -1,
+        .added_window = -1,
+        .cols = 80,
+        .rows = 24,
+    };
+}
+
+void tmux_free(tmux_client *tc)
+{
+    for (int i = 0; i < TMUX_PANES_CAP; i++) {
+        if (tc->panes[i].scr == NULL) continue;
+
+        screen_destroy(tc->panes[i].scr);
+        counted_free(tc->panes[i].scr);
+    }
+    counted_free(tc->line);
+    tc->line = NULL;
+}
+
+bool tmux_active(tmux_client *tc)
+{
+    return atomic_load_explicit(&tc->active, memory_order_relaxed);
+}
+
+// The screen the UI should draw, it stays allocated until the next call
+screen *tmux_shown(tmux_client *tc)
+{
+    pthread_mutex_lock(&tc->lock);
+    tc->ui_screen = atomic_load(&tc->shown);
+    pthread_mutex_unlock(&tc->lock);
+
+    return tc->ui_screen;
+}
+
+/*
+ * Sends one command line, its reply is matched with `kind` once it comes
+ * back. The reader writes it out as tmux reads, the bytes and the pending
+ * entry go in under `lock` together so replies come back in that order.
+ * The UI waits for room in the queue (`wait`), without holding any lock
+ * meanwhile. The parser never waits: it is what lets tmux write again.
+ */
+static
+void command(tmux_client *tc, tty_state *tty, bool wait, enum tmux_reply kind, int pane, const char *fmt, ...)
+{
+    char cmd[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    int len = vsnprintf(cmd, sizeof cmd, fmt, ap);
+    va_end(ap);
+
+    if (len < 0 || (size_t)len >= sizeof cmd) return;
+
+    for (;;) {
+        pthread_mutex_lock(&tc->lock);
+        bool room = tc->pending_count < TMUX_PENDING_CAP;
+        bool sent = room && tty_queue(tty, cmd, len);
+
+        if (sent) {
+            size_t i = (tc->pending_head + tc->pending_count++) % TMUX_PENDING_CAP;
+            tc->pending[i] = (tmux_pending){ kind, pane };
+        }
+        pthread_mutex_unlock(&tc->lock);
+
+        if (sent || tty->pty_master_fd < 0 || tty->child_exited || tty->should_exit) return;
+
+        if (!room) {
+            pretty_log(PRETTY_WARN, "tmux: %d commands without a reply, dropped one", TMUX_PENDING_CAP);
+            return;
+        }
+        if (!wait) {
+            pretty_log(PRETTY_WARN, "tmux doesn't read, dropped a command");
+            return;
+        }
+        tty_wait_queue(tty, len);
+    }
+}
+
+static
+void list_panes(tmux_client *tc, tty_state *tty)
+{
+    command(tc, tty, false, REPLY_PANES, -1, "list-panes -F '" PANES_FORMAT "'\n");
+}
+
+void tmux_resize(tmux_client *tc, tty_state *tty, int cols, int rows)
+{
+    pthread_mutex_lock(&tc->lock);
+    tc->cols = cols;
+    tc->rows = rows;
+    pthread_mutex_unlock(&tc->lock);
+
+    // tmux lays the panes out again and answers with a %layout-change
+    if (tmux_active(tc)) command(tc, tty, true, REPLY_NONE, -1, "refresh-client -C %d,%d\n", cols, rows);
+}
+
+// Keys go to the active pane as hex bytes, nothing in them needs quoting that way
+void tmux_send_keys(tmux_client *tc, tty_state *tty, const char *s, size_t n)
+{
+    static const char hex[] = "0123456789abcdef";
+    char cmd[sizeof("send-keys -H") + KEYS_PER_COMMAND * 3];
+
+    while (n > 0) {
+        size_t k = (n < KEYS_PER_COMMAND) ? n : KEYS_PER_COMMAND;
+        size_t len = sizeof("send-keys -H") - 1;
+
+        memcpy(cmd, "send-keys -H", len);
+        for (size_t i = 0; i < k; i++) {
+            cmd[len++] = ' ';
+            cmd[len++] = hex[(unsigned char)s[i] >> 4];
+            cmd[len++] = hex[(unsigned char)s[i] & 0xF];
+        }
+        command(tc, tty, true, REPLY_NONE, -1, "%.*s\n", (int)len, cmd);
+
+        s += k;
+        n -= k;
+    }
+}
+
+void tmux_select_pane(tmux_client *tc, tty_state *tty, int dir)
+{
+    command(tc, tty, true, REPLY_NONE, -1, "select-pane -t :.%c\n", (dir < 0) ? '-' : '+');
+}
+
+static
+tmux_pane *pane_find(tmux_client *tc, int id)
+{
+    for (int i = 0; i < TMUX_PANES_CAP; i++)
+        if (tc->panes[i].live && tc->panes[i].id == id) return &tc->panes[i];
+    return NULL;
+}
+
+// Gives a new pane a blank screen, reusing one the UI can no longer be drawing
+static
+tmux_pane *pane_open(tmux_client *tc, int id, int window, int cols, int rows)
+{
+    tmux_pane *p = NULL;
+
+    pthread_mutex_lock(&tc->lock);
+    for (int i = 0; i < TMUX_PANES_CAP && p == NULL; i++) {
+        screen *scr = tc->panes[i].scr;
+
+        if (tc->panes[i].live) continue;
+        if (scr == NULL || (scr != tc->ui_screen && scr != atomic_load(&tc->shown)
+                && atomic_load(&scr->borrowed) == 0))
+            p = &tc->panes[i];
+    }
+    pthread_mutex_unlock(&tc->lock);
+
+    if (p == NULL) {
+        pretty_log(PRETTY_WARN, "tmux: more than %d panes, %%%d is not shown", TMUX_PANES_CAP, id);
+        return NULL;
+    }
+
+    screen *scr = p->scr;
+
+    if (scr != NULL) screen_destroy(scr);
+    else if ((scr = counted_malloc(sizeof *scr)) == NULL)
+        die("Failed to allocate a screen for tmux pane %%%d", id);
+
+    if (!screen_init(scr, (cols > 0) ? cols : 1, (rows > 0) ? rows : 1, SCREEN_HISTORY_CAP))
+        die("Failed to allocate a screen for tmux pane %%%d", id);
+    scr->urls = tc->urls;
+
+    *p = (tmux_pane){ .scr = scr, .id = id, .window = window, .live = true, .changed = true };
+    return p;
+}
+
+static
+void pane_show(tmux_client *tc, tmux_pane *p)
+{
+    if (atomic_load(&tc->shown) == p->scr) return;
+
+    atomic_store(&tc->shown, p->scr);
+    tc->shown_moved = true;
+}
+
+static
+void pane_close(tmux_client *tc, tty_state *tty, tmux_pane *p)
+{
+    p->live = false;
+
+    // keep drawing it until tmux says which pane is active now
+    if (atomic_load(&tc->shown) == p->scr) list_panes(tc, tty);
+}
+
+static
+void pane_feed(tmux_pane *p, const char *s, size_t n)
+{
+    while (n > 0) {
+        size_t used = screen_feed(p->scr, s, n);
+
+        // tmux answers the queries of its panes itself
+        p->scr->reply_len = 0;
+        p->scr->control_mode = false;
+        s += used;
+        n -= used;
+    }
+    p->changed = true;
+}
+
+static
+void pane_resize(tmux_pane *p, int cols, int rows)
+{
+    if (cols == p->scr->cols && rows == p->scr->rows) return;
+
+    screen_resize(p->scr, cols, rows);
+    p->changed = true;
+}
+
+// Back to the screen tmux was started from, the pane screens are kept for next time
+static
+void control_end(tmux_client *tc)
+{
+    for (int i = 0; i < TMUX_PANES_CAP; i++) tc->panes[i].live = false;
+
+    atomic_store(&tc->shown, NULL);
+    atomic_store(&tc->active, false);
+    tc->shown_moved = false;
+    pretty_log(PRETTY_INFO, "tmux control mode ended");
+}
+
+void tmux_start(tmux_client *tc, tty_state *tty)
+{
+    tc->exiting = false;
+    tc->escape = false;
+    tc->in_reply = false;
+    tc->len = 0;
+    tc->overflow = false;
+    tc->window = -1;
+    tc->added_window = -1;
+
+    pthread_mutex_lock(&tc->lock);
+    tc->pending_count = 0;
+    int cols = tc->cols;
+    int rows = tc->rows;
+    pthread_mutex_unlock(&tc->lock);
+
+    atomic_store(&tc->active, true);
+    pretty_log(PRETTY_INFO, "tmux control mode started, %dx%d", cols, rows);
+
+    command(tc, tty, false, REPLY_NONE, -1, "refresh-client -C %d,%d\n", cols, rows);
+    list_panes(tc, tty);
+}
+
+// %output escapes bytes below 0x20 and backslashes as \ooo, decoded in place
+static
+size_t output_decode(char *data, size_t n)
+{
+    char *w = data;
+    const char *r = data;
+    const char *end = data + n;
+
+    while (r < end) {
+        const char *bs = memchr(r, '\\', end - r);
+        size_t k = ((bs != NULL) ? bs : end) - r;
+
+        memmove(w, r, k);
+        w += k;
+        r += k;
+        if (bs == NULL) break;
+
+        if (end - r >= 4 && BETWEEN(r[1], '0', '3') && BETWEEN(r[2], '0', '7') && BETWEEN(r[3], '0', '7')) {
+            *w++ = (char)((r[1] - '0') << 6 | (r[2] - '0') << 3 | (r[3] - '0'));
+            r += 4;
+        } else *w++ = *r++;
+    }
+    return w - data;
+}
+
+// "%N data" after %output, or "%N age ... : data" after %extended-output
+static
+void pane_output(tmux_client *tc, char *args, char *end, bool extended)
+{
+    char *data;
+
+    if (*args != '%') return;
+
+    int id = strtol(args + 1, &data, 10);
+
+    if (extended) data = strstr(data, " : ");
+    if (data == NULL || *data != ' ') return;
+    data += extended ? 3 : 1;
+
+    tmux_pane *p = pane_find(tc, id);
+
+    // a pane of a window we haven't listed yet, sized for the whole client until then
+    if (p == NULL) {
+        pthread_mutex_lock(&tc->lock);
+        int cols = tc->cols;
+        int rows = tc->rows;
+        pthread_mutex_unlock(&tc->lock);
+
+        if ((p = pane_open(tc, id, -1, cols, rows)) == NULL) return;
+    }
+
+    pane_feed(p, data, output_decode(data, end - data));
+}
+
+/*
+ * One cell of a layout, "WxH,X,Y" followed by ",id" for a pane or by its
+ * children in {} (side by side) or [] (stacked). Returns where the cell
+ * ends, NULL when the layout doesn't parse.
+ */
+static
+const char *layout_cell(tmux_client *tc, int window, const char *s)
+{
+    int cols, rows, n;
+    char *end;
+
+    if (sscanf(s, "%dx%d,%*d,%*d%n", &cols, &rows, &n) != 2) return NULL;
+    s += n;
+
+    if (*s == ',') {
+        int id = strtol(s + 1, &end, 10);
+        tmux_pane *p = pane_find(tc, id);
+
+        if (end == s + 1) return NULL;
+
+        if (p != NULL) pane_resize(p, cols, rows);
+        else if ((p = pane_open(tc, id, window, cols, rows)) != NULL)
+            // split off after we listed the window, all it ever printed comes as %output
+            p->captured = window == tc->window || window == tc->added_window;
+
+        if (p != NULL) {
+            p->window = window;
+            p->seen = true;
+        }
+        return end;
+    }
+
+    if (*s != '{' && *s != '[') return NULL;
+
+    char close = (*s == '{') ? '}' : ']';
+
+    do s = layout_cell(tc, window, s + 1);
+    while (s != NULL && *s == ',');
+
+    return (s != NULL && *s == close) ? s + 1 : NULL;
+}
+
+// "@W layout visible-layout flags", panes missing from the layout were closed
+static
+void layout_change(tmux_client *tc, tty_state *tty, const char *args)
+{
+    const char *layout;
+    int window;
+
+    if (sscanf(args, "@%d", &window) != 1 || (layout = strchr(args, ' ')) == NULL) return;
+    if ((layout = strchr(layout, ',')) == NULL) return;
+
+    for (int i = 0; i < TMUX_PANES_CAP; i++)
+        if (tc->panes[i].window == window) tc->panes[i].seen = false;
+
+    if (layout_cell(tc, window, layout + 1) == NULL) {
+        pretty_log(PRETTY_WARN, "tmux: can't parse the layout of window @%d", window);
+        return;
+    }
+
+    for (int i = 0; i < TMUX_PANES_CAP; i++) {
+        tmux_pane *p = &tc->panes[i];
+
+        if (p->live && p->window == window && !p->seen) pane_close(tc, tty, p);
+    }
+}
+
+static
+void window_close(tmux_client *tc, tty_state *tty, const char *args)
+{
+    int window;
+
+    if (sscanf(args, "@%d", &window) != 1) return;
+
+    for (int i = 0; i < TMUX_PANES_CAP; i++) {
+        tmux_pane *p = &tc->panes[i];
+
+        if (p->live && p->window == window) pane_close(tc, tty, p);
+    }
+}
+
+// "@W %P", only the current window decides what is shown
+static
+void window_pane_changed(tmux_client *tc, const char *args)
+{
+    int window, id;
+
+    if (sscanf(args, "@%d %%%d", &window, &id) != 2 || window != tc->window) return;
+
+    tmux_pane *p = pane_find(tc, id);
+    if (p != NULL) pane_show(tc, p);
+}
+
+// One line of a list-panes in PANES_FORMAT
+static
+void reply_pane(tmux_client *tc, tty_state *tty, const char *line)
+{
+    int id, window, cols, rows, active, cursor_x, cursor_y;
+
+    if (sscanf(line, "%%%d @%d %d %d %d %d %d",
+            &id, &window, &cols, &rows, &active, &cursor_x, &cursor_y) != 7)
+        return;
+
+    tmux_pane *p = pane_find(tc, id);
+
+    if (p != NULL) pane_resize(p, cols, rows);
+    else if ((p = pane_open(tc, id, window, cols, rows)) == NULL) return;
+
+    p->window = window;
+
+    // what it printed before we attached is fetched once, scrolling back is local from then on
+    if (!p->captured) {
+        p->captured = true;
+        p->cursor_x = cursor_x;
+        p->cursor_y = cursor_y;
+        command(tc, tty, false, REPLY_CAPTURE, id, "capture-pane -p -e -S - -t %%%d\n", id);
+    }
+
+    if (active) {
+        tc->window = window;
+        pane_show(tc, p);
+    }
+}
+
+static
+void reply_begin(tmux_client *tc, const char *args)
+{
+    int flags = 0;
+
+    snprintf(tc->guard, sizeof tc->guard, "%s", args);
+    sscanf(args, "%*d %*d %d", &flags);
+
+    tc->in_reply = true;
+    tc->reply_lines = 0;
+    tc->reply = (tmux_pending){ REPLY_NONE, -1 };
+
+    // blocks without the flag answer commands that didn't come from us
+    if (flags & 1) {
+        pthread_mutex_lock(&tc->lock);
+        if (tc->pending_count > 0) {
+            tc->reply = tc->pending[tc->pending_head];
+            tc->pending_head = (tc->pending_head + 1) % TMUX_PENDING_CAP;
+            tc->pending_count--;
+        }
+        pthread_mutex_unlock(&tc->lock);
+    }
+
+    tmux_pane *p = (tc->reply.kind == REPLY_CAPTURE) ? pane_find(tc, tc->reply.pane) : NULL;
+    if (p != NULL) pane_feed(p, "\x1b[H\x1b[2J", 7);
+}
+
+static
+void reply_line(tmux_client *tc, tty_state *tty, const char *line, size_t len)
+{
+    tmux_pane *p;
+
+    switch (tc->reply.kind) {
+        case REPLY_PANES:
+            reply_pane(tc, tty, line);
+            break;
+        case REPLY_CAPTURE:
+            if ((p = pane_find(tc, tc->reply.pane)) == NULL) break;
+
+            if (tc->reply_lines > 0) pane_feed(p, "\r\n", 2);
+            pane_feed(p, line, len);
+            break;
+        case REPLY_NONE:
+            break;
+    }
+    tc->reply_lines++;
+}
+
+static
+void reply_end(tmux_client *tc)
+{
+    tmux_pane *p = (tc->reply.kind == REPLY_CAPTURE) ? pane_find(tc, tc->reply.pane) : NULL;
+
+    tc->in_reply = false;
+    if (p == NULL) return;
+
+    char cursor[32];
+    int len = snprintf(cursor, sizeof cursor, "\x1b[m\x1b[%d;%dH", p->cursor_y + 1, p->cursor_x + 1);
+
+    pane_feed(p, cursor, len);
+}
+
+// The %end or %error with the same time, number and flags as the %begin
+static
+bool reply_closes(const tmux_client *tc, const char *line)
+{
+    const char *rest;
+
+    if (strncmp(line, "%end ", 5) == 0) rest = line + 5;
+    else if (strncmp(line, "%error ", 7) == 0) rest = line + 7;
+    else return false;
+
+    return strcmp(rest, tc->guard) == 0;
+}
+
+static
+void handle_line(tmux_client *tc, tty_state *tty, char *line, size_t len)
+{
+    if (tc->in_reply) {
+        if (reply_closes(tc, line)) reply_end(tc);
+        else reply_line(tc, tty, line, len);
+        return;
+    }
+
+    // tmux died without saying goodbye, the line was meant for the screen
+    if (line[0] != '%') {
+        control_end(tc);
+        for (size_t used = 0; used < len;) used += screen_feed(tty->screen, line + used, len - used);
+        screen_feed(tty->screen, "\n", 1);
+        return;
+    }
+
+    char *args = strchr(line, ' ');
+    size_t word = (args != NULL) ? (size_t)(args++ - line) : len;
+
+    #define IS(name) (word == sizeof(name) - 1 && memcmp(line, name, word) == 0)
+
+    if (IS("%output") && args != NULL) pane_output(tc, args, line + len, false);
+    else if (IS("%extended-output") && args != NULL) pane_output(tc, args, line + len, true);
+    else if (IS("%begin") && args != NULL) reply_begin(tc, args);
+    else if (IS("%layout-change") && args != NULL) layout_change(tc, tty, args);
+    else if (IS("%window-pane-changed") && args != NULL) window_pane_changed(tc, args);
+    else if ((IS("%window-close") || IS("%unlinked-window-close")) && args != NULL)
+        window_close(tc, tty, args);
+    else if (IS("%window-add") && args != NULL) sscanf(args, "@%d", &tc->added_window);
+    else if (IS("%session-window-changed") || IS("%session-changed")) {
+        tc->window = -1;
+        list_panes(tc, tty);
+    } else if (IS("%exit")) tc->exiting = true;
+
+    #undef IS
+}
+
+static
+void line_append(tmux_client *tc, const char *s, size_t n)
+{
+    if (tc->overflow) return;
+
+    // one more for the terminating nul
+    if (tc->len + n + 1 > tc->cap) {
+        size_t cap = (tc->cap > 0) ? tc->cap : 4096;
+
+        while (cap < tc->len + n + 1) cap *= 2;
+
+        char *grown = (cap <= TMUX_LINE_MAX) ? counted_realloc(tc->line, cap) : NULL;
+
+        if (grown == NULL) {
+            tc->overflow = true;
+            return;
+        }
+        tc->line = grown;
+        tc->cap = cap;
+    }
+
+    memcpy(tc->line + tc->len, s, n);
+    tc->len += n;
+}
+
+/*
+ * Eats control mode notifications, one line at a time. Returns how much was
+ * used, less than `n` when control mode ended and the rest is for the screen.
+ */
+size_t tmux_feed(tmux_client *tc, tty_state *tty, const char *s, size_t n)
+{
+    size_t i = 0;
+
+    while (i < n && tmux_active(tc)) {
+        // the DCS opened by tmux -CC ends with ST after %exit
+        if (tc->exiting) {
+            char c = s[i++];
+
+            if (tc->escape && c == '\\') control_end(tc);
+            tc->escape = c == 0x1B;
+            continue;
+        }
+
+        const char *nl = memchr(s + i, '\n', n - i);
+        size_t k = ((nl != NULL) ? nl : s + n) - (s + i);
+
+        line_append(tc, s + i, k);
+        i += k;
+        if (nl == NULL) break;
+        i++;
+
+        if (tc->overflow) pretty_log(PRETTY_WARN, "tmux: dropped a line longer than %d bytes", TMUX_LINE_MAX);
+        else if (tc->line != NULL) {
+            if (tc->len > 0 && tc->line[tc->len - 1] == '\r') tc->len--;
+            tc->line[tc->len] = '\0';
+
+            // blank rows of a capture count, blank notifications don't exist
+            if (tc->len > 0 || tc->in_reply) handle_line(tc, tty, tc->line, tc->len);
+        }
+        tc->len = 0;
+        tc->overflow = false;
+    }
+    return i;
+}
+
+// Publishes the panes fed since last time, true when the shown one has a new frame
+bool tmux_publish(tmux_client *tc)
+{
+    screen *shown = atomic_load(&tc->shown);
+    bool fresh = tc->shown_moved;
+    uint64_t deadline;
+
+    tc->shown_moved = false;
+    for (int i = 0; i < TMUX_PANES_CAP; i++) {
+        tmux_pane *p = &tc->panes[i];
+
+        if (p->scr == NULL || !p->changed) continue;
+
+        if (screen_publish(p->scr) && p->scr == shown) fresh = true;
+        // a held update stays pending until it ends or times out
+        p->changed = screen_sync_deadline(p->scr, &deadline);
+    }
+    return fresh;
+}
+
+// The earliest deadline among the panes holding a synchronized update
+bool tmux_sync_deadline(tmux_client *tc, uint64_t *deadline)
+{
+    bool held = false;
+    uint64_t pane_deadline;
+
+    for (int i = 0; i < TMUX_PANES_CAP; i++) {
+        tmux_pane *p = &tc->panes[i];
+
+        if (p->scr == NULL || !p->live || !screen_sync_deadline(p->scr, &pane_deadline)) continue;
+        if (!held || pane_deadline < *deadline) *deadline = pane_deadline;
+        held = true;
+    }
+    return held;
+}
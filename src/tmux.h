@@ -0,0 +1,101 @@
+#ifndef TMUX_H
+    #define TMUX_H
+
+    #include <pthread.h>
+    #include <stdatomic.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+
+    #include "screen.h"
+    #include "slave.h"
+
+// panes with a screen of their own, the screens of closed panes are reused
+enum { TMUX_PANES_CAP = 16 };
+// commands sent to tmux whose %begin ... %end reply has not come back yet
+enum { TMUX_PENDING_CAP = 256 };
+// a notification longer than this is dropped, tmux splits %output well below it
+enum { TMUX_LINE_MAX = 1024 * 1024 };
+// the rest of a %begin line, repeated by the %end closing the block
+enum { TMUX_GUARD_CAP = 64 };
+
+// What the reply to a command holds, tmux answers commands in the order they were sent
+enum tmux_reply {
+    REPLY_NONE,
+    REPLY_PANES, // one line per pane of the current window
+    REPLY_CAPTURE, // the scrollback and visible rows of `pane`
+};
+
+typedef struct {
+    enum tmux_reply kind;
+    int pane;
+} tmux_pending;
+
+typedef struct {
+    screen *scr; // kept once allocated, even after the pane closed
+    int id; // the N of %N
+    int window; // the N of @N
+    bool live;
+    bool seen; // still in the layout being parsed
+    bool captured; // its content was asked for since it showed up
+    bool changed; // fed since the last publish
+    int cursor_x;
+    int cursor_y;
+} tmux_pane;
+
+/*
+ * A tmux running in control mode (tmux -CC) on our tty. Instead of painting
+ * its panes with escape sequences, it sends one %output line per chunk a
+ * pane wrote, and every pane is parsed into a screen of its own. Only the
+ * active pane of the current window is shown, its scrollback is local.
+ *
+ * The parser thread owns the panes. The UI thread only reads `active` and
+ * `shown`, and queues commands, keys and sizes under `lock`. Neither writes
+ * to the tty itself, commands go through the queue the reader flushes.
+ */
+typedef struct tmux_client {
+    atomic_bool active;
+    _Atomic(screen *) shown; // NULL shows the screen tmux was started from
+    bool exiting; // %exit came, the DCS ends with the next ST
+    bool shown_moved;
+
+    /* the notification being received, grown up to TMUX_LINE_MAX */
+    char *line;
+    size_t len;
+    size_t cap;
+    bool overflow;
+    bool escape; // an ESC was seen while exiting
+
+    /* the %begin ... %end block being received */
+    bool in_reply;
+    tmux_pending reply;
+    char guard[TMUX_GUARD_CAP];
+    size_t reply_lines;
+
+    tmux_pane panes[TMUX_PANES_CAP];
+    int window; // current window, -1 until known
+    int added_window; // the last %window-add, its panes are new
+
+    pthread_mutex_t lock;
+    tmux_pending pending[TMUX_PENDING_CAP];
+    size_t pending_head;
+    size_t pending_count;
+    int cols;
+    int rows;
+    screen *ui_screen; // last screen handed to the UI, never recycled
+
+    struct url_finder *urls; // handed to the screens of the panes
+} tmux_client;
+
+void tmux_init(tmux_client *tc);
+void tmux_free(tmux_client *tc);
+void tmux_start(tmux_client *tc, tty_state *tty);
+size_t tmux_feed(tmux_client *tc, tty_state *tty, const char *s, size_t n);
+bool tmux_publish(tmux_client *tc);
+bool tmux_sync_deadline(tmux_client *tc, uint64_t *deadline);
+bool tmux_active(tmux_client *tc);
+screen *tmux_shown(tmux_client *tc);
+void tmux_resize(tmux_client *tc, tty_state *tty, int cols, int rows);
+void tmux_send_keys(tmux_client *tc, tty_state *tty, const char *s, size_t n);
+void tmux_select_pane(tmux_client *tc, tty_state *tty, int dir);
+
+#endif // TMUX_H
@@ -0,0 +1,176 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "log.h"
+
+enum { TRACE_INITIAL_EVENTS = 4096 };
+enum { TRACE_MAX_EVENTS = 1 << 20 };
+
+typedef struct {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+} trace_event;
+
+// Only the owning thread appends, the buffers are read once all threads joined
+typedef struct trace_buffer {
+    struct trace_buffer *next;
+    const char *thread_name;
+    int tid;
+    trace_event *events;
+    size_t count;
+    size_t cap;
+    size_t dropped;
+} trace_buffer;
+
+bool trace_enabled = false;
+
+static char *trace_path;
+static uint64_t trace_epoch;
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static trace_buffer *buffers;
+static int next_tid = 1;
+static _Thread_local trace_buffer *local;
+
+uint64_t trace_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+bool trace_init(const char *path)
+{
+    if (path == NULL) path = getenv("PRETTY_TRACE");
+    if (path == NULL || *path == '\0') return false;
+
+    trace_path = strdup(path);
+    if (trace_path == NULL) return false;
+
+    trace_epoch = trace_now_ns();
+    trace_enabled = true;
+    pretty_log(PRETTY_INFO, "Tracing to [%s]", trace_path);
+    return true;
+}
+
+static
+trace_buffer *local_buffer(void)
+{
+    if (local != NULL) return local;
+
+    trace_buffer *buf = calloc(1, sizeof *buf);
+    if (buf == NULL) return NULL;
+
+    pthread_mutex_lock(&buffers_lock);
+    buf->tid = next_tid++;
+    buf->next = buffers;
+    buffers = buf;
+    pthread_mutex_unlock(&buffers_lock);
+
+    return local = buf;
+}
+
+void trace_thread_name(const char *name)
+{
+    if (!trace_enabled) return;
+
+    trace_buffer *buf = local_buffer();
+    if (buf != NULL) buf->thread_name = name;
+}
+
+void trace_record(const char *name, uint64_t start, uint64_t end)
+{
+    if (!trace_enabled) return;
+
+    trace_buffer *buf = local_buffer();
+    if (buf == NULL) return;
+
+    if (buf->count == buf->cap) {
+        size_t cap = buf->cap ? buf->cap * 2 : TRACE_INITIAL_EVENTS;
+        trace_event *events = (cap <= TRACE_MAX_EVENTS)
+            ? realloc(buf->events, cap * sizeof *events)
+            : NULL;
+
+        if (events == NULL) {
+            buf->dropped++;
+            return;
+        }
+        buf->events = events;
+        buf->cap = cap;
+    }
+
+    buf->events[buf->count++] = (trace_event){ name, start, end };
+}
+
+// Chrome trace-event JSON, loads in chrome://tracing and ui.perfetto.dev
+static
+bool trace_write(FILE *f)
+{
+    int pid = getpid();
+    const char *sep = "";
+
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+    for (trace_buffer *buf = buffers; buf != NULL; buf = buf->next) {
+        if (buf->thread_name != NULL) {
+            fprintf(f, "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": %d, \"tid\": %d, "
+                "\"args\": {\"name\": \"%s\"}}", sep, pid, buf->tid, buf->thread_name);
+            sep = ",\n";
+        }
+
+        for (size_t i = 0; i < buf->count; i++) {
+            const trace_event *ev = &buf->events[i];
+
+            fprintf(f, "%s{\"ph\": \"X\", \"name\": \"%s\", \"pid\": %d, \"tid\": %d, "
+                "\"ts\": %.3f, \"dur\": %.3f}", sep, ev->name, pid, buf->tid,
+                (double)(ev->start - trace_epoch) / 1e3, (double)(ev->end - ev->start) / 1e3);
+            sep = ",\n";
+        }
+
+        if (buf->dropped > 0)
+            pretty_log(PRETTY_WARN, "trace: dropped %zu events of thread %d",
+                buf->dropped, buf->tid);
+    }
+
+    fprintf(f, "\n]}\n");
+    return !ferror(f);
+}
+
+// Must only run once every traced thread has been joined
+void trace_flush(void)
+{
+    if (!trace_enabled) return;
+    trace_enabled = false;
+
+    FILE *f = fopen(trace_path, "w");
+
+    if (f == NULL)
+        pretty_log(PRETTY_ERROR, "Couldn't open trace [%s]: %s", trace_path, strerror(errno));
+    else {
+        bool ok = trace_write(f);
+
+        if (fclose(f) != 0) ok = false;
+
+        if (ok) pretty_log(PRETTY_INFO, "Trace written to [%s]", trace_path);
+        else pretty_log(PRETTY_ERROR, "Couldn't write trace [%s]", trace_path);
+    }
+
+    while (buffers != NULL) {
+        trace_buffer *next = buffers->next;
+
+        free(buffers->events);
+        free(buffers);
+        buffers = next;
+    }
+
+    local = NULL;
+    free(trace_path);
+    trace_path = NULL;
+}
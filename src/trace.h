@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+    #define TRACE_H
+
+    #include <stdbool.h>
+    #include <stdint.h>
+
+    #include "macro_utils.h"
+
+typedef struct {
+    const char *name;
+    uint64_t start;
+} trace_span;
+
+// Checked by every trace point, stays false unless tracing was requested
+extern bool trace_enabled;
+
+bool trace_init(const char *path);
+void trace_thread_name(const char *name);
+void trace_record(const char *name, uint64_t start, uint64_t end);
+// CLOCK_MONOTONIC in nanoseconds, the clock every timestamp and deadline is taken from
+uint64_t trace_now_ns(void);
+void trace_flush(void);
+
+// `name` must outlive the trace, in practice it is a string literal
+static inline
+trace_span trace_begin(const char *name)
+{
+    if (!trace_enabled) return (trace_span){ NULL, 0 };
+    return (trace_span){ name, trace_now_ns() };
+}
+
+static inline
+void trace_end(trace_span *span)
+{
+    if (span->name != NULL) trace_record(span->name, span->start, trace_now_ns());
+    span->name = NULL;
+}
+
+// Traces until the end of the enclosing block
+    #define TRACE_SCOPE(name)                                       \
+        trace_span xconcat(trace_span_, __LINE__)                   \
+            __attribute__((cleanup(trace_end))) = trace_begin(name)
+
+#endif // TRACE_H
@@ -0,0 +1,212 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "log.h"
+#include "unicode.h"
+#include "unicode_tables.h"
+
+// layout of the property byte, see tests/gen_unicode.pl
+#define PROP_WIDTH(p) ((p) & 0x3)
+#define PROP_BREAK(p) (((p) >> 2) & 0xF)
+#define PROP_EXT_PICT(p) (((p) >> 6) & 1)
+#define PROP_EMOJI_PRES(p) (((p) >> 7) & 1)
+
+static
+uint8_t props(uint32_t cp)
+{
+    if (cp >= 0x110000) return 1;
+
+    uint32_t block = unicode_stage1[cp >> UNICODE_SHIFT];
+    return unicode_stage2[(block << UNICODE_SHIFT) | (cp & ((1 << UNICODE_SHIFT) - 1))];
+}
+
+// Number of cells `cp` takes on its own, combining marks take none
+int unicode_width(uint32_t cp)
+{
+    if (cp >= 0x20 && cp < 0x7F) return 1;
+    return PROP_WIDTH(props(cp));
+}
+
+enum grapheme_break unicode_grapheme_break(uint32_t cp)
+{
+    return PROP_BREAK(props(cp));
+}
+
+bool unicode_extended_pictographic(uint32_t cp)
+{
+    return PROP_EXT_PICT(props(cp));
+}
+
+bool unicode_emoji_presentation(uint32_t cp)
+{
+    return PROP_EMOJI_PRES(props(cp));
+}
+
+static
+bool is_control(uint8_t brk)
+{
+    return brk == GCB_CR || brk == GCB_LF || brk == GCB_CONTROL;
+}
+
+// Extended grapheme cluster rules from UAX #29, returns true when `cp` starts a new cluster
+bool grapheme_break(grapheme_state *st, uint32_t cp)
+{
+    uint8_t p = props(cp);
+    uint8_t brk = PROP_BREAK(p);
+    uint8_t prev = st->prev;
+    bool started = st->started;
+    bool split;
+
+    if (!started) split = true;                                             // GB1
+    else if (prev == GCB_CR && brk == GCB_LF) split = false;                // GB3
+    else if (is_control(prev) || is_control(brk)) split = true;             // GB4, GB5
+    else if (prev == GCB_L && (brk == GCB_L || brk == GCB_V || brk == GCB_LV || brk == GCB_LVT))
+        split = false;                                                      // GB6
+    else if ((prev == GCB_LV || prev == GCB_V) && (brk == GCB_V || brk == GCB_T))
+        split = false;                                                      // GB7
+    else if ((prev == GCB_LVT || prev == GCB_T) && brk == GCB_T) split = false;  // GB8
+    else if (brk == GCB_EXTEND || brk == GCB_ZWJ || brk == GCB_SPACING_MARK)
+        split = false;                                                      // GB9, GB9a
+    else if (prev == GCB_PREPEND) split = false;                            // GB9b
+    else if (prev == GCB_ZWJ && st->emoji_sequence && PROP_EXT_PICT(p)) split = false;  // GB11
+    else if (prev == GCB_REGIONAL_INDICATOR && brk == GCB_REGIONAL_INDICATOR)
+        split = !st->odd_regional;                                          // GB12, GB13
+    else split = true;                                                      // GB999
+
+    // an emoji sequence is Extended_Pictographic Extend* ZWJ
+    if (PROP_EXT_PICT(p)) st->emoji_sequence = true;
+    else if (brk != GCB_EXTEND && brk != GCB_ZWJ) st->emoji_sequence = false;
+
+    st->odd_regional = (brk == GCB_REGIONAL_INDICATOR) && (split || !st->odd_regional);
+    st->prev = brk;
+    st->started = true;
+    return split;
+}
+
+typedef struct {
+    uint8_t len;
+    uint32_t cps[CLUSTER_LEN_MAX];
+} cluster;
+
+/*
+ * Every cluster seen by any screen, ids are never reused so a cell keeps
+ * meaning the same text for as long as it lives, in history or in a pane.
+ * The index is open addressed over the contents, 0 marks a free bucket.
+ */
+static pthread_mutex_t clusters_lock = PTHREAD_MUTEX_INITIALIZER;
+static cluster *clusters;
+static uint32_t *clusters_index;
+static uint32_t clusters_count;
+static uint32_t clusters_cap;
+static bool clusters_full;
+
+static
+uint32_t cluster_hash(const cluster *c)
+{
+    uint32_t h = 2166136261U;
+
+    for (int i = 0; i < c->len; i++) h = (h ^ c->cps[i]) * 16777619U;
+    return h;
+}
+
+// The id of `c`, added to the table if it is new, 0 once the table is full
+static
+uint32_t cluster_intern(const cluster *c)
+{
+    uint32_t mask = 2 * CLUSTER_CAP - 1;
+    uint32_t i = cluster_hash(c) & mask;
+
+    if (clusters_index == NULL && (clusters_index = counted_calloc(2 * CLUSTER_CAP, sizeof *clusters_index)) == NULL)
+        return 0;
+
+    for (; clusters_index[i] != 0; i = (i + 1) & mask) {
+        const cluster *known = &clusters[clusters_index[i] - 1];
+
+        if (known->len == c->len && memcmp(known->cps, c->cps, c->len * sizeof *c->cps) == 0)
+            return CLUSTER_FIRST + clusters_index[i] - 1;
+    }
+
+    if (clusters_count == CLUSTER_CAP) {
+        if (!clusters_full) pretty_log(PRETTY_WARN, "%d grapheme clusters seen, new ones are cut short", CLUSTER_CAP);
+        clusters_full = true;
+        return 0;
+    }
+
+    if (clusters_count == clusters_cap) {
+        uint32_t cap = (clusters_cap > 0) ? clusters_cap * 2 : 256;
+        cluster *grown = counted_realloc(clusters, cap * sizeof *grown);
+
+        if (grown == NULL) return 0;
+        clusters = grown;
+        clusters_cap = cap;
+    }
+
+    clusters[clusters_count++] = *c;
+    clusters_index[i] = clusters_count;
+    return CLUSTER_FIRST + clusters_count - 1;
+}
+
+// Copies the codepoints of a cell, a cluster id or a codepoint on its own, returns how many
+size_t cluster_codepoints(uint32_t cp, uint32_t out[static CLUSTER_LEN_MAX])
+{
+    if (cp < CLUSTER_FIRST) {
+        out[0] = cp;
+        return 1;
+    }
+
+    size_t len = 1;
+
+    out[0] = 0xFFFD;
+    pthread_mutex_lock(&clusters_lock);
+    if (cp - CLUSTER_FIRST < clusters_count) {
+        const cluster *c = &clusters[cp - CLUSTER_FIRST];
+
+        len = c->len;
+        memcpy(out, c->cps, len * sizeof *out);
+    }
+    pthread_mutex_unlock(&clusters_lock);
+    return len;
+}
+
+// The cluster of `cp` followed by `next`, `cp` as is when the cluster can't grow
+uint32_t cluster_append(uint32_t cp, uint32_t next)
+{
+    cluster c;
+
+    c.len = cluster_codepoints(cp, c.cps);
+    if (c.len == CLUSTER_LEN_MAX) return cp;
+    c.cps[c.len++] = next;
+
+    pthread_mutex_lock(&clusters_lock);
+    uint32_t id = cluster_intern(&c);
+    pthread_mutex_unlock(&clusters_lock);
+
+    return (id != 0) ? id : cp;
+}
+
+// The utf-8 of a cell, at most CLUSTER_UTF8_MAX bytes, returns how many
+size_t cluster_utf8(uint32_t cp, char *out)
+{
+    uint32_t cps[CLUSTER_LEN_MAX];
+    size_t n = cluster_codepoints(cp, cps), len = 0;
+
+    for (size_t i = 0; i < n; i++) len += utf8_encode(cps[i], out + len);
+    return len;
+}
+
+// Writes the 1 to 4 bytes of `cp` to `out`, returns how many
+size_t utf8_encode(uint32_t cp, char *out)
+{
+    static const unsigned char lead[] = { 0, 0, 0xC0, 0xE0, 0xF0 };
+    size_t n = (cp < 0x80) ? 1 : (cp < 0x800) ? 2 : (cp < 0x10000) ? 3 : 4;
+
+    if (n == 1) {
+        out[0] = cp;
+        return 1;
+    }
+
+    for (size_t i = n - 1; i > 0; i--, cp >>= 6) out[i] = 0x80 | (cp & 0x3F);
+    out[0] = lead[n] | cp;
+    return n;
+}
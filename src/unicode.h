@@ -0,0 +1,56 @@
+#ifndef UNICODE_H
+    #define UNICODE_H
+
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include <stdint.h>
+
+/*
+ * A grapheme cluster of several codepoints is stored as one id past the
+ * last codepoint, so it fits a cell like a codepoint does. 0x110000 is
+ * left for the right half of wide cells.
+ */
+enum {
+    CLUSTER_FIRST = 0x110001,
+    CLUSTER_LEN_MAX = 8, // codepoints past this are dropped from the cluster
+    CLUSTER_CAP = 1 << 16, // distinct clusters, more are cut down to their first codepoint
+    CLUSTER_UTF8_MAX = CLUSTER_LEN_MAX * 4,
+};
+
+// Grapheme_Cluster_Break values, in the order tests/gen_unicode.pl numbers them
+enum grapheme_break {
+    GCB_OTHER,
+    GCB_CR,
+    GCB_LF,
+    GCB_CONTROL,
+    GCB_EXTEND,
+    GCB_ZWJ,
+    GCB_REGIONAL_INDICATOR,
+    GCB_PREPEND,
+    GCB_SPACING_MARK,
+    GCB_L,
+    GCB_V,
+    GCB_T,
+    GCB_LV,
+    GCB_LVT,
+};
+
+// What the previous codepoints of the current cluster leave behind for the next one
+typedef struct {
+    uint8_t prev;
+    bool started;
+    bool odd_regional;
+    bool emoji_sequence;
+} grapheme_state;
+
+int unicode_width(uint32_t cp);
+enum grapheme_break unicode_grapheme_break(uint32_t cp);
+bool unicode_extended_pictographic(uint32_t cp);
+bool unicode_emoji_presentation(uint32_t cp);
+bool grapheme_break(grapheme_state *st, uint32_t cp);
+size_t utf8_encode(uint32_t cp, char *out);
+uint32_t cluster_append(uint32_t cp, uint32_t next);
+size_t cluster_codepoints(uint32_t cp, uint32_t out[static CLUSTER_LEN_MAX]);
+size_t cluster_utf8(uint32_t cp, char *out);
+
+#endif // UNICODE_H
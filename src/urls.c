@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "trace.h"
+#include "urls.h"
+
+#define IS_ALPHA(c) (((c) | 0x20) >= 'a' && ((c) | 0x20) <= 'z')
+#define IS_SCHEME(c) (IS_ALPHA(c) || ((c) >= '0' && (c) <= '9') || (c) == '+' || (c) == '-' || (c) == '.')
+
+// What a link can be made of, quotes and brackets around one are left out
+static
+bool url_char(uint32_t c)
+{
+    if (c >= 0x80) return true; // the right half of a wide character too
+    return c > ' ' && c != 0x7F && strchr("\"'<>`{}|\\^", (int)c) == NULL;
+}
+
+// Where a file path may start, after a blank or something that usually comes before one
+static
+bool path_boundary(const uint32_t *text, int i)
+{
+    uint32_t c = (i > 0) ? text[i - 1] : ' ';
+
+    return !url_char(c) || (c < 0x80 && strchr("([=:,", (int)c) != NULL);
+}
+
+// Goes on up to a blank, a ')' or ']' closes only what the link opened itself
+static
+int link_end(const uint32_t *text, int len, int i, bool path)
+{
+    int depth = 0;
+
+    for (; i < len && url_char(text[i]); i++) {
+        uint32_t c = text[i];
+
+        if (c == '(' || c == '[') depth++;
+        else if (c == ')' || c == ']') {
+            if (depth == 0) break;
+            depth--;
+        } else if (c == ':' && path) break; // file.c:12:3 from compilers
+    }
+    return i;
+}
+
+// Punctuation ending a sentence is not part of the link in it
+static
+int link_trim(const uint32_t *text, int start, int end)
+{
+    while (end > start && text[end - 1] < 0x80 && strchr(".,:;!?", (int)text[end - 1]) != NULL) end--;
+    return end;
+}
+
+// The start of "scheme://" ending at `i`, -1 when there is no scheme before it
+static
+int scheme_start(const uint32_t *text, int i)
+{
+    int s = i;
+
+    while (s > 0 && text[s - 1] < 0x80 && IS_SCHEME(text[s - 1])) s--;
+    while (s < i && !IS_ALPHA(text[s])) s++;
+    return (s < i) ? s : -1;
+}
+
+/*
+ * Urls as scheme://..., and absolute or home relative file paths in a row
+ * of codepoints, 0 standing for a blank. Returns how many spans were
+ * found, at most `max`.
+ */
+size_t url_scan(const uint32_t *text, int len, url_span *spans, size_t max)
+{
+    size_t n = 0;
+
+    for (int i = 0; i < len && n < max;) {
+        int start = -1, end = i, body = i;
+
+        if (i + 2 < len && text[i] == ':' && text[i + 1] == '/' && text[i + 2] == '/') {
+            start = scheme_start(text, i);
+            body = i + 3;
+            end = link_end(text, len, body, false);
+        } else if ((text[i] == '/' || (text[i] == '~' && i + 1 < len && text[i + 1] == '/'))
+            && path_boundary(text, i)) {
+            start = i;
+            body = i + ((text[i] == '~') ? 2 : 1);
+            end = link_end(text, len, body, true);
+        }
+
+        if (start >= 0) end = link_trim(text, body, end);
+        if (start < 0 || end == body || (n > 0 && start < spans[n - 1].to)) {
+            i = (end > i) ? end : i + 1;
+            continue;
+        }
+
+        spans[n++] = (url_span){ (uint16_t)start, (uint16_t)end };
+        i = end;
+    }
+    return n;
+}
+
+static
+void *url_loop(void *arg)
+{
+    url_finder *uf = arg;
+    uint32_t text[URL_ROW_MAX];
+
+    trace_thread_name("url finder");
+
+    for (;;) {
+        pthread_mutex_lock(&uf->lock);
+        while (uf->queue_count == 0 && !uf->should_exit) pthread_cond_wait(&uf->wake, &uf->lock);
+
+        if (uf->should_exit) {
+            pthread_mutex_unlock(&uf->lock);
+            return NULL;
+        }
+
+        url_job *job = &uf->queue[uf->queue_head];
+        uint64_t hash = job->hash;
+        int len = job->len;
+
+        memcpy(text, job->text, len * sizeof *text);
+        uf->queue_head = (uf->queue_head + 1) % URL_QUEUE_CAP;
+        uf->queue_count--;
+        pthread_mutex_unlock(&uf->lock);
+
+        trace_span span = trace_begin("url_scan");
+        url_row row = { .hash = hash };
+
+        row.count = url_scan(text, len, row.spans, URL_SPANS_MAX);
+        trace_end(&span);
+
+        pthread_mutex_lock(&uf->lock);
+        uf->cache[hash % URL_CACHE_CAP] = row;
+        pthread_mutex_unlock(&uf->lock);
+    }
+}
+
+bool url_start(url_finder *uf)
+{
+    *uf = (url_finder){
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .wake = PTHREAD_COND_INITIALIZER,
+    };
+
+    if (pthread_create(&uf->thread, NULL, url_loop, uf) != 0) {
+        pretty_log(PRETTY_WARN, "Couldn't start the url finder, links are not detected");
+        return false;
+    }
+    uf->started = true;
+    return true;
+}
+
+void url_stop(url_finder *uf)
+{
+    if (!uf->started) return;
+
+    pthread_mutex_lock(&uf->lock);
+    uf->should_exit = true;
+    pthread_cond_broadcast(&uf->wake);
+    pthread_mutex_unlock(&uf->lock);
+
+    pthread_join(uf->thread, NULL);
+    uf->started = false;
+    pretty_log(PRETTY_DEBUG, "url finder dropped %zu rows on a full queue", uf->dropped);
+}
+
+// Queues a row that changed, unless its links are known already or it can't have any
+void url_submit(url_finder *uf, uint64_t hash, const cell *cells, int n)
+{
+    bool candidate = false;
+
+    if (n > URL_ROW_MAX) n = URL_ROW_MAX;
+
+    // most rows have neither a ':' nor a '/' and never get as far as the lock
+    for (int i = 0; i < n && !candidate; i++)
+        candidate = cells[i].codepoint == ':' || cells[i].codepoint == '/';
+    if (!candidate || !uf->started) return;
+
+    pthread_mutex_lock(&uf->lock);
+    if (uf->cache[hash % URL_CACHE_CAP].hash == hash) {
+        pthread_mutex_unlock(&uf->lock);
+        return;
+    }
+
+    if (uf->queue_count == URL_QUEUE_CAP) uf->dropped++;
+    else {
+        url_job *job = &uf->queue[(uf->queue_head + uf->queue_count) % URL_QUEUE_CAP];
+
+        job->hash = hash;
+        job->len = n;
+        for (int i = 0; i < n; i++) job->text[i] = cells[i].codepoint;
+
+        uf->queue_count++;
+        pthread_cond_signal(&uf->wake);
+    }
+    pthread_mutex_unlock(&uf->lock);
+}
+
+/*
+ * The link found at column `col` of a row, the row is queued when it was
+ * never looked at. Spans are cut to the `n` columns the row has now.
+ */
+bool url_find(url_finder *uf, uint64_t hash, const cell *cells, int n, int col, url_span *span)
+{
+    pthread_mutex_lock(&uf->lock);
+    const url_row *row = &uf->cache[hash % URL_CACHE_CAP];
+    bool known = row->hash == hash, found = false;
+
+    for (int i = 0; known && i < row->count && !found; i++) {
+        url_span s = { row->spans[i].from, (uint16_t)((row->spans[i].to < n) ? row->spans[i].to : n) };
+
+        found = col >= s.from && col < s.to;
+        if (found) *span = s;
+    }
+    pthread_mutex_unlock(&uf->lock);
+
+    if (!known) url_submit(uf, hash, cells, n);
+    return found;
+}
+
+/*
+ * What opening the link in `span` of a row of `n` cells asks for, file
+ * paths become file:// urls. The caller frees it with counted_free.
+ */
+char *url_target(const cell *cells, int n, url_span span)
+{
+    if (span.to > n) span.to = (uint16_t)n;
+    if (span.from >= span.to) return NULL;
+
+    const char *home = (cells[span.from].codepoint == '~') ? getenv("HOME") : "";
+    bool path = cells[span.from].codepoint == '/' || cells[span.from].codepoint == '~';
+    size_t prefix = path ? strlen("file://") + strlen((home != NULL) ? home : "") : 0;
+    char *uri = counted_malloc(prefix + (size_t)(span.to - span.from) * CLUSTER_UTF8_MAX + 1);
+
+    if (uri == NULL) return NULL;
+
+    size_t len = 0;
+    if (path) len = (size_t)sprintf(uri, "file://%s", (home != NULL) ? home : "");
+
+    for (int i = span.from + ((cells[span.from].codepoint == '~') ? 1 : 0); i < span.to; i++)
+        if (cells[i].codepoint != CELL_WIDE_SPACER) len += cluster_utf8(cells[i].codepoint, uri + len);
+    uri[len] = '\0';
+    return uri;
+}
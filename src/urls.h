@@ -0,0 +1,67 @@
+#ifndef URLS_H
+    #define URLS_H
+
+    #include <pthread.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include <stdint.h>
+
+    #include "screen.h"
+
+// columns of a row looked at, links further right in a wider row are not found
+enum { URL_ROW_MAX = 512 };
+// rows waiting for the worker, more are dropped until it catches up
+enum { URL_QUEUE_CAP = 64 };
+// rows whose links are remembered, by content hash
+enum { URL_CACHE_CAP = 4096 };
+enum { URL_SPANS_MAX = 4 };
+
+// Columns of a link in a row, up to but not including `to`
+typedef struct {
+    uint16_t from;
+    uint16_t to;
+} url_span;
+
+typedef struct {
+    uint64_t hash; // 0 for an empty slot
+    uint8_t count;
+    url_span spans[URL_SPANS_MAX];
+} url_row;
+
+typedef struct {
+    uint64_t hash;
+    int len;
+    uint32_t text[URL_ROW_MAX];
+} url_job;
+
+/*
+ * Finds urls and file paths in rows of text on a worker thread. The parser
+ * hands it the rows it hashed again because they changed, the results are
+ * kept by row hash so a row scrolling by or showing up again costs nothing.
+ * Nothing is looked for while drawing, the UI only asks for the row under
+ * the mouse.
+ */
+typedef struct url_finder {
+    pthread_t thread;
+    bool started;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    bool should_exit;
+
+    url_job queue[URL_QUEUE_CAP];
+    size_t queue_head;
+    size_t queue_count;
+    size_t dropped;
+
+    url_row cache[URL_CACHE_CAP]; // direct mapped, a colliding row replaces the one there
+} url_finder;
+
+bool url_start(url_finder *uf);
+void url_stop(url_finder *uf);
+void url_submit(url_finder *uf, uint64_t hash, const cell *cells, int n);
+bool url_find(url_finder *uf, uint64_t hash, const cell *cells, int n, int col, url_span *span);
+size_t url_scan(const uint32_t *text, int len, url_span *spans, size_t max);
+char *url_target(const cell *cells, int n, url_span span);
+
+#endif // URLS_H
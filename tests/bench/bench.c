@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+#include "pretty.h"
+
+// the benchmarks run without a ui to wake up
+void notify_ui_flush(unsigned int window_id)
+{
+}
+
+bench_result bench_last;
+
+uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// One JSON object per line, so runs on different commits can be diffed by scripts
+void bench_report(const bench_result *res)
+{
+    const char *rev = getenv("PRETTY_BENCH_REV");
+    double ns_per_op = (double)res->elapsed_ns / res->iters;
+
+    printf("{\"bench\": \"%s\", \"variant\": \"%s\", \"rev\": \"%s\", "
+        "\"iters\": %lu, \"ns_per_op\": %.2f, \"allocs_per_op\": %.3f",
+        res->name, res->variant, rev != NULL ? rev : "unknown",
+        (unsigned long)res->iters, ns_per_op, (double)res->allocs / res->iters);
+
+    if (res->bytes > 0)
+        printf(", \"mb_per_s\": %.2f",
+            (double)res->bytes / (1024 * 1024) / ((double)res->elapsed_ns / 1e9));
+
+    printf("}\n");
+    fflush(stdout);
+}
+
+/*
+ * Times parsing `s` over and over into a new 120x40 screen, which is left
+ * published in `scr` so the caller can check what the bytes did.
+ */
+bool bench_screen_feed(screen *scr, const char *variant, const char *s, size_t n)
+{
+    if (!screen_init(scr, 120, 40, SCREEN_HISTORY_CAP)) return false;
+
+    BENCH_RUN("screen_feed", variant, n, screen_feed(scr, s, n));
+    screen_publish(scr);
+    return true;
+}
+
+// True when visible row `row` of the snapshot starts with the ascii `text`
+bool bench_row_starts(const screen_snapshot *snap, int row, const char *text)
+{
+    size_t n = strlen(text);
+
+    if (row < 0 || row >= snap->rows || n > (size_t)snap->cols) return false;
+
+    const cell *cells = snap->cells + (size_t)row * snap->cols;
+
+    for (size_t i = 0; i < n; i++)
+        if (cells[i].codepoint != (unsigned char)text[i]) return false;
+    return true;
+}
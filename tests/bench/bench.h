@@ -0,0 +1,52 @@
+#ifndef BENCH_H
+    #define BENCH_H
+
+    #include <stddef.h>
+    #include <stdint.h>
+
+    #include "alloc.h"
+    #include "screen.h"
+
+// Minimum wall time spent on every measurement
+enum { BENCH_MIN_NS = 200 * 1000 * 1000 };
+
+typedef struct {
+    const char *name;
+    const char *variant;
+    uint64_t iters;
+    uint64_t elapsed_ns;
+    size_t bytes;
+    size_t allocs;
+} bench_result;
+
+// the result of the last BENCH_RUN, for benchmarks that check it
+extern bench_result bench_last;
+
+uint64_t bench_now_ns(void);
+void bench_report(const bench_result *res);
+bool bench_screen_feed(screen *scr, const char *variant, const char *s, size_t n);
+bool bench_row_starts(const screen_snapshot *snap, int row, const char *text);
+
+/*
+ * Runs `body` in batches until BENCH_MIN_NS elapsed, then reports one JSON
+ * line on stdout. `bytes_per_iter` may be 0 for benchmarks without throughput.
+ * Only allocations going through alloc.h on the calling thread are counted.
+ */
+    #define BENCH_RUN(bench_name, bench_variant, bytes_per_iter, body)        \
+        do {                                                                \
+            bench_result res_ = { bench_name, bench_variant, 0, 0, 0, 0 };   \
+            size_t allocs_ = alloc_thread_counters().allocs;                \
+            uint64_t start_ = bench_now_ns();                               \
+            for (uint64_t batch_ = 1; res_.elapsed_ns < BENCH_MIN_NS;        \
+                batch_ *= 2) {                                              \
+                for (uint64_t i_ = 0; i_ < batch_; i_++) { body; }          \
+                res_.iters += batch_;                                       \
+                res_.elapsed_ns = bench_now_ns() - start_;                  \
+            }                                                               \
+            res_.bytes = (size_t)(bytes_per_iter) * res_.iters;             \
+            res_.allocs = alloc_thread_counters().allocs - allocs_;         \
+            bench_report(&res_);                                            \
+            bench_last = res_;                                              \
+        } while (0)
+
+#endif // BENCH_H
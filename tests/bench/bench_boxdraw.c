@@ -0,0 +1,30 @@
+#include <stdlib.h>
+
+#include "bench.h"
+#include "boxdraw.h"
+#include "macro_utils.h"
+
+// a 10x20 cell at scale 1 and the same font on a 2x display
+static const struct { const char *variant; int w, h; } sizes[] = {
+    { "10x20", 10, 20 },
+    { "20x40", 20, 40 },
+};
+
+int main(void)
+{
+    enum { GLYPHS = (0x259F - 0x2500 + 1) + (0x28FF - 0x2800 + 1) };
+
+    for (size_t i = 0; i < length_of(sizes); i++) {
+        uint8_t *mask = malloc((size_t)sizes[i].w * sizes[i].h);
+
+        if (mask == NULL) return EXIT_FAILURE;
+
+        // every procedural glyph once, what a dashboard costs the first time it shows up
+        BENCH_RUN("boxdraw", sizes[i].variant, GLYPHS * (size_t)sizes[i].w * sizes[i].h,
+            for (uint32_t cp = 0x2500; cp <= 0x28FF; cp++) {
+                if (boxdraw_supported(cp)) boxdraw_render(cp, mask, sizes[i].w, sizes[i].h);
+            });
+        free(mask);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "config.h"
+#include "pretty.h"
+
+#define DEFAULT_CONFIG "config.toml"
+
+int main(int argc, char **argv)
+{
+    const char *path = (argc > 1) ? argv[1] : DEFAULT_CONFIG;
+    char *source = file_read(path);
+
+    if (source == NULL) {
+        fprintf(stderr, "bench_config: couldn't read [%s]\n", path);
+        return EXIT_FAILURE;
+    }
+
+    // the parser cuts the text in place, so every run parses a fresh copy
+    size_t len = strlen(source) + 1;
+    char *scratch = malloc(len);
+    if (scratch == NULL) return EXIT_FAILURE;
+
+    BENCH_RUN("return_config", path, len - 1,
+        (memcpy(scratch, source, len), return_config(scratch)));
+
+    free(scratch);
+    free(source);
+    return EXIT_SUCCESS;
+}
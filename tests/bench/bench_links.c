@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "screen.h"
+#include "urls.h"
+
+// a compiler error line, a path and a url to find in 120 columns
+static const char row[] =
+    "src/screen.c:12:5: see /usr/include/stdio.h and https://en.wikipedia.org/wiki/C_(language) for details";
+
+// what ls --hyperlink prints for one file
+static const char osc8[] = "\x1b]8;;file:///home/user/notes.txt\x1b\\notes.txt\x1b]8;;\x1b\\\r\n";
+
+int main(void)
+{
+    url_finder uf;
+    url_span spans[URL_SPANS_MAX], span;
+    uint32_t text[120] = { 0 };
+    cell cells[120] = { 0 };
+    screen scr;
+
+    for (size_t i = 0; i < sizeof(row) - 1; i++) text[i] = cells[i].codepoint = (unsigned char)row[i];
+
+    // what the worker does once per row that changed
+    BENCH_RUN("url_scan", "120 cols", sizeof(text), url_scan(text, 120, spans, URL_SPANS_MAX));
+
+    if (!url_start(&uf)) return EXIT_FAILURE;
+
+    // what the parser pays per dirty row, most have no ':' or '/' and are turned away early
+    cell plain[120] = { 0 };
+    for (int i = 0; i < 120; i++) plain[i].codepoint = 'a' + i % 26;
+    BENCH_RUN("url_submit", "no candidate", 0, url_submit(&uf, 1, plain, 120));
+
+    // a row seen before, found in the cache by its hash
+    while (!url_find(&uf, 2, cells, 120, 60, &span)) usleep(1000);
+    BENCH_RUN("url_submit", "cached", 0, url_submit(&uf, 2, cells, 120));
+
+    url_stop(&uf);
+
+    if (!bench_screen_feed(&scr, "osc 8", osc8, sizeof(osc8) - 1)) return EXIT_FAILURE;
+
+    // the name printed last links to the file, and nothing after it does
+    bool fresh;
+    const screen_snapshot *snap = screen_acquire(&scr, &fresh);
+    const cell *name = snap->cells + (size_t)(snap->cursor_y - 1) * snap->cols;
+    uint16_t link = snap->attrs[name[0].attr].link;
+    char *uri = screen_link_uri(&scr, link);
+    bool linked = link != 0 && uri != NULL && strcmp(uri, "file:///home/user/notes.txt") == 0
+        && bench_row_starts(snap, snap->cursor_y - 1, "notes.txt") && snap->attrs[name[9].attr].link == 0;
+
+    for (int i = 1; i < 9; i++) linked &= snap->attrs[name[i].attr].link == link;
+
+    counted_free(uri);
+    screen_destroy(&scr);
+    if (!linked) {
+        fprintf(stderr, "bench_links: the osc 8 cells don't carry the link\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
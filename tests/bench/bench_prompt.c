@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "prompt.h"
+#include "screen.h"
+
+// a full index spread over about a million lines of scrollback
+enum { LINES_PER_COMMAND = 512 };
+
+static
+uint64_t next_line(uint64_t *seed)
+{
+    *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (*seed >> 33) % ((uint64_t)PROMPT_MARKS_CAP * LINES_PER_COMMAND);
+}
+
+int main(void)
+{
+    prompt_index idx = { 0 };
+    volatile const prompt_mark *sink;
+    uint64_t seed = 1;
+
+    for (uint64_t i = 0; i < PROMPT_MARKS_CAP; i++) {
+        uint64_t line = i * LINES_PER_COMMAND;
+
+        prompt_index_add(&idx, MARK_PROMPT, (prompt_mark){ line, -1, 0 });
+        prompt_index_add(&idx, MARK_OUTPUT, (prompt_mark){ line + 1, -1, 0 });
+        prompt_index_add(&idx, MARK_DONE, (prompt_mark){ line + LINES_PER_COMMAND - 1, 0, 0 });
+    }
+
+    BENCH_RUN("prompt_index_before", "marks=2048", 0,
+        sink = prompt_index_before(&idx, MARK_PROMPT, next_line(&seed), 0));
+    BENCH_RUN("prompt_index_after", "marks=2048", 0,
+        sink = prompt_index_after(&idx, MARK_PROMPT, next_line(&seed), 0));
+
+    // inside every command, its own prompt is before and the next one after
+    for (uint64_t i = 0; i < PROMPT_MARKS_CAP; i++) {
+        uint64_t line = i * LINES_PER_COMMAND + LINES_PER_COMMAND / 2;
+        const prompt_mark *before = prompt_index_before(&idx, MARK_PROMPT, line, 0);
+        const prompt_mark *after = prompt_index_after(&idx, MARK_PROMPT, line, 0);
+
+        if (before == NULL || before->line != i * LINES_PER_COMMAND
+            || (after == NULL) != (i == PROMPT_MARKS_CAP - 1)
+            || (after != NULL && after->line != (i + 1) * LINES_PER_COMMAND)) {
+            fprintf(stderr, "bench_prompt: wrong prompts around line %lu\n", (unsigned long)line);
+            return EXIT_FAILURE;
+        }
+    }
+    prompt_index_free(&idx);
+
+    // shell integration wraps every command, its marks must not slow the parser down
+    static const char command[] =
+        "\x1b]133;A\x07$ \x1b]133;B\x07ls -l\r\n\x1b]133;C\x07"
+        "-rw-r--r-- 1 user user 4096 Jan  1 00:00 file\r\n"
+        "\x1b]133;D;0\x07";
+    screen scr;
+
+    if (!bench_screen_feed(&scr, "osc133", command, sizeof(command) - 1)) return EXIT_FAILURE;
+
+    // the last command is marked on its two lines, prompt and input on the first
+    const prompt_mark *prompt = prompt_index_last(&scr.prompts, MARK_PROMPT);
+    const prompt_mark *input = prompt_index_last(&scr.prompts, MARK_INPUT);
+    const prompt_mark *output = prompt_index_last(&scr.prompts, MARK_OUTPUT);
+    const prompt_mark *done = prompt_index_last(&scr.prompts, MARK_DONE);
+    bool marked = prompt != NULL && input != NULL && output != NULL && done != NULL
+        && prompt->col == 0 && input->line == prompt->line && input->col == 2
+        && output->line == prompt->line + 1 && done->line == prompt->line + 2 && done->status == 0;
+
+    screen_destroy(&scr);
+    if (!marked) {
+        fprintf(stderr, "bench_prompt: osc 133 marks are not where the command is\n");
+        return EXIT_FAILURE;
+    }
+
+    (void)sink;
+    return EXIT_SUCCESS;
+}
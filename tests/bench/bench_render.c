@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <SDL3/SDL.h>
+
+#include "bench.h"
+#include "config.h"
+#include "font.h"
+#include "renderer.h"
+#include "screen.h"
+
+// frames drawn while waiting for the glyphs to be rasterised
+enum { SETTLE_FRAMES = 1000 };
+
+/*
+ * The SDL renderer path drawing into a surface through the software
+ * renderer, so it runs without a display. Steady state frames must not
+ * allocate, like the GL ones in bench_gl.
+ */
+typedef struct {
+    SDL_Renderer *renderer;
+    glyph_atlas *atlas;
+    frame_state frame;
+    struct dim size;
+    generic_config *conf;
+} sdl_target;
+
+static
+bool draw(sdl_target *t, const screen_snapshot *snap)
+{
+    return atlas_sync(t->atlas)
+        && render_frame(t->renderer, t->atlas, &t->frame, t->size, snap, &t->atlas->cache->font, t->conf);
+}
+
+static
+void scroll_frame(screen *scr, sdl_target *t)
+{
+    static const char line[] = "\r\n\x1b[1;32mok\x1b[0m the quick brown fox jumps over the lazy dog";
+    bool fresh;
+
+    screen_feed(scr, line, sizeof(line) - 1);
+    screen_publish(scr);
+    draw(t, screen_acquire(scr, &fresh));
+}
+
+int main(void)
+{
+    generic_config *conf = return_config(NULL);
+    sdl_target t = { .size = { 1280, 720 }, .conf = conf };
+    size_t unchanged_allocs;
+    font_info font;
+    screen scr;
+    bool fresh;
+
+    SDL_Surface *surface = SDL_CreateSurface(t.size.width, t.size.height, SDL_PIXELFORMAT_RGBA32);
+    if (surface == NULL || (t.renderer = SDL_CreateSoftwareRenderer(surface)) == NULL) {
+        fprintf(stderr, "bench_render: no software renderer: %s\n", SDL_GetError());
+        return EXIT_FAILURE;
+    }
+
+    if (!collect_font(conf->font_name, conf->font_size, &font)) return EXIT_FAILURE;
+
+    glyph_cache *cache = create_glyph_cache(font.ttf, 1.0f, conf);
+    if (cache == NULL || (t.atlas = create_atlas(t.renderer, cache)) == NULL) return EXIT_FAILURE;
+
+    struct dim grid = grid_size(t.size, &cache->font, conf, 1.0f);
+    if (!screen_init(&scr, grid.width, grid.height, SCREEN_HISTORY_CAP)) return EXIT_FAILURE;
+    for (int i = 0; i < grid.height; i++) scroll_frame(&scr, &t);
+
+    // every glyph on screen is baked before anything is timed
+    const screen_snapshot *snap = screen_acquire(&scr, &fresh);
+    for (int i = 0; i < SETTLE_FRAMES && (i == 0 || t.frame.glyphs_pending); i++) {
+        glyph_cache_commit(cache);
+        draw(&t, snap);
+        SDL_Delay(1);
+    }
+
+    // nothing changed, every row is found drawn already
+    BENCH_RUN("render_frame", "unchanged", 0, draw(&t, snap));
+    unchanged_allocs = bench_last.allocs;
+
+    // every frame scrolls by one line, the origin moves and a single row is drawn
+    BENCH_RUN("render_frame", "scroll", 0, scroll_frame(&scr, &t));
+
+    screen_destroy(&scr);
+    frame_destroy(&t.frame);
+    atlas_destroy(t.atlas);
+    glyph_cache_destroy(cache);
+    SDL_DestroyRenderer(t.renderer);
+    SDL_DestroySurface(surface);
+    SDL_Quit();
+
+    if (unchanged_allocs > 0 || bench_last.allocs > 0) {
+        fprintf(stderr, "render_frame allocated %zu times in steady state\n", unchanged_allocs + bench_last.allocs);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "macro_utils.h"
+#include "slave.h"
+
+enum { RING_CAP = 64 * 1024 };
+
+static char payload[RING_CAP];
+
+// Writes then drains `chunk` bytes, the head and tail walk around the whole ring
+static
+void ring_roundtrip(tty_state *tty, size_t chunk)
+{
+    const char *p;
+    size_t n;
+
+    ring_write(tty, payload, chunk);
+
+    while ((n = ring_read_span(tty, &p)) > 0) ring_consume(tty, n);
+}
+
+// Keeps the ring half full so every span splits at the end of the buffer
+static
+void ring_half_full(tty_state *tty, size_t chunk)
+{
+    const char *p;
+    size_t n = ring_write(tty, payload, chunk);
+
+    while (n > 0) {
+        size_t span = ring_read_span(tty, &p);
+
+        if (span > n) span = n;
+        ring_consume(tty, span);
+        n -= span;
+    }
+}
+
+int main(void)
+{
+    static const size_t chunks[] = { 1, 16, 64, 512, 4096, 16384 };
+    tty_state tty = { 0 };
+    char variant[64];
+
+    memset(payload, 'x', sizeof(payload));
+
+    if (!ring_init(&tty, RING_CAP, RING_CAP)) return EXIT_FAILURE;
+
+    for (size_t i = 0; i < length_of(chunks); i++) {
+        size_t chunk = chunks[i];
+
+        snprintf(variant, sizeof(variant), "chunk=%zu", chunk);
+        BENCH_RUN("ring_write", variant, chunk,
+            (ring_write(&tty, payload, chunk), ring_consume(&tty, chunk)));
+
+        BENCH_RUN("ring_roundtrip", variant, chunk, ring_roundtrip(&tty, chunk));
+
+        // prefill half the ring with an odd offset so spans keep wrapping
+        tty.head = tty.tail = 0;
+        ring_write(&tty, payload, RING_CAP / 2 + 7);
+        snprintf(variant, sizeof(variant), "chunk=%zu,wrapping", chunk);
+        BENCH_RUN("ring_roundtrip", variant, chunk, ring_half_full(&tty, chunk));
+        tty.head = tty.tail = 0;
+    }
+
+    ring_free(&tty);
+    return EXIT_SUCCESS;
+}
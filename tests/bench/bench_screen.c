@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "screen.h"
+
+enum { FEED_COLS = 200, FEED_ROWS = 50, FEED_HISTORY = 1000 };
+
+static
+void feed_line(screen *scr, size_t i)
+{
+    char line[FEED_COLS + 2];
+    int len = snprintf(line, sizeof(line), "%010zu: the quick brown fox jumps over the lazy dog\r\n", i);
+
+    screen_feed(scr, line, len);
+}
+
+// the same line the way a compiler or `ls --color` would print it
+static
+void feed_colored_line(screen *scr, size_t i)
+{
+    char line[FEED_COLS + 2];
+    int len = snprintf(line, sizeof(line),
+        "\033[1;31m%010zu\033[0m: the \033[38;5;208mquick\033[0m brown \033[38;2;0;175;255mfox\033[0m "
+        "jumps over the \033[4mlazy\033[24m dog\r\n", i);
+
+    screen_feed(scr, line, len);
+}
+
+// every character in a colour of its own, the way a truecolor gradient or image viewer prints
+static
+void feed_truecolor_line(screen *scr, size_t i)
+{
+    char line[FEED_COLS * 24];
+    int len = 0;
+
+    for (int x = 0; x < 64; x++) {
+        uint32_t rgb = (uint32_t)(i * 64 + x) * 2654435761U;
+
+        len += snprintf(line + len, sizeof(line) - len, "\033[38;2;%u;%u;%um#",
+            (rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF);
+    }
+    len += snprintf(line + len, sizeof(line) - len, "\033[0m\r\n");
+
+    screen_feed(scr, line, len);
+}
+
+int main(void)
+{
+    screen scr;
+    size_t n = 0;
+
+    if (!screen_init(&scr, FEED_COLS, FEED_ROWS, FEED_HISTORY)) return EXIT_FAILURE;
+
+    // overflow the scrollback twice so every page in flight has been recycled once,
+    // lines keep the same width so the number of pages in flight stays put
+    while (n < 2 * FEED_HISTORY + FEED_ROWS) feed_line(&scr, n++);
+
+    BENCH_RUN("screen_feed", "history=full", 0, feed_line(&scr, n++));
+    size_t plain_allocs = bench_last.allocs;
+
+    BENCH_RUN("screen_feed", "history=full,sgr", 0, feed_colored_line(&scr, n++));
+    size_t sgr_allocs = bench_last.allocs;
+
+    // far more looks than there are attribute ids, the ones history holds must not pin them
+    while (n < 4 * FEED_HISTORY) feed_truecolor_line(&scr, n++);
+    BENCH_RUN("screen_feed", "history=full,truecolor", 0, feed_truecolor_line(&scr, n++));
+    screen_destroy(&scr);
+
+    // scrollback pages are recycled, a steady stream of lines must not hit malloc
+    if (plain_allocs > 0 || sgr_allocs > 0 || bench_last.allocs > 0) {
+        fprintf(stderr, "screen_feed allocated %zu times in steady state\n",
+            plain_allocs + sgr_allocs + bench_last.allocs);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
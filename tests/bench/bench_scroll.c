@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "macro_utils.h"
+#include "renderer.h"
+#include "screen.h"
+
+enum { SCROLL_COLS = 200, SCROLL_ROWS = 50 };
+
+// Sweeps the view up to the oldest line and back down again
+static
+void scroll_step(screen *scr, bool publish)
+{
+    static enum event dir = SCROLL_UP;
+
+    if (dir == SCROLL_UP && scr->view_offset == scr->history_count) dir = SCROLL_DOWN;
+    else if (dir == SCROLL_DOWN && scr->view_offset == 0) dir = SCROLL_UP;
+
+    calculate_scroll(scr, dir);
+    if (publish) screen_publish(scr);
+}
+
+static
+bool fill_history(screen *scr, size_t lines)
+{
+    char line[SCROLL_COLS + 2];
+
+    for (size_t i = 0; i < lines; i++) {
+        int len = snprintf(line, sizeof(line), "%zu: the quick brown fox jumps over the lazy dog\r\n", i);
+
+        screen_feed(scr, line, len);
+    }
+    return scr->history_count > 0;
+}
+
+int main(void)
+{
+    static const size_t histories[] = { 100, 1000, SCREEN_HISTORY_CAP };
+    char variant[64];
+
+    for (size_t i = 0; i < length_of(histories); i++) {
+        screen scr;
+
+        if (!screen_init(&scr, SCROLL_COLS, SCROLL_ROWS, histories[i])) return EXIT_FAILURE;
+        if (!fill_history(&scr, histories[i] + SCROLL_ROWS)) return EXIT_FAILURE;
+
+        snprintf(variant, sizeof(variant), "history=%zu", scr.history_count);
+        BENCH_RUN("calculate_scroll", variant, 0, scroll_step(&scr, false));
+        BENCH_RUN("calculate_scroll+publish", variant, 0, scroll_step(&scr, true));
+
+        screen_destroy(&scr);
+    }
+    return EXIT_SUCCESS;
+}
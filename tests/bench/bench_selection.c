@@ -0,0 +1,43 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "clipboard.h"
+#include "screen.h"
+
+int main(void)
+{
+    static const char line[] = "\x1b[1;32mok\x1b[0m the quick brown fox jumps over the lazy dog\r\n";
+    screen scr;
+    text_pos from, to;
+    size_t len;
+
+    if (!screen_init(&scr, 120, 40, SCREEN_HISTORY_CAP)) return EXIT_FAILURE;
+    for (int i = 0; i < SCREEN_HISTORY_CAP + 40; i++) screen_feed(&scr, line, sizeof(line) - 1);
+
+    // selecting all of the scrollback is two positions, whatever its size
+    BENCH_RUN("screen_select_all", "history=10000", 0, screen_select_all(&scr));
+    if (!screen_selection(&scr, &from, &to)) return EXIT_FAILURE;
+
+    // the longest the parser can wait on a copy in progress
+    BENCH_RUN("screen_selection_text", "chunk", 0,
+        counted_free(screen_selection_text(&scr, from, to, from.line, from.line + CLIP_CHUNK_LINES - 1, &len)));
+
+    // the chunk is the text of its lines without the colours, one per line
+    static const char text[] = "ok the quick brown fox jumps over the lazy dog\n";
+    char *chunk = screen_selection_text(&scr, from, to, from.line, from.line + CLIP_CHUNK_LINES - 1, &len);
+    bool copied = chunk != NULL && len == CLIP_CHUNK_LINES * (sizeof(text) - 1) - 1;
+
+    // the last line has no newline after it
+    for (size_t at = 0; copied && at < len; at += sizeof(text) - 1)
+        copied = memcmp(chunk + at, text, (len - at < sizeof(text) - 1) ? len - at : sizeof(text) - 1) == 0;
+
+    counted_free(chunk);
+    screen_destroy(&scr);
+    if (!copied) {
+        fprintf(stderr, "bench_selection: the selected text isn't what was printed\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
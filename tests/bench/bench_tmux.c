@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "screen.h"
+#include "tmux.h"
+
+// what tmux -CC sends for a coloured line a pane printed, escapes already octal
+static const char output[] =
+    "%output %0 \\033[1;32mok\\033[0m the quick brown fox jumps over the lazy dog\\015\\012\n";
+
+int main(void)
+{
+    tty_state tty = { .pty_master_fd = -1 };
+    tmux_client tc;
+    screen scr;
+
+    if (!screen_init(&scr, 120, 40, SCREEN_HISTORY_CAP)) return EXIT_FAILURE;
+
+    tty.screen = &scr;
+    tty.tmux = &tc;
+    tmux_init(&tc);
+    tmux_resize(&tc, &tty, 120, 40);
+    tmux_start(&tc, &tty);
+
+    BENCH_RUN("tmux_feed", "output", sizeof(output) - 1, tmux_feed(&tc, &tty, output, sizeof(output) - 1));
+    BENCH_RUN("tmux_publish", "output", 0,
+        (tmux_feed(&tc, &tty, output, sizeof(output) - 1), tmux_publish(&tc)));
+
+    // the line ends up in the grid of pane %0, coloured, and the outer screen never sees it
+    screen *pane = NULL;
+    for (int i = 0; i < TMUX_PANES_CAP; i++)
+        if (tc.panes[i].scr != NULL && tc.panes[i].id == 0) pane = tc.panes[i].scr;
+
+    bool fresh, shown = false;
+    if (pane != NULL) {
+        const screen_snapshot *snap = screen_acquire(pane, &fresh);
+        const cell_attr *ok = &snap->attrs[snap->cells[(size_t)(snap->cursor_y - 1) * snap->cols].attr];
+
+        shown = bench_row_starts(snap, snap->cursor_y - 1, "ok the quick brown fox jumps over the lazy dog")
+            && ok->fg == (ATTR_COLOR_INDEXED | 2) && (ok->flags & ATTR_BOLD);
+    }
+    shown &= !bench_row_starts(screen_acquire(&scr, &fresh), 0, "ok");
+
+    tmux_free(&tc);
+    screen_destroy(&scr);
+    if (!shown) {
+        fprintf(stderr, "bench_tmux: %%output didn't reach the grid of pane %%0\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
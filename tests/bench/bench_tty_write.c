@@ -0,0 +1,43 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "macro_utils.h"
+#include "slave.h"
+
+enum { INPUT_SIZE = 4096 };
+
+static char input[INPUT_SIZE];
+
+// A carriage return every `stride` bytes, 1 means the input is only CRs
+static
+void fill_input(size_t stride)
+{
+    for (size_t i = 0; i < sizeof(input); i++)
+        input[i] = (i % stride == stride - 1) ? '\r' : 'a';
+}
+
+int main(void)
+{
+    static const size_t strides[] = { 1, 2, 8, 80, INPUT_SIZE + 1 };
+    char variant[64];
+
+    // the write syscalls are part of the cost, /dev/null keeps them cheap and stable
+    tty_state tty = { .pty_master_fd = open("/dev/null", O_WRONLY) };
+    if (tty.pty_master_fd < 0) return EXIT_FAILURE;
+
+    for (size_t i = 0; i < length_of(strides); i++) {
+        fill_input(strides[i]);
+
+        if (strides[i] > INPUT_SIZE) snprintf(variant, sizeof(variant), "cr_every=never");
+        else snprintf(variant, sizeof(variant), "cr_every=%zu", strides[i]);
+
+        BENCH_RUN("tty_write", variant, sizeof(input), tty_write(&tty, input, sizeof(input)));
+    }
+
+    close(tty.pty_master_fd);
+    return EXIT_SUCCESS;
+}
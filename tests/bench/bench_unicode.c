@@ -0,0 +1,36 @@
+// wcwidth is an X/Open extension
+#define _XOPEN_SOURCE 700
+
+#include <locale.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+#include "bench.h"
+#include "macro_utils.h"
+#include "unicode.h"
+
+// a mix of ascii, accented latin, cjk and emoji, like a busy log line
+static const uint32_t sample[] = {
+    'h', 'e', 'l', 'l', 'o', ' ', 0xE9, 0x301, ' ', 0x4E2D, 0x6587, ' ',
+    0x1F600, 0x200D, 0x1F469, ' ', 0x3042, 0x30A2, 'z', 0xAC00,
+};
+
+enum { SAMPLE_LEN = length_of(sample) };
+
+int main(void)
+{
+    volatile int sink = 0;
+
+    setlocale(LC_CTYPE, "C.UTF-8");
+
+    BENCH_RUN("width", "tables", SAMPLE_LEN * sizeof(uint32_t),
+        for (int i = 0; i < SAMPLE_LEN; i++) sink += unicode_width(sample[i]));
+    BENCH_RUN("width", "wcwidth", SAMPLE_LEN * sizeof(uint32_t),
+        for (int i = 0; i < SAMPLE_LEN; i++) sink += wcwidth((wchar_t)sample[i]));
+
+    grapheme_state st = { 0 };
+    BENCH_RUN("grapheme_break", "tables", SAMPLE_LEN * sizeof(uint32_t),
+        for (int i = 0; i < SAMPLE_LEN; i++) sink += grapheme_break(&st, sample[i]));
+
+    return EXIT_SUCCESS;
+}
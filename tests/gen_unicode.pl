@@ -0,0 +1,124 @@
+#!/usr/bin/env perl
+# Generates src/unicode_tables.h from the Unicode database shipped with perl:
+#   perl tests/gen_unicode.pl > src/unicode_tables.h
+#
+# Every codepoint maps to one property byte, looked up in two stages:
+#   unicode_stage2[unicode_stage1[cp >> SHIFT] * BLOCK + (cp & (BLOCK - 1))]
+# Identical blocks are stored once, which keeps the tables around 30 KiB.
+use strict;
+use warnings;
+use Unicode::UCD qw(prop_invmap prop_invlist);
+
+my $SHIFT = 7;
+my $BLOCK = 1 << $SHIFT;
+my $MAX_CP = 0x110000;
+
+# must match enum grapheme_break in src/unicode.h
+my @GCB = qw(Other CR LF Control Extend ZWJ Regional_Indicator Prepend
+    SpacingMark L V T LV LVT);
+my %gcb_index = map { $GCB[$_] => $_ } 0 .. $#GCB;
+
+# Expands an inversion map into one value per codepoint
+sub expand_map {
+    my ($prop) = @_;
+    my ($ranges, $values) = prop_invmap($prop);
+    my @out;
+
+    for my $i (0 .. $#$ranges) {
+        my $end = ($i < $#$ranges) ? $ranges->[$i + 1] : $MAX_CP;
+        $out[$_] = $values->[$i] for $ranges->[$i] .. $end - 1;
+    }
+    return \@out;
+}
+
+sub expand_list {
+    my ($prop) = @_;
+    my @ranges = prop_invlist($prop);
+    my @out = (0) x $MAX_CP;
+
+    for (my $i = 0; $i < @ranges; $i += 2) {
+        my $end = ($i + 1 < @ranges) ? $ranges[$i + 1] : $MAX_CP;
+        $out[$_] = 1 for $ranges[$i] .. $end - 1;
+    }
+    return \@out;
+}
+
+my $eaw = expand_map('East_Asian_Width');
+my $gc = expand_map('General_Category');
+my $gcb = expand_map('Grapheme_Cluster_Break');
+my $emoji_pres = expand_list('Emoji_Presentation');
+my $ext_pict = expand_list('Extended_Pictographic');
+
+sub width {
+    my ($cp) = @_;
+    my $cat = $gc->[$cp];
+
+    return 0 if $cat eq 'Cc' || $cat eq 'Mn' || $cat eq 'Me';
+    # the soft hyphen is the one format character terminals draw
+    return 0 if $cat eq 'Cf' && $cp != 0xAD;
+    # hangul medial vowels and final consonants join the syllable before them
+    return 0 if $cp >= 0x1160 && $cp <= 0x11FF;
+    return 0 if $cp == 0x200B;
+    return 2 if $eaw->[$cp] eq 'W' || $eaw->[$cp] eq 'F' || $emoji_pres->[$cp];
+    return 1;
+}
+
+my @props;
+for my $cp (0 .. $MAX_CP - 1) {
+    # perl folds Extended_Pictographic into the break property, the flag carries it
+    my $brk = $gcb->[$cp] =~ s/^ExtPict_XX$/Other/r;
+
+    die "unknown grapheme break value [$brk]\n" unless exists $gcb_index{$brk};
+
+    $props[$cp] = width($cp)
+        | ($gcb_index{$brk} << 2)
+        | ($ext_pict->[$cp] << 6)
+        | ($emoji_pres->[$cp] << 7);
+}
+
+my (@stage1, @stage2, %seen);
+for (my $cp = 0; $cp < $MAX_CP; $cp += $BLOCK) {
+    my @block = @props[$cp .. $cp + $BLOCK - 1];
+    my $key = pack('C*', @block);
+
+    if (!exists $seen{$key}) {
+        $seen{$key} = @stage2 / $BLOCK;
+        push @stage2, @block;
+    }
+    push @stage1, $seen{$key};
+}
+
+sub emit {
+    my ($values, $per_line) = @_;
+    my $out = '';
+
+    for (my $i = 0; $i < @$values; $i += $per_line) {
+        my $end = $i + $per_line - 1;
+        $end = $#$values if $end > $#$values;
+        $out .= '    ' . join(', ', @$values[$i .. $end]) . ",\n";
+    }
+    return $out;
+}
+
+die "too many distinct blocks for an 8 bit stage1\n" if @stage2 / $BLOCK > 256;
+
+my $version = Unicode::UCD::UnicodeVersion();
+my $nstage1 = @stage1;
+my $nstage2 = @stage2;
+
+print <<"EOF";
+// Generated by tests/gen_unicode.pl from Unicode $version, do not edit
+#ifndef UNICODE_TABLES_H
+    #define UNICODE_TABLES_H
+
+    #include <stdint.h>
+
+    #define UNICODE_VERSION "$version"
+    #define UNICODE_SHIFT $SHIFT
+
+static const uint8_t unicode_stage1[$nstage1] = {
+EOF
+print emit(\@stage1, 16);
+print "};\n\nstatic const uint8_t unicode_stage2[$nstage2] = {\n";
+print emit(\@stage2, 16);
+print "};\n\n#endif // UNICODE_TABLES_H\n";